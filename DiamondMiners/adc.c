@@ -0,0 +1,94 @@
+/*
+ * adc.c
+ *
+ * Author: Matthew Chen
+ *
+ * See adc.h. The ISR alternates between the two joystick channels, so each
+ * axis is sampled at about 4.8kHz with the 125kHz ADC clock (13 ADC clocks
+ * per conversion).
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "adc.h"
+#include "isr_trace.h"
+
+// Each axis is smoothed with an exponential moving average. The filter
+// state is kept scaled up by 2^ADC_FILTER_SHIFT so no precision is lost.
+#define ADC_FILTER_SHIFT 2
+
+typedef struct {
+	uint16_t x;
+	uint16_t y;
+} JoystickSnapshot;
+
+// Two snapshots - the ISR writes into the one readers aren't using and
+// then flips published to point at it. sequence is bumped on every flip so
+// a reader can tell if it was overtaken while copying. The snapshots are
+// volatile too, so the compiler can't move the reader's copy out from
+// between its two reads of sequence.
+static volatile JoystickSnapshot snapshots[2];
+static volatile uint8_t published;
+static volatile uint8_t sequence;
+static uint8_t last_read_sequence;
+
+// Filter state for each axis (only used by the ISR)
+static uint16_t filtered_x;
+static uint16_t filtered_y;
+
+void init_adc(void) {
+	// Both axes start centred
+	filtered_x = filtered_y = 512 << ADC_FILTER_SHIFT;
+	snapshots[0].x = snapshots[0].y = 512;
+	snapshots[1].x = snapshots[1].y = 512;
+	published = 0;
+	sequence = 0;
+	last_read_sequence = 0;
+
+	// AVCC reference, right adjust, start with the x channel
+	ADMUX = (1<<REFS0) | ADC_CHANNEL_X;
+	// Turn on the ADC with a clock divider of 64 (8MHz / 64 = 125kHz, the
+	// ADC clock must be between 50kHz and 200kHz), enable the conversion
+	// complete interrupt and start the first conversion.
+	ADCSRA = (1<<ADEN)|(1<<ADIE)|(1<<ADPS2)|(1<<ADPS1)|(1<<ADSC);
+}
+
+uint8_t adc_read_joystick(uint16_t* x, uint16_t* y) {
+	uint8_t seq;
+	JoystickSnapshot copy;
+	do {
+		seq = sequence;
+		uint8_t which = published;
+		copy.x = snapshots[which].x;
+		copy.y = snapshots[which].y;
+		// If the ISR published again while we were copying, the snapshot we
+		// were reading may have been reused - try again.
+	} while (seq != sequence);
+	*x = copy.x;
+	*y = copy.y;
+	uint8_t is_new = (seq != last_read_sequence);
+	last_read_sequence = seq;
+	return is_new;
+}
+
+ISR(ADC_vect) {
+	ISR_TRACE_ENTER_A(ISR_TRACE_PIN_ADC);
+	uint16_t value = ADC;
+	if (ADMUX & 1) {
+		filtered_y += value - (filtered_y >> ADC_FILTER_SHIFT);
+		// Publish the pair into the snapshot nobody is reading
+		uint8_t next = published ^ 1;
+		snapshots[next].x = filtered_x >> ADC_FILTER_SHIFT;
+		snapshots[next].y = filtered_y >> ADC_FILTER_SHIFT;
+		published = next;
+		sequence++;
+	} else {
+		filtered_x += value - (filtered_x >> ADC_FILTER_SHIFT);
+	}
+	// Swap channels and start the next conversion. The multiplexer can be
+	// changed now since no conversion is running.
+	ADMUX ^= 1;
+	ADCSRA |= (1<<ADSC);
+	ISR_TRACE_EXIT_A(ISR_TRACE_PIN_ADC);
+}
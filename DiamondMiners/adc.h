@@ -0,0 +1,34 @@
+/*
+ * adc.h
+ *
+ * Author: Matthew Chen
+ *
+ * Interrupt driven sampling of the joystick on ADC0 (x) and ADC1 (y).
+ * Once started the ADC never stops: each time a conversion finishes the
+ * ADC complete interrupt stores the result, switches to the other channel
+ * and starts the next conversion. The readings are smoothed and an (x, y)
+ * pair is published to a double buffered snapshot after every y
+ * conversion, so reading the joystick never has to wait for the ADC.
+ */
+
+#ifndef ADC_H_
+#define ADC_H_
+
+#include <stdint.h>
+
+#define ADC_CHANNEL_X 0
+#define ADC_CHANNEL_Y 1
+
+/* Sets up the ADC (AVCC reference, 125kHz ADC clock) and starts the first
+ * conversion. Readings will only start arriving once interrupts are enabled
+ * globally.
+ */
+void init_adc(void);
+
+/* Copies the most recent filtered joystick reading (0 to 1023 on each axis)
+ * into x and y. Never blocks. Returns 1 if a new reading has been published
+ * since the last call, 0 if the values are the same as last time.
+ */
+uint8_t adc_read_joystick(uint16_t* x, uint16_t* y);
+
+#endif /* ADC_H_ */
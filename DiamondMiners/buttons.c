@@ -2,26 +2,43 @@
  * buttons.c
  *
  * Author: Peter Sutton
- */ 
+ * Modified by Matthew Chen (debouncing, events and a lock free queue,
+ * latency stamps, trace markers)
+ */
 
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include "buttons.h"
+#include "timer0.h"
+#include "isr_trace.h"
+#include "input.h"
+#include "latency.h"
 
-// Global variable to keep track of the last button state so that we 
-// can detect changes when an interrupt fires. The lower 4 bits (0 to 3)
-// will correspond to the last state of port B pins 0 to 3.
-static volatile uint8_t last_button_state;
-
-// Our button queue. button_queue[0] is always the head of the queue. If we
-// take something off the queue we just move everything else along. We don't
-// use a circular buffer since it is usually expected that the queue is very
-// short. In most uses it will never have more than 1 element at a time.
-// This button queue can be changed by the interrupt handler below so we should
-// turn off interrupts if we're changing the queue outside the handler.
-#define BUTTON_QUEUE_SIZE 4
-static volatile uint8_t button_queue[BUTTON_QUEUE_SIZE];
-static volatile int8_t queue_length;
+#define BUTTON_QUEUE_MASK (BUTTON_QUEUE_SIZE - 1)
+
+// Global variable to keep track of the debounced button state. The lower
+// 4 bits (0 to 3) correspond to the state of port B pins 0 to 3.
+static volatile uint8_t button_state;
+
+// Buttons that changed recently and are ignored until their debounce time
+// has passed (one bit per button), and when each of them changed. Only
+// the interrupt handlers use these.
+static uint8_t locked;
+static uint16_t lock_time[4];
+// When each held button should next send a hold event
+static uint32_t next_hold_time[4];
+
+// Our event queue. This is a circular buffer with separate head and tail
+// indices. Only the interrupt handlers add events (they can't interrupt
+// each other so there is only ever one writer) and they only change
+// queue_head. Only button_get_event() removes events and it only changes
+// queue_tail. That means neither side needs to turn interrupts off.
+// The indices are free running and are masked when used, so
+// queue_head - queue_tail is always the number of events in the queue.
+static volatile ButtonEvent button_queue[BUTTON_QUEUE_SIZE];
+static volatile uint8_t queue_head;
+static volatile uint8_t queue_tail;
+static volatile uint16_t overflow_count;
 
 // Setup interrupt if any of pins B0 to B3 change. We do this
 // using a pin change interrupt. These pins correspond to pin
@@ -30,66 +47,135 @@ static volatile int8_t queue_length;
 void init_button_interrupts(void) {
 	// Enable the interrupt (see datasheet page 77)
 	PCICR |= (1<<PCIE1);
-	
-	// Make sure the interrupt flag is cleared (by writing a 
+
+	// Make sure the interrupt flag is cleared (by writing a
 	// 1 to it) (see datasheet page 78)
 	PCIFR |= (1<<PCIF1);
-	
+
 	// Choose which pins we're interested in by setting
 	// the relevant bits in the mask register (see datasheet page 78)
-	PCMSK1 |= (1<<PCINT8)|(1<<PCINT9)|(1<<PCINT10)|(1<<PCINT11);	
-	
-	// Empty the button push queue
-	queue_length = 0;
+	PCMSK1 |= (1<<PCINT8)|(1<<PCINT9)|(1<<PCINT10)|(1<<PCINT11);
+
+	// Empty the event queue
+	queue_head = 0;
+	queue_tail = 0;
+	overflow_count = 0;
+	locked = 0;
+	button_state = PINB & 0x0F;
+}
+
+// Adds an event to the queue. Must only be called from an interrupt handler.
+static void queue_event(uint8_t button, uint8_t type, uint32_t time) {
+	uint8_t head = queue_head;
+	if((uint8_t)(head - queue_tail) >= BUTTON_QUEUE_SIZE) {
+		overflow_count++;
+		return;
+	}
+	volatile ButtonEvent* event = &button_queue[head & BUTTON_QUEUE_MASK];
+	event->button = button;
+	event->type = type;
+	event->time = time;
+	// Only make the event visible once it has been filled in
+	queue_head = head + 1;
+	if(type != BUTTON_EVENT_RELEASE) {
+		latency_stamp(INPUT_SOURCE_BUTTON);
+	}
+}
+
+// Records a debounced change of state of a button
+static void button_changed(uint8_t pin, uint32_t current_time) {
+	button_state ^= (1<<pin);
+	locked |= (1<<pin);
+	lock_time[pin] = (uint16_t)current_time;
+	if(button_state & (1<<pin)) {
+		queue_event(pin, BUTTON_EVENT_PRESS, current_time);
+		next_hold_time[pin] = current_time + BUTTON_HOLD_DELAY;
+	} else {
+		queue_event(pin, BUTTON_EVENT_RELEASE, current_time);
+	}
+}
+
+uint8_t button_get_event(ButtonEvent* event) {
+	uint8_t tail = queue_tail;
+	if(tail == queue_head) {
+		return 0;
+	}
+	volatile ButtonEvent* next = &button_queue[tail & BUTTON_QUEUE_MASK];
+	event->button = next->button;
+	event->type = next->type;
+	event->time = next->time;
+	// Only give the slot back once we've copied it
+	queue_tail = tail + 1;
+	return 1;
 }
 
 int8_t button_pushed(void) {
-	int8_t return_value = NO_BUTTON_PUSHED;	// Assume no button pushed
-	if(queue_length > 0) {
-		// Remove the first element off the queue and move all the other
-		// entries closer to the front of the queue. We turn off interrupts (if on)
-		// before we make any changes to the queue. If interrupts were on
-		// we turn them back on when done.
-		return_value = button_queue[0];
-		
-		// Save whether interrupts were enabled and turn them off
-		int8_t interrupts_were_enabled = bit_is_set(SREG, SREG_I);
-		cli();
-		
-		for(uint8_t i = 1; i < queue_length; i++) {
-			button_queue[i-1] = button_queue[i];
+	ButtonEvent event;
+	while(button_get_event(&event)) {
+		if(event.type == BUTTON_EVENT_PRESS) {
+			return event.button;
+		}
+	}
+	return NO_BUTTON_PUSHED;
+}
+
+uint16_t button_overflow_count(void) {
+	// The count is 16 bits so it can change between reading the two bytes.
+	// Read until we get the same value twice.
+	uint16_t count;
+	do {
+		count = overflow_count;
+	} while(count != overflow_count);
+	return count;
+}
+
+void buttons_tick(uint32_t current_time) {
+	// Once a button's debounce time is up, check that the pin ended up in
+	// the state we reported. If it didn't, an edge was swallowed as bounce
+	// and we report it now.
+	if(locked) {
+		uint8_t pins = PINB & 0x0F;
+		for(uint8_t pin=0; pin<=3; pin++) {
+			if((locked & (1<<pin)) &&
+					(uint16_t)((uint16_t)current_time - lock_time[pin]) >= BUTTON_DEBOUNCE_MS) {
+				locked &= ~(1<<pin);
+				if((pins ^ button_state) & (1<<pin)) {
+					button_changed(pin, current_time);
+				}
+			}
 		}
-		queue_length--;
-		
-		if(interrupts_were_enabled) {
-			// Turn them back on again
-			sei();
+	}
+
+	// Auto repeat for buttons being held down
+	for(uint8_t pin=0; pin<=3; pin++) {
+		if((button_state & (1<<pin)) &&
+				(int32_t)(current_time - next_hold_time[pin]) >= 0) {
+			queue_event(pin, BUTTON_EVENT_HOLD, current_time);
+			next_hold_time[pin] = current_time + BUTTON_REPEAT_INTERVAL;
 		}
 	}
-	return return_value;
 }
 
 // Interrupt handler for a change on buttons
 ISR(PCINT1_vect) {
+	ISR_TRACE_ENTER(ISR_TRACE_PIN_BUTTONS);
 	// Get the current state of the buttons. We'll compare this with
-	// the last state to see what has changed.
-	uint8_t button_state = PINB & 0x0F;
-	
-	// Iterate over all the buttons and see which ones have changed.
-	// Any button pushes are added to the queue of button pushes (if
-	// there is space). We ignore button releases so we're just looking
-	// for a transition from 0 in the last_button_state bit to a 1 in the 
-	// button_state.
+	// the debounced state to see what has changed.
+	uint8_t pins = PINB & 0x0F;
+	uint8_t changed = (pins ^ button_state) & ~locked;
+	if(!changed) {
+		ISR_TRACE_EXIT(ISR_TRACE_PIN_BUTTONS);
+		return;
+	}
+
+	// A button that isn't in its debounce period is reported straight away
+	// (so there is no added delay) and then locked, so any bounce that
+	// follows is ignored.
+	uint32_t current_time = get_current_time();
 	for(uint8_t pin=0; pin<=3; pin++) {
-		if(queue_length < BUTTON_QUEUE_SIZE && 
-				(button_state & (1<<pin)) && 
-				!(last_button_state & (1<<pin))) {
-			// Add the button push to the queue (and update the
-			// length of the queue
-			button_queue[queue_length++] = pin;
+		if(changed & (1<<pin)) {
+			button_changed(pin, current_time);
 		}
 	}
-	
-	// Remember this button state
-	last_button_state = button_state;
-}
\ No newline at end of file
+	ISR_TRACE_EXIT(ISR_TRACE_PIN_BUTTONS);
+}
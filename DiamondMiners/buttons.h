@@ -5,7 +5,9 @@
  *
  * We assume four push buttons (B0 to B3) are connected to pins B0 to B3. We configure
  * pin change interrupts on these pins.
- */ 
+ * Modified by Matthew Chen: buttons are debounced and report press, release
+ * and hold (auto repeat) events with the time they happened.
+ */
 
 
 #ifndef BUTTONS_H_
@@ -19,20 +21,55 @@
 #define BUTTON2_PUSHED 2
 #define BUTTON3_PUSHED 3
 
+// Button event types
+#define BUTTON_EVENT_PRESS		0
+#define BUTTON_EVENT_RELEASE	1
+#define BUTTON_EVENT_HOLD		2	// sent repeatedly while a button is held down
+
+// After a button changes state, further changes within this many
+// milliseconds are treated as contact bounce.
+#define BUTTON_DEBOUNCE_MS 20
+// A held button sends its first BUTTON_EVENT_HOLD after BUTTON_HOLD_DELAY ms
+// and another one every BUTTON_REPEAT_INTERVAL ms after that
+#define BUTTON_HOLD_DELAY 500
+#define BUTTON_REPEAT_INTERVAL 150
+
+// Number of events that can be waiting (must be a power of 2 no larger than 128)
+#define BUTTON_QUEUE_SIZE 8
+
+typedef struct {
+	uint8_t button;		// 0 to 3
+	uint8_t type;		// BUTTON_EVENT_PRESS, BUTTON_EVENT_RELEASE or BUTTON_EVENT_HOLD
+	uint32_t time;		// get_current_time() value when it happened
+} ButtonEvent;
+
 /* Set up pin change interrupts on pins B0 to B3.
  * It is assumed that global interrupts are off when this function is called
  * and are enabled sometime after this function is called.
  */
 void init_button_interrupts(void);
 
-/* Return the last button pushed (0 to 3) or -1 (NO_BUTTON_PUSHED) if 
- * there are no button pushes to return. (A small queue of button pushes
+/* Return the last button pushed (0 to 3) or -1 (NO_BUTTON_PUSHED) if
+ * there are no button pushes to return. Release and hold events that are
+ * waiting in front of the next push are discarded. (A small queue of events
  * is kept. This function should be called frequently enough to
- * ensure the queue does not overflow. Excess button pushes are
- * discarded.)
+ * ensure the queue does not overflow. Events that arrive when the queue
+ * is full are discarded and counted by button_overflow_count().)
  */
-
 int8_t button_pushed(void);
 
+/* Removes the next event from the queue and copies it into event.
+ * Returns 1 if there was an event, 0 if the queue was empty.
+ */
+uint8_t button_get_event(ButtonEvent* event);
+
+/* Returns the number of events discarded because the queue was full.
+ */
+uint16_t button_overflow_count(void);
+
+/* Debounce and auto repeat processing. Called by the timer0 interrupt
+ * handler every millisecond with the current time - not for use elsewhere.
+ */
+void buttons_tick(uint32_t current_time);
 
-#endif /* BUTTONS_H_ */
\ No newline at end of file
+#endif /* BUTTONS_H_ */
@@ -0,0 +1,28 @@
+/*
+ * crc.c
+ *
+ * Author: Matthew Chen
+ *
+ * See crc.h.
+ */
+
+#include "crc.h"
+#include "eeprom.h"
+
+uint16_t crc_block(uint16_t crc, const void* data, uint8_t len) {
+	const uint8_t* bytes = data;
+	for (uint8_t i = 0; i < len; i++) {
+		crc = crc_update(crc, bytes[i]);
+	}
+	return crc;
+}
+
+uint16_t crc_eeprom(uint16_t address, uint16_t len) {
+	uint16_t crc = CRC_INIT;
+	for (uint16_t i = 0; i < len; i++) {
+		uint8_t byte;
+		eeprom_read(address + i, &byte, 1);
+		crc = crc_update(crc, byte);
+	}
+	return crc;
+}
@@ -0,0 +1,37 @@
+/*
+ * crc.h
+ *
+ * Author: Matthew Chen
+ *
+ * The CRC16 used to check telemetry frames and the records kept in EEPROM
+ * (persist.c, snapshot.c and levels.c): avr-libc's _crc_ccitt_update()
+ * starting from CRC_INIT, stored and sent low byte first. Starting from
+ * 0xFFFF rather than 0 means erased EEPROM (all 0xFF) and half written
+ * records don't check out. tools/telemetry_decode and tools/level_upload
+ * work it out the same way.
+ */
+
+#ifndef CRC_H_
+#define CRC_H_
+
+#include <stdint.h>
+#include <util/crc16.h>
+
+#define CRC_INIT 0xFFFF
+
+/* Adds a byte to a CRC and returns the new CRC.
+ */
+static inline uint16_t crc_update(uint16_t crc, uint8_t byte) {
+	return _crc_ccitt_update(crc, byte);
+}
+
+/* Adds len bytes of data to a CRC and returns the new CRC.
+ */
+uint16_t crc_block(uint16_t crc, const void* data, uint8_t len);
+
+/* Returns the CRC of len bytes of EEPROM from address on. Waits for the
+ * queued EEPROM writes to finish first (see eeprom_read()).
+ */
+uint16_t crc_eeprom(uint16_t address, uint16_t len);
+
+#endif /* CRC_H_ */
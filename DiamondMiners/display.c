@@ -5,19 +5,39 @@
  */ 
 
 #include <stdio.h>
+#include <string.h>
 #include <avr/pgmspace.h>
 
 #include "display.h"
 #include "pixel_colour.h"
 #include "ledmatrix.h"
+#include "profile.h"
 
 // constant value used to display 'D <> M' on launch
 static const uint8_t miners_display[MATRIX_NUM_COLUMNS] = 
 		{125, 69, 69, 57, 0, 16, 56, 124, 56, 16, 0, 125, 33, 17, 33, 125};
 
+// The object on each square of the playing field (4 bits a square, the
+// even row in the low bits) and the squares that have changed since the
+// last display_flush() (bit x of changed[y])
+static uint8_t objects[WIDTH][HEIGHT / 2];
+static uint16_t changed[HEIGHT];
+static uint8_t num_changed;
+
+#if WIDTH != MATRIX_NUM_COLUMNS || HEIGHT != MATRIX_NUM_ROWS
+#error The playing field must be the size of the LED matrix
+#endif
+
+static uint8_t object_at(uint8_t x, uint8_t y) {
+	return (y & 1) ? objects[x][y >> 1] >> 4 : objects[x][y >> 1] & 0x0F;
+}
+
 void initialise_display(void) {
 	// clear the LED matrix
 	ledmatrix_clear();
+	memset(objects, EMPTY_SQUARE, sizeof(objects));
+	memset(changed, 0, sizeof(changed));
+	num_changed = 0;
 }
 
 void start_display(void) {
@@ -50,34 +70,72 @@ void start_display(void) {
 	}
 }
 
-void update_square_colour(uint8_t x, uint8_t y, uint16_t object) {
-	// first check that this is a square within the game field
-	// if outside the game field, don't update anything
-	if (x < 0 || x >= WIDTH || y < 0 || y >= HEIGHT) {
-		return;
-	}
-	
+PixelColour object_colour(uint16_t object) {
 	// determine which colour corresponds to this object
-	PixelColour colour;
 	if (object == PLAYER) {
-		colour = MATRIX_COLOUR_PLAYER;
+		return MATRIX_COLOUR_PLAYER;
 	} else if (object == FACING) {
-		colour = MATRIX_COLOUR_FACING;
+		return MATRIX_COLOUR_FACING;
 	} else if (object == UNBREAKABLE || object == BREAKABLE) {
-		colour = MATRIX_COLOUR_WALL;
+		return MATRIX_COLOUR_WALL;
 	} else if (object == DISCOVERED_BREAKABLE) {
-		colour = MATRIX_COLOUR_DISCOVERED_BREAKABLE;
+		return MATRIX_COLOUR_DISCOVERED_BREAKABLE;
 	} else if (object == DIAMOND) {
-		colour = MATRIX_COLOUR_DIAMOND;
+		return MATRIX_COLOUR_DIAMOND;
 	} else if (object == UNDISCOVERED) {
-		colour = MATRIX_COLOUR_UNDISCOVERED;
+		return MATRIX_COLOUR_UNDISCOVERED;
 	} else if (object == BOMB) {
-		colour = MATRIX_COLOUR_BOMB;
+		return MATRIX_COLOUR_BOMB;
+	}
+	// anything unexpected (or empty) will be black
+	return MATRIX_COLOUR_EMPTY;
+}
+
+void update_square_colour(uint8_t x, uint8_t y, uint16_t object) {
+	PROFILE_FUNCTION(PROFILE_UPDATE_SQUARE_COLOUR);
+	// first check that this is a square within the game field
+	// if outside the game field, don't update anything
+	if (x < 0 || x >= WIDTH || y < 0 || y >= HEIGHT) {
+		return;
+	}
+
+	// record the object, display_flush() draws it
+	if (object_at(x, y) == object) {
+		return;
+	}
+	uint8_t* pair = &objects[x][y >> 1];
+	if (y & 1) {
+		*pair = (*pair & 0x0F) | (object << 4);
 	} else {
-		// anything unexpected (or empty) will be black
-		colour = MATRIX_COLOUR_EMPTY;
+		*pair = (*pair & 0xF0) | (object & 0x0F);
 	}
+	if (!(changed[y] & (1U << x))) {
+		changed[y] |= 1U << x;
+		num_changed++;
+	}
+}
 
-	// update the pixel at the given location with this colour
-	ledmatrix_update_pixel(x, y, colour);
+void display_flush(void) {
+	if (num_changed == 0) {
+		return;
+	}
+	if (num_changed > DISPLAY_UPDATE_ALL_SQUARES) {
+		MatrixData data;
+		for (uint8_t x = 0; x < WIDTH; x++) {
+			for (uint8_t y = 0; y < HEIGHT; y++) {
+				data[x][y] = object_colour(object_at(x, y));
+			}
+		}
+		ledmatrix_update_all(data);
+	} else {
+		for (uint8_t y = 0; y < HEIGHT; y++) {
+			for (uint8_t x = 0; x < WIDTH; x++) {
+				if (changed[y] & (1U << x)) {
+					ledmatrix_update_pixel(x, y, object_colour(object_at(x, y)));
+				}
+			}
+		}
+	}
+	memset(changed, 0, sizeof(changed));
+	num_changed = 0;
 }
\ No newline at end of file
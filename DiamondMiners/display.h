@@ -49,7 +49,23 @@ void start_display(void);
  * of the object 'object'
  * 'object' is expected to be EMPTY_SQUARE, PLAYER, FACING, 
  * BREAKABLE, UNBREAKABLE, DIAMOND or UNDISCOVERED
+ * (Edited by Matthew Chen: this only records the object - the LED matrix
+ * is updated by display_flush())
  */
 void update_square_colour(uint8_t x, uint8_t y, uint16_t object);
 
+/* Author: Matthew Chen
+ * Sends the squares that have changed since the last flush to the LED
+ * matrix. A square that changed several times is only sent once, and if
+ * more than DISPLAY_UPDATE_ALL_SQUARES have changed the whole matrix is
+ * sent in one go (129 SPI bytes rather than 3 a square).
+ */
+#define DISPLAY_UPDATE_ALL_SQUARES 43
+void display_flush(void);
+
+/* Author: Matthew Chen
+ * returns the colour an object is drawn in
+ */
+PixelColour object_colour(uint16_t object);
+
 #endif 
\ No newline at end of file
@@ -0,0 +1,116 @@
+/*
+ * eeprom.c
+ *
+ * Author: Matthew Chen
+ *
+ * See eeprom.h. Each queued write is its address (low byte first), its
+ * length and then its data. The indices are free running and are masked
+ * when used (as in buttons.c), so queue_head - queue_tail is always the
+ * number of bytes queued.
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "eeprom.h"
+#include "isr_trace.h"
+
+#define EEPROM_QUEUE_MASK (EEPROM_QUEUE_SIZE - 1)
+#define WRITE_HEADER_SIZE 3
+
+#if (EEPROM_QUEUE_SIZE & EEPROM_QUEUE_MASK) != 0 || EEPROM_QUEUE_SIZE > 128
+#error EEPROM_QUEUE_SIZE must be a power of 2 no more than 128
+#endif
+
+static uint8_t queue[EEPROM_QUEUE_SIZE];
+static volatile uint8_t queue_head;		// only changed by eeprom_write()
+static volatile uint8_t queue_tail;		// only changed by the handler
+// The write the handler is part way through
+static uint16_t write_address;
+static volatile uint8_t write_remaining;
+
+void init_eeprom(void) {
+	queue_head = 0;
+	queue_tail = 0;
+	write_remaining = 0;
+	// Atomic (erase and write) programming, the interrupt is turned on
+	// when there is something to write
+	EECR = 0;
+}
+
+uint8_t eeprom_write_space(void) {
+	uint8_t space = EEPROM_QUEUE_SIZE - (uint8_t)(queue_head - queue_tail);
+	return space > WRITE_HEADER_SIZE ? space - WRITE_HEADER_SIZE : 0;
+}
+
+uint8_t eeprom_write(uint16_t address, const void* data, uint8_t len) {
+	if (len == 0 || len > eeprom_write_space()) {
+		return 0;
+	}
+	uint8_t head = queue_head;
+	queue[head++ & EEPROM_QUEUE_MASK] = address & 0xFF;
+	queue[head++ & EEPROM_QUEUE_MASK] = address >> 8;
+	queue[head++ & EEPROM_QUEUE_MASK] = len;
+	const uint8_t* bytes = data;
+	for (uint8_t i = 0; i < len; i++) {
+		queue[head++ & EEPROM_QUEUE_MASK] = bytes[i];
+	}
+	// The handler can't run between the queue being seen as empty and
+	// the interrupt being turned off, so this can't be missed
+	queue_head = head;
+	EECR |= (1 << EERIE);
+	return 1;
+}
+
+uint8_t eeprom_idle(void) {
+	return queue_head == queue_tail && write_remaining == 0
+			&& !(EECR & (1 << EEPE));
+}
+
+void eeprom_read(uint16_t address, void* data, uint16_t len) {
+	while (!eeprom_idle()) {
+		;
+	}
+	uint8_t* bytes = data;
+	for (uint16_t i = 0; i < len; i++) {
+		EEAR = address++;
+		EECR |= (1 << EERE);
+		bytes[i] = EEDR;
+	}
+}
+
+/*
+ * Runs whenever the EEPROM is ready for another write (and the interrupt
+ * is on). Starts writing the next byte that needs changing, or turns the
+ * interrupt off if there is nothing left to write.
+ */
+ISR(EE_READY_vect) {
+	ISR_TRACE_ENTER_A(ISR_TRACE_PIN_EEPROM);
+	uint8_t tail = queue_tail;
+	uint8_t remaining = write_remaining;
+	while (1) {
+		if (remaining == 0) {
+			if (tail == queue_head) {
+				EECR &= ~(1 << EERIE);
+				break;
+			}
+			write_address = queue[tail++ & EEPROM_QUEUE_MASK];
+			write_address |= queue[tail++ & EEPROM_QUEUE_MASK] << 8;
+			remaining = queue[tail++ & EEPROM_QUEUE_MASK];
+		}
+		uint8_t byte = queue[tail++ & EEPROM_QUEUE_MASK];
+		remaining--;
+		EEAR = write_address++;
+		EECR |= (1 << EERE);
+		if (EEDR != byte) {
+			EEDR = byte;
+			// EEPE must be set within 4 cycles of EEMPE
+			EECR |= (1 << EEMPE);
+			EECR |= (1 << EEPE);
+			break;
+		}
+	}
+	write_remaining = remaining;
+	queue_tail = tail;
+	ISR_TRACE_EXIT_A(ISR_TRACE_PIN_EEPROM);
+}
@@ -0,0 +1,60 @@
+/*
+ * eeprom.h
+ *
+ * Author: Matthew Chen
+ *
+ * Interrupt driven EEPROM writes. Writing a byte takes about 3.4ms, so
+ * instead of waiting, eeprom_write() copies the data into a queue and the
+ * EE_READY interrupt handler writes it a byte at a time in the
+ * background. Bytes that already hold the value being written are
+ * skipped, which saves both the time and the wear.
+ * The queue has a single writer (the main program) and a single reader
+ * (the interrupt handler), so it doesn't need interrupts turned off.
+ * Reads have to wait until every queued write has finished, so they are
+ * for start up and the screens between games, not the game loop.
+ */
+
+#ifndef EEPROM_H_
+#define EEPROM_H_
+
+#include <stdint.h>
+
+// How the 1KB of EEPROM is shared out
+#define EEPROM_SIZE				1024
+#define EEPROM_PERSIST_START	0		// persist.c's log
+#define EEPROM_PERSIST_SIZE		256
+#define EEPROM_SNAPSHOT_START	256		// snapshot.c's copies of the game
+#define EEPROM_SNAPSHOT_SIZE	576
+#define EEPROM_LEVELS_START	832		// levels.c's uploaded levels
+#define EEPROM_LEVELS_SIZE		70
+
+// Bytes of queue (must be a power of 2). Each write takes 3 bytes (the
+// address and length) plus its data.
+#ifndef EEPROM_QUEUE_SIZE
+#define EEPROM_QUEUE_SIZE 64
+#endif
+
+/* Sets up the EEPROM driver.
+ */
+void init_eeprom(void);
+
+/* Queues len bytes of data (1 to EEPROM_QUEUE_SIZE - 3) to be written
+ * from address on. Returns 1 if they were queued, 0 (queueing nothing) if
+ * there isn't room. Never waits.
+ */
+uint8_t eeprom_write(uint16_t address, const void* data, uint8_t len);
+
+/* Returns the largest write that would fit in the queue right now.
+ */
+uint8_t eeprom_write_space(void);
+
+/* Returns 1 if there is nothing queued or being written.
+ */
+uint8_t eeprom_idle(void);
+
+/* Waits for the queued writes to finish, then reads len bytes from
+ * address on into data. Interrupts must be on.
+ */
+void eeprom_read(uint16_t address, void* data, uint16_t len);
+
+#endif /* EEPROM_H_ */
@@ -0,0 +1,76 @@
+/*
+ * flight.c
+ *
+ * Author: Matthew Chen
+ *
+ * See flight.h. Each event takes 4 bytes: the low 16 bits of
+ * get_current_time() and the type and argument. The full time is worked
+ * out when the recorder is dumped, so events more than about a minute
+ * old come out with the wrong time.
+ */
+
+#include <util/atomic.h>
+
+#include "flight.h"
+#include "telemetry.h"
+#include "timer0.h"
+
+#if (FLIGHT_SIZE & (FLIGHT_SIZE - 1)) != 0
+#error FLIGHT_SIZE must be a power of 2
+#endif
+
+typedef struct {
+	uint16_t time;
+	uint8_t type;
+	uint8_t arg;
+} FlightEvent;
+
+typedef struct {
+	uint32_t time;
+	uint8_t type;
+	uint8_t arg;
+} FlightRecord;
+
+static FlightEvent events[FLIGHT_SIZE];
+static uint8_t next;		// where the next event goes
+static uint8_t count;		// number of events recorded (up to FLIGHT_SIZE)
+
+void flight_record(uint8_t type, uint8_t arg) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		FlightEvent* event = &events[next];
+		event->time = get_current_time();
+		event->type = type;
+		event->arg = arg;
+		next = (next + 1) & (FLIGHT_SIZE - 1);
+		if (count < FLIGHT_SIZE) {
+			count++;
+		}
+	}
+}
+
+void flight_dump(void) {
+	uint8_t was_enabled = telemetry_enabled();
+	if (!was_enabled) {
+		telemetry_enable(1);
+	}
+	uint32_t now = get_current_time();
+	FlightRecord record;
+	uint8_t n;
+	uint8_t i;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		n = count;
+		i = next - count;
+	}
+	for (; n > 0; n--, i++) {
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+			const FlightEvent* event = &events[i & (FLIGHT_SIZE - 1)];
+			record.time = now - (uint16_t)((uint16_t)now - event->time);
+			record.type = event->type;
+			record.arg = event->arg;
+		}
+		telemetry_send_wait(TELEMETRY_FLIGHT, &record, sizeof(record));
+	}
+	if (!was_enabled) {
+		telemetry_enable(0);
+	}
+}
@@ -0,0 +1,57 @@
+/*
+ * flight.h
+ *
+ * Author: Matthew Chen
+ *
+ * Flight recorder: keeps the last FLIGHT_SIZE things that happened (with
+ * the time they happened) so that after a laggy game or a surprising
+ * death the last few seconds can be looked at without a debugger.
+ * Recording an event is a few stores, and it can be done from interrupt
+ * handlers (the serial overruns are recorded that way).
+ * The recorder is dumped as TELEMETRY_FLIGHT records (one per event,
+ * oldest first) at game over if telemetry is on, or with the f command
+ * (which turns telemetry on for the dump if it is off). telemetry_decode
+ * prints each one as "flight time=... type=... arg=...".
+ */
+
+#ifndef FLIGHT_H_
+#define FLIGHT_H_
+
+#include <stdint.h>
+
+// Event types
+#define FLIGHT_INPUT		0	// arg is the source (top 4 bits) and action
+#define FLIGHT_MOVE			1	// as FLIGHT_INPUT, plus FLIGHT_MOVED
+#define FLIGHT_BOMB_PLACED	2
+#define FLIGHT_BOMB_BLOWN	3
+#define FLIGHT_DIAMOND		4	// arg is the diamond count
+#define FLIGHT_RX_OVERRUN	5	// serial input lost (arg 1 if by the UART)
+#define FLIGHT_TX_OVERRUN	6	// serial output lost
+#define FLIGHT_SLOW_LOOP	7	// arg is the loop time in ms (up to 255)
+#define FLIGHT_GAME_START	8	// arg is the level
+#define FLIGHT_GAME_OVER	9	// arg is 1 if the game was won
+
+// Set in a FLIGHT_MOVE event's arg if the player moved
+#define FLIGHT_MOVED 0x80
+
+// Number of events kept (must be a power of 2). A move is one event (a
+// FLIGHT_MOVE rather than a FLIGHT_INPUT as well), so even held down the
+// joystick (a move every 100ms at most) takes over 6 seconds to fill it.
+#ifndef FLIGHT_SIZE
+#define FLIGHT_SIZE 64
+#endif
+
+// Main loop iterations whose work takes longer than this (in
+// microseconds) are recorded
+#define FLIGHT_SLOW_LOOP_US 20000
+
+/* Records an event, replacing the oldest one if the recorder is full.
+ */
+void flight_record(uint8_t type, uint8_t arg);
+
+/* Sends every event recorded as a TELEMETRY_FLIGHT record. Waits for
+ * room in the serial output buffer rather than dropping records.
+ */
+void flight_dump(void);
+
+#endif /* FLIGHT_H_ */
@@ -8,11 +8,12 @@
 
 #include "game.h"
 #include "display.h"
-#include "timer0.h"
+#include "sound.h"
+#include "profile.h"
+#include "levels.h"
 #include <stdlib.h>
+#include <avr/pgmspace.h>
 
-#define PLAYER_START_X  0
-#define PLAYER_START_Y  0
 #define FACING_START_X  1
 #define FACING_START_Y  0
 #define NO_BOMB			UINT8_MAX
@@ -22,7 +23,9 @@
 // note that this is not laid out in such a way that starting_layout[x][y]
 // does not correspond to an (x,y) coordinate but is a better visual
 // representation
-static const uint16_t starting_layout[HEIGHT][WIDTH] = 
+// (the layouts are kept in program memory - as ordinary constants they
+// would be copied into RAM at startup)
+static const uint16_t starting_layout[HEIGHT][WIDTH] PROGMEM = 
 		{
 			{0, 3, 0, 3, 0, 0, 0, 4, 4, 0, 0, 4, 0, 4, 0, 4},
 			{0, 4, 0, 4, 0, 0, 0, 3, 4, 4, 3, 4, 0, 3, 0, 4},
@@ -34,7 +37,7 @@ static const uint16_t starting_layout[HEIGHT][WIDTH] =
 			{0, 0, 0, 4, 0, 0, 3, 0, 4, 0, 0, 3, 3, 0, 5, 4} 
 		};
 		
-static const uint16_t alternate_layout[HEIGHT][WIDTH] =
+static const uint16_t alternate_layout[HEIGHT][WIDTH] PROGMEM =
 {
 	{0, 3, 0, 3, 0, 0, 0, 4, 5, 0, 0, 4, 0, 4, 0, 4},
 	{3, 3, 3, 4, 0, 0, 0, 3, 4, 4, 3, 4, 0, 3, 0, 4},
@@ -49,22 +52,24 @@ static const uint16_t alternate_layout[HEIGHT][WIDTH] =
 #define NUM_DIRECTIONS 8
 static const uint8_t directions[NUM_DIRECTIONS][2] = { {0,1}, {0,-1}, {1,0}, {-1,0}};
 
-// variables for the current state of the game
-uint16_t playing_field[WIDTH][HEIGHT]; // what is currently located at each square
-uint8_t visible[WIDTH][HEIGHT]; // whether each square is currently visible
-uint8_t discovered[WIDTH][HEIGHT]; // This is a record of which square has been discovered or not (regardless of if visible or not)
-uint8_t player_x;
-uint8_t player_y;
-uint8_t facing_x;
-uint8_t facing_y;
-uint8_t facing_visible;
-uint8_t bomb_x;		// x position of bomb on map
-uint8_t bomb_y;		// y position of bomb on map
-uint8_t game_over;
-uint8_t steps; //steps taken in game
-uint8_t game_initialised; // if game has started or not
-uint8_t vision_field_on; // if field of vision is on 
-uint8_t bomb_visible;
+// the state of the current game (see use_game_state())
+static GameState default_game;
+#ifdef __AVR__
+// there is only ever one game on the board, so use it directly
+#define game (&default_game)
+#else
+// each thread of the host simulator plays its own game
+static _Thread_local GameState* game = &default_game;
+
+void use_game_state(GameState* state) {
+	game = state;
+}
+#endif
+
+GameState* get_game_state(void) {
+	return game;
+}
+
 // function prototypes for this file
 void discoverable_dfs(uint8_t x, uint8_t y);
 void initialise_game_display(void);
@@ -76,29 +81,29 @@ void initialise_game_state(void);
  */
 void initialise_game_state(void) {
 	// initialise the player position and the facing position
-	player_x = PLAYER_START_X;
-	player_y = PLAYER_START_Y;
-	facing_x = FACING_START_X;
-	facing_y = FACING_START_Y;
-	bomb_x = NO_BOMB;
-	bomb_y = NO_BOMB;
-	facing_visible = 1;
-	bomb_visible = 1;
-	game_over = 0;
-	steps = 0;
-	game_initialised = 1;
-	vision_field_on = 0;
+	game->player_x = PLAYER_START_X;
+	game->player_y = PLAYER_START_Y;
+	game->facing_x = FACING_START_X;
+	game->facing_y = FACING_START_Y;
+	game->bomb_x = NO_BOMB;
+	game->bomb_y = NO_BOMB;
+	game->facing_visible = 1;
+	game->bomb_visible = 1;
+	game->game_over = 0;
+	game->steps = 0;
+	game->game_initialised = 1;
+	game->vision_field_on = 0;
 	// go through and initialise the state of the playing_field
 	for (int x = 0; x < WIDTH; x++) {
 		for (int y = 0; y < HEIGHT; y++) {
 			// initialise this square based on the starting layout
 			// the indices here are to ensure the starting layout
 			// could be easily visualised when declared
-			playing_field[x][y] = starting_layout[HEIGHT - 1 - y][x];
+			game->playing_field[x][y] = pgm_read_word(&starting_layout[HEIGHT - 1 - y][x]);
 			// set all squares to start not visible, this will be
 			// updated once the display is initialised as well
-			visible[x][y] = 0;
-			discovered[x][y] = 0;
+			game->visible[x][y] = 0;
+			game->discovered[x][y] = 0;
 		}
 	}
 }
@@ -109,28 +114,28 @@ void initialise_game_state(void) {
  */
 void initialise_game_state_alt(void) {
 	// initialise the player position and the facing position
-	player_x = PLAYER_START_X;
-	player_y = PLAYER_START_Y;
-	facing_x = FACING_START_X;
-	facing_y = FACING_START_Y;
-	bomb_x = NO_BOMB;
-	bomb_y = NO_BOMB;
-	facing_visible = 1;
-	bomb_visible = 1;
-	game_over = 0;
-	steps = 0;
-	game_initialised = 1;
+	game->player_x = PLAYER_START_X;
+	game->player_y = PLAYER_START_Y;
+	game->facing_x = FACING_START_X;
+	game->facing_y = FACING_START_Y;
+	game->bomb_x = NO_BOMB;
+	game->bomb_y = NO_BOMB;
+	game->facing_visible = 1;
+	game->bomb_visible = 1;
+	game->game_over = 0;
+	game->steps = 0;
+	game->game_initialised = 1;
 	// go through and initialise the state of the playing_field
 	for (int x = 0; x < WIDTH; x++) {
 		for (int y = 0; y < HEIGHT; y++) {
 			// initialise this square based on the starting layout
 			// the indices here are to ensure the starting layout
 			// could be easily visualised when declared
-			playing_field[x][y] = alternate_layout[HEIGHT - 1 - y][x];
+			game->playing_field[x][y] = pgm_read_word(&alternate_layout[HEIGHT - 1 - y][x]);
 			// set all squares to start not visible, this will be
 			// updated once the display is initialised as well
-			visible[x][y] = 0;
-			discovered[x][y] = 0;
+			game->visible[x][y] = 0;
+			game->discovered[x][y] = 0;
 		}
 	}	
 }
@@ -152,10 +157,10 @@ void initialise_game_display(void) {
 		}
 	}
 	// now explore visibility from the starting location
-	discoverable_dfs(player_x, player_y);
+	discoverable_dfs(game->player_x, game->player_y);
 	// make the player and facing square visible
-	update_square_colour(player_x, player_y, PLAYER);
-	update_square_colour(facing_x, facing_y, FACING);
+	update_square_colour(game->player_x, game->player_y, PLAYER);
+	update_square_colour(game->facing_x, game->facing_y, FACING);
 }
 
 void initialise_game(uint8_t level) {
@@ -166,6 +171,10 @@ void initialise_game(uint8_t level) {
 	} else {
 		initialise_game_state_alt();
 	}
+#ifdef __AVR__
+	// a level uploaded over the serial port replaces the built in layout
+	levels_load(level, game->playing_field);
+#endif
 	initialise_game_display();
 }
 
@@ -181,24 +190,34 @@ uint8_t get_object_at(uint8_t x, uint8_t y) {
 		return UNBREAKABLE;
 	} else {
 		//if in the bounds, just index into the array
-		return playing_field[x][y];
+		return game->playing_field[x][y];
+	}
+}
+
+uint16_t get_displayed_object(uint8_t x, uint8_t y) {
+	if (x == game->player_x && y == game->player_y) {
+		return PLAYER;
 	}
+	if (x == game->facing_x && y == game->facing_y && game->facing_visible) {
+		return FACING;
+	}
+	return game->visible[x][y] ? game->playing_field[x][y] : UNDISCOVERED;
 }
 
 void flash_facing(void) {
 	// only flash the facing cursor if it is in bounds
-	if (in_bounds(facing_x, facing_y)) {
-		if (facing_visible) {
+	if (in_bounds(game->facing_x, game->facing_y)) {
+		if (game->facing_visible) {
 			// we need to flash the facing cursor off, it should be replaced by
 			// the colour of the piece which is at that location
-			uint16_t piece_at_cursor = get_object_at(facing_x, facing_y);
-			update_square_colour(facing_x, facing_y, piece_at_cursor);
+			uint16_t piece_at_cursor = get_object_at(game->facing_x, game->facing_y);
+			update_square_colour(game->facing_x, game->facing_y, piece_at_cursor);
 		
 		} else {
 			// we need to flash the facing cursor on
-			update_square_colour(facing_x, facing_y, FACING);
+			update_square_colour(game->facing_x, game->facing_y, FACING);
 		}
-		facing_visible = 1 - facing_visible; //alternate between 0 and 1
+		game->facing_visible = 1 - game->facing_visible; //alternate between 0 and 1
 	}
 }
 
@@ -206,6 +225,7 @@ void flash_facing(void) {
 // it contains a few extra hints
 // Matthew Chen edit: returns 1 if a valid move is made
 uint8_t move_player(uint8_t dx, uint8_t dy) {
+	PROFILE_FUNCTION(PROFILE_MOVE_PLAYER);
 	// YOUR CODE HERE
 	// suggestions for implementation:
 	// 1: remove the display of the player at the current location
@@ -217,24 +237,24 @@ uint8_t move_player(uint8_t dx, uint8_t dy) {
 	
 	
 	uint8_t valid_move = 0;
-	uint8_t object_here = get_object_at(player_x+dx, player_y+dy);
+	uint8_t object_here = get_object_at(game->player_x+dx, game->player_y+dy);
 	if (object_here == EMPTY_SQUARE || object_here == DIAMOND) {
-		update_square_colour(player_x, player_y, get_object_at(player_x, player_y));
-		player_x += dx;
-		player_y += dy;
-		if (steps < 99) {
-			steps ++;
+		update_square_colour(game->player_x, game->player_y, get_object_at(game->player_x, game->player_y));
+		game->player_x += dx;
+		game->player_y += dy;
+		if (game->steps < 99) {
+			game->steps ++;
 		}
 		if (object_here == DIAMOND) {
 			play_found_diamond();
 		}
 		valid_move = 1;
 	}
-	update_square_colour(facing_x, facing_y, get_object_at(facing_x, facing_y)); // Make sure to change LED to correct colour (otherwise it may be stuck in red flash)
-	facing_x = player_x + dx;
-	facing_y = player_y + dy;
+	update_square_colour(game->facing_x, game->facing_y, get_object_at(game->facing_x, game->facing_y)); // Make sure to change LED to correct colour (otherwise it may be stuck in red flash)
+	game->facing_x = game->player_x + dx;
+	game->facing_y = game->player_y + dy;
 	flash_facing();
-	update_square_colour(player_x, player_y, PLAYER);
+	update_square_colour(game->player_x, game->player_y, PLAYER);
 	
 	maintain_field_of_vision();
 	return valid_move;
@@ -242,7 +262,25 @@ uint8_t move_player(uint8_t dx, uint8_t dy) {
 
 uint8_t is_game_over(void) {
 	// initially the game never ends
-	return game_over; // Note game_over = 0 if game hasn't ended and 1 otherwise
+	return game->game_over; // Note game_over = 0 if game hasn't ended and 1 otherwise
+}
+
+/*
+ * Makes a square visible and discovered and updates its colour (unless
+ * field of vision is on and the square is outside it). Returns the object
+ * at the square.
+ */
+static uint8_t reveal_square(uint8_t x, uint8_t y) {
+	game->visible[x][y] = 1;
+	game->discovered[x][y] = 1;
+	uint8_t object_here = get_object_at(x, y);
+	
+	// Make sure that if field of vision is on, we don't update square colours that are outside of field of vision
+	uint8_t distance = abs(x - game->player_x) + abs(y - game->player_y);
+	if (game->vision_field_on == 0 || (distance <= 2 || (distance == 3 && (abs(x - game->player_x) == 1 || abs(y - game->player_y) == 1)))) {
+		update_square_colour(x, y, object_here);
+	}
+	return object_here;
 }
 
 /*
@@ -251,33 +289,37 @@ uint8_t is_game_over(void) {
  * (x,y), this function should be called with coordinates (x,y)
  * YOU SHOULD NOT NEED TO MODIFY THIS FUNCTION
  * Matthew Chen Edit: Spoiler. I modified it. Now it wont update square colour if its outside of field of vision and field of vision is active.
+ * Matthew Chen Edit: the search now uses its own stack of squares instead
+ * of recursion, which could take over a kilobyte of stack on an open map.
  */
 void discoverable_dfs(uint8_t x, uint8_t y) {
+	PROFILE_FUNCTION(PROFILE_DISCOVERABLE_DFS);
+	// Squares (x * HEIGHT + y) still to be explored from. A square is made
+	// visible when it is added and only squares that aren't visible are
+	// added, so no square is added twice.
+	uint8_t to_explore[WIDTH * HEIGHT];
+	uint8_t count = 0;
 	uint8_t x_adj, y_adj, object_here;
-	// set the current square to be visible and update display
-	visible[x][y] = 1;
-	discovered[x][y] = 1;
-	object_here = get_object_at(x, y);
-	
-	// Make sure that if field of vision is on, we don't update square colours that are outside of field of vision
-	uint8_t 
-	
-	distance = abs(x - player_x) + abs(y - player_y);
-	if (vision_field_on == 0 || (distance <= 2 || (distance == 3 && (abs(x - player_x) == 1 || abs(y - player_y) == 1)))) {
-		update_square_colour(x, y, object_here);
-	}
 	
-	// we can continue exploring from this square if it is empty
+	object_here = reveal_square(x, y);
+	// we can continue exploring from a square if it is empty
 	if (object_here == EMPTY_SQUARE || object_here == DIAMOND) {
+		to_explore[count++] = x * HEIGHT + y;
+	}
+	while (count > 0) {
+		count--;
+		x = to_explore[count] / HEIGHT;
+		y = to_explore[count] % HEIGHT;
 		// consider all 4 adjacent square
 		for (int i = 0; i < NUM_DIRECTIONS; i++) {
 			x_adj = x + directions[i][0];
 			y_adj = y + directions[i][1];
 			// if this square is not visible yet, it should be explored
-			if (in_bounds(x_adj, y_adj) && !visible[x_adj][y_adj]) {
-				// this recursive call implements a depth first search
-				// the visible array ensures termination
-				discoverable_dfs(x_adj, y_adj);
+			if (in_bounds(x_adj, y_adj) && !game->visible[x_adj][y_adj]) {
+				object_here = reveal_square(x_adj, y_adj);
+				if (object_here == EMPTY_SQUARE || object_here == DIAMOND) {
+					to_explore[count++] = x_adj * HEIGHT + y_adj;
+				}
 			}
 		}
 	}
@@ -288,12 +330,12 @@ void discoverable_dfs(uint8_t x, uint8_t y) {
  * If it is breakable, highlights it blue.
  */
 void inspect_wall(uint8_t cheatMode) {
-	if (get_object_at(facing_x, facing_y) == BREAKABLE || get_object_at(facing_x, facing_y) == DISCOVERED_BREAKABLE) {
+	if (get_object_at(game->facing_x, game->facing_y) == BREAKABLE || get_object_at(game->facing_x, game->facing_y) == DISCOVERED_BREAKABLE) {
 		if (cheatMode == 0) {
-			playing_field[facing_x][facing_y] = DISCOVERED_BREAKABLE;
+			game->playing_field[game->facing_x][game->facing_y] = DISCOVERED_BREAKABLE;
 		} else {
-			playing_field[facing_x][facing_y] = EMPTY_SQUARE;
-			discoverable_dfs(facing_x, facing_y);
+			game->playing_field[game->facing_x][game->facing_y] = EMPTY_SQUARE;
+			discoverable_dfs(game->facing_x, game->facing_y);
 		}
 	}
 }
@@ -302,8 +344,8 @@ void inspect_wall(uint8_t cheatMode) {
  * Check if standing on diamond. Removes diamond if standing on it and returns 1, else returns 0.
  */
 uint8_t check_diamond() {
-	if (get_object_at(player_x, player_y) == DIAMOND) {
-		playing_field[player_x][player_y] = EMPTY_SQUARE;
+	if (get_object_at(game->player_x, game->player_y) == DIAMOND) {
+		game->playing_field[game->player_x][game->player_y] = EMPTY_SQUARE;
 		return 1;
 	}
 	return 0;
@@ -319,7 +361,7 @@ uint16_t diamond_distance() {
 	for (int x = 0; x < WIDTH; x ++) {
 		for (int y = 0; y < HEIGHT; y ++) {
 			if (get_object_at(x, y) == DIAMOND) {
-				uint16_t distance = abs(player_x - x) + abs(player_y - y);
+				uint16_t distance = abs(game->player_x - x) + abs(game->player_y - y);
 				if (distance < minDistance ) {
 					minDistance = distance;
 				}
@@ -334,10 +376,10 @@ uint16_t diamond_distance() {
  * Return 1 if successfully places new bomb.
  */
 uint8_t place_bomb() {
-	if ((bomb_x == NO_BOMB) && (bomb_y == NO_BOMB)) {
-		playing_field[player_x][player_y] = BOMB;
-		bomb_x = player_x;
-		bomb_y = player_y;
+	if ((game->bomb_x == NO_BOMB) && (game->bomb_y == NO_BOMB)) {
+		game->playing_field[game->player_x][game->player_y] = BOMB;
+		game->bomb_x = game->player_x;
+		game->bomb_y = game->player_y;
 		return 1;
 	}
 	return 0;
@@ -346,18 +388,20 @@ uint8_t place_bomb() {
 /*
  * Blows up the bomb, destroying walls (as well as the player if they're in the range).
  * Range is any object within 1 manhattan distance from it.
+ * (Parts of the blast outside the playing field are ignored.)
  */
 void blow_bomb() {
-	if (bomb_x == NO_BOMB || bomb_y == NO_BOMB) {
+	PROFILE_FUNCTION(PROFILE_BLOW_BOMB);
+	if (game->bomb_x == NO_BOMB || game->bomb_y == NO_BOMB) {
 		return;
 	}
-	playing_field[bomb_x][bomb_y] = EMPTY_SQUARE;
+	game->playing_field[game->bomb_x][game->bomb_y] = EMPTY_SQUARE;
 	for (int i = -1; i <= 1; i+=2) {
-		uint8_t xPos = bomb_x +i;
-		uint8_t yPos = bomb_y;
-		uint16_t blownLocation = playing_field[xPos][yPos];
+		uint8_t xPos = game->bomb_x +i;
+		uint8_t yPos = game->bomb_y;
+		uint16_t blownLocation = get_object_at(xPos, yPos); // outside the field is unbreakable
 		if (blownLocation == BREAKABLE || blownLocation == DISCOVERED_BREAKABLE) {
-			playing_field[xPos][yPos] = EMPTY_SQUARE;
+			game->playing_field[xPos][yPos] = EMPTY_SQUARE;
 			if (in_field_of_vision(xPos, yPos)) {
 				update_square_colour(xPos, yPos, EMPTY_SQUARE);
 			}
@@ -365,11 +409,11 @@ void blow_bomb() {
 		}
 	}
 	for (int i = -1; i <= 1; i+=2) {
-		uint8_t xPos = bomb_x;
-		uint8_t yPos = bomb_y+i;
-		uint16_t blownLocation = playing_field[xPos][yPos];
+		uint8_t xPos = game->bomb_x;
+		uint8_t yPos = game->bomb_y+i;
+		uint16_t blownLocation = get_object_at(xPos, yPos); // outside the field is unbreakable
 		if (blownLocation == BREAKABLE || blownLocation == DISCOVERED_BREAKABLE) {
-			playing_field[xPos][yPos] = EMPTY_SQUARE;
+			game->playing_field[xPos][yPos] = EMPTY_SQUARE;
 			if (in_field_of_vision(xPos, yPos)) {
 				update_square_colour(xPos, yPos, EMPTY_SQUARE);
 			}
@@ -377,23 +421,23 @@ void blow_bomb() {
 		}
 	}
 	
-	uint8_t distance_to_bomb = abs(player_x-bomb_x) + abs(player_y-bomb_y);
+	uint8_t distance_to_bomb = abs(game->player_x-game->bomb_x) + abs(game->player_y-game->bomb_y);
 	if (distance_to_bomb <= 1) {
-		game_over = 1;
+		game->game_over = 1;
 	}
-	if (in_field_of_vision(bomb_x, bomb_y)) {
-		update_square_colour(bomb_x, bomb_y, EMPTY_SQUARE);
+	if (in_field_of_vision(game->bomb_x, game->bomb_y)) {
+		update_square_colour(game->bomb_x, game->bomb_y, EMPTY_SQUARE);
 	}
-	bomb_visible = 0;
+	game->bomb_visible = 0;
 	bomb_animation_start();
 }
 
 uint8_t get_steps() {
-	return steps;
+	return game->steps;
 }
 
 uint8_t get_game_initialised() {
-	return game_initialised;
+	return game->game_initialised;
 }
 
 
@@ -411,7 +455,7 @@ uint8_t is_game_won() {
 			}
 		}
 	}
-	if (player_x == WIDTH-1) {
+	if (game->player_x == WIDTH-1) {
 		return 1;
 	}
 	return 0;
@@ -421,17 +465,18 @@ uint8_t is_game_won() {
  * Super hacky solution
  */
 void maintain_field_of_vision() {
-	if (vision_field_on) {
+	PROFILE_FUNCTION(PROFILE_FIELD_OF_VISION);
+	if (game->vision_field_on) {
 		for (int x = 0; x < WIDTH; x++) {
 			for (int y = 0; y < HEIGHT; y++) {
-				uint8_t distance = abs(x - player_x) + abs(y - player_y);
-				if ((distance <= 2 || (distance == 3 && (abs(x - player_x) == 1 || abs(y - player_y) == 1)))) {
-					if ((player_x != x || player_y != y) && discovered[x][y] == 1) {
-						visible[x][y] = 1;
+				uint8_t distance = abs(x - game->player_x) + abs(y - game->player_y);
+				if ((distance <= 2 || (distance == 3 && (abs(x - game->player_x) == 1 || abs(y - game->player_y) == 1)))) {
+					if ((game->player_x != x || game->player_y != y) && game->discovered[x][y] == 1) {
+						game->visible[x][y] = 1;
 						update_square_colour(x, y, get_object_at(x, y));
 					}
 				} else {
-					visible[x][y] = 0;
+					game->visible[x][y] = 0;
 					update_square_colour(x, y, UNDISCOVERED);
 				}
 			}
@@ -443,20 +488,27 @@ void maintain_field_of_vision() {
  * Toggle field of vision.
  */
 void toggle_field_of_vision() {
-	vision_field_on ^= 1;
-	if (vision_field_on == 0) {
+	game->vision_field_on ^= 1;
+	if (game->vision_field_on == 0) {
 		for (int x = 0; x < WIDTH; x++) {
 			for (int y = 0; y < HEIGHT; y++) {
-				visible[x][y] = 0;
+				game->visible[x][y] = 0;
 			}
 		}
-		discoverable_dfs(player_x, player_y);
-		update_square_colour(player_x, player_y, PLAYER);
+		discoverable_dfs(game->player_x, game->player_y);
+		update_square_colour(game->player_x, game->player_y, PLAYER);
 	} else {
 		maintain_field_of_vision();
 	}
 }
 
+/*
+ * Returns 1 if field of vision is on.
+ */
+uint8_t is_field_of_vision_on() {
+	return game->vision_field_on;
+}
+
 /*
  * Returns 1 if player is in danger of being blown up (i.e. in bomb distance).
  */
@@ -464,7 +516,7 @@ uint8_t in_danger() {
 	// technically due to implementation of NO_BOMB, we don't even need to check
 	// if there is a bomb as if there isn't a bomb, the distance will be greater than
 	// 1
-	uint8_t distance_to_bomb = abs(player_x-bomb_x) + abs(player_y-bomb_y);
+	uint8_t distance_to_bomb = abs(game->player_x-game->bomb_x) + abs(game->player_y-game->bomb_y);
 	if (distance_to_bomb <= 1) {
 		return 1;
 	}
@@ -472,28 +524,28 @@ uint8_t in_danger() {
 }
 
 void bomb_animation_start() {
-	if (bomb_x == NO_BOMB || bomb_y == NO_BOMB) {
+	if (game->bomb_x == NO_BOMB || game->bomb_y == NO_BOMB) {
 		return;
 	}
-	if (in_field_of_vision(bomb_x, bomb_y)) {
-		update_square_colour(bomb_x, bomb_y, PLAYER);
+	if (in_field_of_vision(game->bomb_x, game->bomb_y)) {
+		update_square_colour(game->bomb_x, game->bomb_y, PLAYER);
 	}
 }
 
 void bomb_animation_middle() {
-	if (bomb_x == NO_BOMB || bomb_y == NO_BOMB) {
+	if (game->bomb_x == NO_BOMB || game->bomb_y == NO_BOMB) {
 		return;
 	}
 	for (int i = -1; i <= 1; i+=2) {
-		uint8_t xPos = bomb_x +i;
-		uint8_t yPos = bomb_y;
+		uint8_t xPos = game->bomb_x +i;
+		uint8_t yPos = game->bomb_y;
 		if (in_field_of_vision(xPos, yPos)) {
 			update_square_colour(xPos, yPos, FACING);
 		}
 	}
 	for (int i = -1; i <= 1; i+=2) {
-		uint8_t xPos = bomb_x;
-		uint8_t yPos = bomb_y+i;
+		uint8_t xPos = game->bomb_x;
+		uint8_t yPos = game->bomb_y+i;
 		if (in_field_of_vision(xPos, yPos)) {
 			update_square_colour(xPos, yPos, FACING);
 		}
@@ -501,67 +553,67 @@ void bomb_animation_middle() {
 }
 
 void bomb_animation_end() {
-	if (bomb_x == NO_BOMB || bomb_y == NO_BOMB) {
+	if (game->bomb_x == NO_BOMB || game->bomb_y == NO_BOMB) {
 		return;
 	}
 	for (int i = -1; i <= 1; i+=2) {
-		uint8_t xPos = bomb_x +i;
-		uint8_t yPos = bomb_y;
+		uint8_t xPos = game->bomb_x +i;
+		uint8_t yPos = game->bomb_y;
 		if (in_field_of_vision(xPos, yPos)) {
 			update_square_colour(xPos, yPos, get_object_at(xPos, yPos));
 		}
 	}
 	for (int i = -1; i <= 1; i+=2) {
-		uint8_t xPos = bomb_x;
-		uint8_t yPos = bomb_y+i;
+		uint8_t xPos = game->bomb_x;
+		uint8_t yPos = game->bomb_y+i;
 		if (in_field_of_vision(xPos, yPos)) {
 			update_square_colour(xPos, yPos, get_object_at(xPos, yPos));
 		}
 	}
-	if (in_field_of_vision(bomb_x, bomb_y)) {
-		update_square_colour(bomb_x, bomb_y, EMPTY_SQUARE);
+	if (in_field_of_vision(game->bomb_x, game->bomb_y)) {
+		update_square_colour(game->bomb_x, game->bomb_y, EMPTY_SQUARE);
 	}
-	bomb_x = NO_BOMB;
-	bomb_y = NO_BOMB;
+	game->bomb_x = NO_BOMB;
+	game->bomb_y = NO_BOMB;
 }
 
 /* 
  * Flashes bomb (basically same as flash_facing())
  */
 void flash_bomb() {
-	if (bomb_x == NO_BOMB || bomb_y == NO_BOMB) {
+	if (game->bomb_x == NO_BOMB || game->bomb_y == NO_BOMB) {
 		return;
 	}
-	if (bomb_visible) {
+	if (game->bomb_visible) {
 		// we need to flash the facing cursor off, it should be replaced by
 		// the colour of the piece which is at that location
-		if (in_field_of_vision(bomb_x, bomb_y)) {
-			update_square_colour(bomb_x, bomb_y, NO_BOMB);		
+		if (in_field_of_vision(game->bomb_x, game->bomb_y)) {
+			update_square_colour(game->bomb_x, game->bomb_y, NO_BOMB);		
 		}
 	} else {
 		// we need to flash the facing cursor on
-		if (in_field_of_vision(bomb_x, bomb_y)) {
-			update_square_colour(bomb_x, bomb_y, BOMB);
+		if (in_field_of_vision(game->bomb_x, game->bomb_y)) {
+			update_square_colour(game->bomb_x, game->bomb_y, BOMB);
 		}
 	}
 
-	bomb_visible = 1 - bomb_visible; //alternate between 0 and 1
+	game->bomb_visible = 1 - game->bomb_visible; //alternate between 0 and 1
 }
 
 /*
  * Returns if bomb is active
  */
 uint8_t bomb_active() {
-	return !(bomb_x == NO_BOMB || bomb_y == NO_BOMB);
+	return !(game->bomb_x == NO_BOMB || game->bomb_y == NO_BOMB);
 }
 
 /*
  * Returns 1 if object is in field of vision, else returns 0.
  */
 uint8_t in_field_of_vision(uint8_t x, uint8_t y) {
-	uint8_t distance = abs(x - player_x) + abs(y - player_y);
-	if (vision_field_on) {
-		if ((distance <= 2 || (distance == 3 && (abs(x - player_x) == 1 || abs(y - player_y) == 1)))) {
+	uint8_t distance = abs(x - game->player_x) + abs(y - game->player_y);
+	if (game->vision_field_on) {
+		if ((distance <= 2 || (distance == 3 && (abs(x - game->player_x) == 1 || abs(y - game->player_y) == 1)))) {
 			return 1;			// within field of vision
 		} else {
 			return 0;			// outside field of vision
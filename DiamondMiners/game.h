@@ -10,6 +10,48 @@
 #define GAME_H_
 
 #include <inttypes.h>
+#include "display.h"
+
+// Where the player starts (an uploaded level has to leave it empty, see
+// levels.c)
+#define PLAYER_START_X  0
+#define PLAYER_START_Y  0
+
+/* Author: Matthew Chen
+ * The state of a game. The game functions below all work on the current
+ * game, which on the board is a single static GameState. A host build
+ * (see tools/game_sim.c) can play several games at once, one per thread,
+ * by pointing each thread at its own state with use_game_state().
+ */
+typedef struct {
+	uint16_t playing_field[WIDTH][HEIGHT]; // what is currently located at each square
+	uint8_t visible[WIDTH][HEIGHT]; // whether each square is currently visible
+	uint8_t discovered[WIDTH][HEIGHT]; // This is a record of which square has been discovered or not (regardless of if visible or not)
+	uint8_t player_x;
+	uint8_t player_y;
+	uint8_t facing_x;
+	uint8_t facing_y;
+	uint8_t facing_visible;
+	uint8_t bomb_x;		// x position of bomb on map
+	uint8_t bomb_y;		// y position of bomb on map
+	uint8_t game_over;
+	uint8_t steps; //steps taken in game
+	uint8_t game_initialised; // if game has started or not
+	uint8_t vision_field_on; // if field of vision is on
+	uint8_t bomb_visible;
+} GameState;
+
+/* Author: Matthew Chen
+ * Returns the current game's state (for saving and restoring it).
+ */
+GameState* get_game_state(void);
+
+#ifndef __AVR__
+/* Author: Matthew Chen
+ * Makes state the current game for the calling thread (host builds only).
+ */
+void use_game_state(GameState* state);
+#endif
 
 /*
  * initialise the game, creates the internal game state and updates
@@ -25,6 +67,13 @@ void initialise_game(uint8_t level);
  */
 uint8_t get_object_at(uint8_t x, uint8_t y);
 
+/* Author: Matthew Chen
+ * returns what is drawn at position (x,y) on the LED matrix: PLAYER,
+ * FACING (while the cursor is flashed on), the object there if the
+ * square is visible, otherwise UNDISCOVERED
+ */
+uint16_t get_displayed_object(uint8_t x, uint8_t y);
+
 /*
  * returns 1 if a given (x,y) coordinate is inside the bounds of 
  * the playing field, 0 if it is out of bounds
@@ -113,6 +162,11 @@ void maintain_field_of_vision();
  */
 void toggle_field_of_vision();
 
+/* Author: Matthew Chen
+ * Returns 1 if field of vision is on.
+ */
+uint8_t is_field_of_vision_on();
+
 /* Author: Matthew Chen
  * Returns if player is in danger of bomb. Returns 1 if in danger.
  */
@@ -0,0 +1,79 @@
+/*
+ * histogram.c
+ *
+ * Author: Matthew Chen
+ *
+ * See histogram.h.
+ */
+
+#include <string.h>
+#include <avr/pgmspace.h>
+
+#include "histogram.h"
+#include "serialio.h"
+#include "terminalio.h"
+#include "telemetry.h"
+#include "timer0.h"
+
+void histogram_reset(Histogram* histogram) {
+	memset(histogram, 0, sizeof(Histogram));
+}
+
+void histogram_add(Histogram* histogram, uint16_t value) {
+	uint8_t bucket = 0;
+	uint16_t v = value;
+	while (v && bucket < HISTOGRAM_BUCKETS - 1) {
+		v >>= 1;
+		bucket++;
+	}
+	if (histogram->buckets[bucket] < UINT16_MAX) {
+		histogram->buckets[bucket]++;
+	}
+	if (value > histogram->max) {
+		histogram->max = value;
+	}
+}
+
+void histogram_print_duration(uint32_t fine_time) {
+	uint32_t us = fine_time * FINE_TIME_US;
+	if (us < 10000) {
+		serial_write_uint(us);
+		serial_write_P(PSTR("us"));
+	} else {
+		serial_write_uint(us / 1000);
+		serial_write_P(PSTR("ms"));
+	}
+}
+
+void histogram_print(const Histogram* histogram, const char* heading) {
+	serial_write_P(heading);
+	serial_write_P(PSTR(" (max "));
+	histogram_print_duration(histogram->max);
+	serial_write_P(PSTR(")"));
+	clear_to_end_of_line();
+	serial_write_P(PSTR("\r\n"));
+	for (uint8_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+		if (histogram->buckets[i] == 0) {
+			continue;
+		}
+		// Bucket i holds values below 2^i (the last one everything else)
+		if (i == HISTOGRAM_BUCKETS - 1) {
+			serial_write_P(PSTR("  >="));
+			histogram_print_duration(1UL << (i - 1));
+		} else {
+			serial_write_P(PSTR("  <"));
+			histogram_print_duration(1UL << i);
+		}
+		serial_write_P(PSTR(": "));
+		serial_write_uint(histogram->buckets[i]);
+		clear_to_end_of_line();
+		serial_write_P(PSTR("\r\n"));
+	}
+}
+
+void histogram_send(const Histogram* histogram, uint8_t id) {
+	uint8_t payload[1 + sizeof(histogram->buckets)];
+	payload[0] = id;
+	memcpy(&payload[1], histogram->buckets, sizeof(histogram->buckets));
+	telemetry_send(TELEMETRY_HISTOGRAM, payload, sizeof(payload));
+}
@@ -0,0 +1,54 @@
+/*
+ * histogram.h
+ *
+ * Author: Matthew Chen
+ *
+ * Log bucketed histograms of durations, for seeing how long things take
+ * on the real hardware. Bucket 0 counts values of 0, and bucket n counts
+ * values from 2^(n-1) up to 2^n - 1 (the last bucket also counts anything
+ * bigger), so adding a value is just finding its highest set bit.
+ * Durations are in get_fine_time() units (FINE_TIME_US microseconds).
+ */
+
+#ifndef HISTOGRAM_H_
+#define HISTOGRAM_H_
+
+#include <stdint.h>
+
+#define HISTOGRAM_BUCKETS 16
+
+// Histogram ids (sent in TELEMETRY_HISTOGRAM records)
+#define HISTOGRAM_LOOP	0	// time for one play_game() loop
+#define HISTOGRAM_MOVE	1	// time from a move to it being drawn
+
+typedef struct {
+	uint16_t buckets[HISTOGRAM_BUCKETS];	// counts (stop at UINT16_MAX)
+	uint16_t max;							// largest value added
+} Histogram;
+
+/* Sets every count back to 0.
+ */
+void histogram_reset(Histogram* histogram);
+
+/* Adds a duration to the histogram.
+ */
+void histogram_add(Histogram* histogram, uint16_t value);
+
+/* Prints the non-empty buckets (and the maximum) to the terminal from the
+ * current cursor position, one per line, after a heading stored in
+ * program memory. This waits for the UART, so it should only be used when
+ * asked for.
+ */
+void histogram_print(const Histogram* histogram, const char* heading);
+
+/* Prints a duration given in get_fine_time() units as microseconds (or
+ * milliseconds once it is too big to read easily).
+ */
+void histogram_print_duration(uint32_t fine_time);
+
+/* Sends the bucket counts as a TELEMETRY_HISTOGRAM record (if telemetry
+ * is on).
+ */
+void histogram_send(const Histogram* histogram, uint8_t id);
+
+#endif /* HISTOGRAM_H_ */
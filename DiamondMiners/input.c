@@ -0,0 +1,177 @@
+/*
+ * input.c
+ *
+ * Author: Matthew Chen
+ *
+ * See input.h. The queue is only used from the main loop so it doesn't
+ * need to be protected from interrupts - the interrupt driven parts are
+ * the buttons and serial queues underneath it.
+ */
+
+#include <stdio.h>
+
+#include "input.h"
+#include "buttons.h"
+#include "serialio.h"
+#include "joystick.h"
+#include "timer0.h"
+#include "latency.h"
+#include "input_log.h"
+#include "flight.h"
+
+// Events waiting to be handled, oldest first
+static InputEvent queue[INPUT_QUEUE_SIZE];
+static uint8_t queue_length;
+static uint16_t overflow_count;
+// Set when INPUT_COMMAND_PREFIX has been typed
+static uint8_t command_next;
+
+// Button number to move (button 0 is on the right, button 3 on the left)
+static const uint8_t button_actions[4] =
+		{INPUT_MOVE_RIGHT, INPUT_MOVE_DOWN, INPUT_MOVE_UP, INPUT_MOVE_LEFT};
+
+// Joystick direction to move
+static const uint8_t joystick_actions[4] =
+		{INPUT_MOVE_RIGHT, INPUT_MOVE_DOWN, INPUT_MOVE_UP, INPUT_MOVE_LEFT};
+
+/*
+ * Returns the action for a key typed on the terminal.
+ */
+static uint8_t key_action(char key) {
+	switch (key) {
+		case 'd':
+		case 'D':
+			return INPUT_MOVE_RIGHT;
+		case 's':
+		case 'S':
+			return INPUT_MOVE_DOWN;
+		case 'w':
+		case 'W':
+			return INPUT_MOVE_UP;
+		case 'a':
+		case 'A':
+			return INPUT_MOVE_LEFT;
+		case 'e':
+		case 'E':
+			return INPUT_INSPECT;
+		case 'c':
+		case 'C':
+			return INPUT_CHEAT;
+		case ' ':
+			return INPUT_BOMB;
+		case 'p':
+		case 'P':
+			return INPUT_PAUSE;
+		case 'f':
+		case 'F':
+			return INPUT_VISION;
+		case 'm':
+		case 'M':
+			return INPUT_MUTE;
+	}
+	return INPUT_NONE;
+}
+
+/*
+ * Adds an event to the queue, keeping the queue in time order. Events with
+ * the same time stay in the order they were added.
+ */
+static void add_event(uint8_t source, uint8_t action, char key, uint32_t time) {
+	if (queue_length >= INPUT_QUEUE_SIZE) {
+		overflow_count++;
+		return;
+	}
+	uint8_t i = queue_length;
+	while (i > 0 && (int32_t)(queue[i-1].time - time) > 0) {
+		queue[i] = queue[i-1];
+		i--;
+	}
+	queue[i].source = source;
+	queue[i].action = action;
+	queue[i].key = key;
+	queue[i].time = time;
+	queue_length++;
+}
+
+void input_clear(void) {
+	ButtonEvent button;
+	while (button_get_event(&button)) {
+		;
+	}
+	clear_serial_input_buffer();
+	joystick_clear();
+	queue_length = 0;
+	command_next = 0;
+	// Inputs that were thrown away shouldn't be timed
+	for (uint8_t i = 0; i < INPUT_NUM_SOURCES; i++) {
+		latency_done(i);
+	}
+}
+
+void input_poll(void) {
+	// While a log is being replayed, only terminal commands are taken
+	// from the live input
+	uint8_t replaying = input_log_replaying();
+	ButtonEvent button;
+	while (button_get_event(&button)) {
+		// A held button repeats the move, a release does nothing
+		if (button.type != BUTTON_EVENT_RELEASE && !replaying) {
+			add_event(INPUT_SOURCE_BUTTON, button_actions[button.button], 0,
+					button.time);
+		}
+	}
+
+	uint32_t current_time = get_current_time();
+	while (serial_input_available()) {
+		char key = fgetc(stdin);
+		if (command_next) {
+			command_next = 0;
+			add_event(INPUT_SOURCE_SERIAL, INPUT_COMMAND, key, current_time);
+		} else if (key == INPUT_COMMAND_PREFIX) {
+			command_next = 1;
+		} else if (!replaying) {
+			add_event(INPUT_SOURCE_SERIAL, key_action(key), key, current_time);
+		}
+	}
+
+	joystick_update();
+	int8_t direction;
+	while ((direction = joystick_move()) != JOYSTICK_NONE) {
+		if (!replaying) {
+			add_event(INPUT_SOURCE_JOYSTICK, joystick_actions[direction], 0,
+					current_time);
+		}
+	}
+
+	// Replayed actions are taken from the log in the tick they were
+	// recorded in, while there is room for them
+	uint8_t action;
+	while (queue_length < INPUT_QUEUE_SIZE && input_log_next(&action)) {
+		add_event(INPUT_SOURCE_SERIAL, action, 0, current_time);
+	}
+}
+
+void input_add(uint8_t source, uint8_t action) {
+	add_event(source, action, 0, get_current_time());
+}
+
+uint8_t input_get_event(InputEvent* event) {
+	if (queue_length == 0) {
+		return 0;
+	}
+	*event = queue[0];
+	queue_length--;
+	for (uint8_t i = 0; i < queue_length; i++) {
+		queue[i] = queue[i+1];
+	}
+	input_log_record(event);
+	// The game records a move itself, with whether the player moved
+	if (event->action < INPUT_MOVE_RIGHT || event->action > INPUT_MOVE_LEFT) {
+		flight_record(FLIGHT_INPUT, (event->source << 4) | event->action);
+	}
+	return 1;
+}
+
+uint16_t input_overflow_count(void) {
+	return overflow_count;
+}
@@ -0,0 +1,77 @@
+/*
+ * input.h
+ *
+ * Author: Matthew Chen
+ *
+ * Collects input from the push buttons (buttons.c), the serial terminal
+ * (serialio.c) and the joystick (joystick.c) into one queue of timestamped
+ * events, ordered by when they happened. The game loop calls input_poll()
+ * once per iteration and then handles every event with input_get_event().
+ * How long each source takes from input to photon is measured by latency.c.
+ * Typing INPUT_COMMAND_PREFIX on the terminal makes the next key a
+ * command (for debugging and measuring) rather than a game action.
+ */
+
+#ifndef INPUT_H_
+#define INPUT_H_
+
+#include <stdint.h>
+
+// Where an event came from
+#define INPUT_SOURCE_BUTTON		0
+#define INPUT_SOURCE_SERIAL		1
+#define INPUT_SOURCE_JOYSTICK	2
+#define INPUT_NUM_SOURCES		3
+
+// What the event asks the game to do
+#define INPUT_NONE			0	// some other key (see the key field)
+#define INPUT_MOVE_RIGHT	1
+#define INPUT_MOVE_DOWN		2
+#define INPUT_MOVE_UP		3
+#define INPUT_MOVE_LEFT		4
+#define INPUT_INSPECT		5
+#define INPUT_CHEAT			6
+#define INPUT_BOMB			7
+#define INPUT_PAUSE			8
+#define INPUT_VISION		9
+#define INPUT_MUTE			10
+#define INPUT_COMMAND		11	// the key field holds the command
+
+// Key that starts a command
+#define INPUT_COMMAND_PREFIX '!'
+
+// Number of events that can be waiting
+#define INPUT_QUEUE_SIZE 8
+
+typedef struct {
+	uint8_t source;		// INPUT_SOURCE_*
+	uint8_t action;		// INPUT_*
+	char key;			// the character typed (serial events only, else 0)
+	uint32_t time;		// get_current_time() value when the input arrived or was polled
+} InputEvent;
+
+/* Discards anything waiting from every input source.
+ */
+void input_clear(void);
+
+/* Moves any waiting input from all of the sources into the event queue.
+ * Never blocks.
+ */
+void input_poll(void);
+
+/* Adds an event for action (INPUT_*) to the queue, as if it had just
+ * come from source. For the game to do something by itself that should
+ * be handled (and recorded in the input log) like any other input.
+ */
+void input_add(uint8_t source, uint8_t action);
+
+/* Removes the oldest event from the queue and copies it into event.
+ * Returns 1 if there was an event, 0 if the queue is empty.
+ */
+uint8_t input_get_event(InputEvent* event);
+
+/* Returns the number of events discarded because the queue was full.
+ */
+uint16_t input_overflow_count(void);
+
+#endif /* INPUT_H_ */
@@ -0,0 +1,152 @@
+/*
+ * input_log.c
+ *
+ * Author: Matthew Chen
+ *
+ * See input_log.h. Like the input queue, the log is only used from the
+ * main loop.
+ */
+
+#include <avr/pgmspace.h>
+
+#include "input_log.h"
+#include "serialio.h"
+#include "terminalio.h"
+#include "telemetry.h"
+
+static uint16_t entries[INPUT_LOG_SIZE];
+static uint8_t length;
+static uint16_t dropped;		// entries that didn't fit
+static uint8_t log_level;		// level the log was recorded on
+static uint32_t tick;			// game ticks since the game started
+static uint32_t last_tick;		// tick of the last entry
+// Replay state
+static uint8_t replay_next;		// replay at the start of the next game
+static uint8_t replaying;
+static uint8_t position;		// next entry to replay
+static uint8_t pending;			// replayed actions not handled yet
+
+/*
+ * Adds an entry to the log (and sends it as telemetry).
+ */
+static void add_entry(uint8_t action, uint16_t delta) {
+	uint16_t entry = ((uint16_t)action << INPUT_LOG_ACTION_SHIFT) | delta;
+	if (length >= INPUT_LOG_SIZE) {
+		if (dropped < UINT16_MAX) {
+			dropped++;
+		}
+	} else {
+		entries[length++] = entry;
+	}
+	telemetry_send(TELEMETRY_INPUT, &entry, sizeof(entry));
+}
+
+uint8_t input_log_start(uint8_t level) {
+	tick = 0;
+	last_tick = 0;
+	replaying = replay_next && length > 0;
+	replay_next = 0;
+	if (replaying) {
+		position = 0;
+		pending = 0;
+		return log_level;
+	}
+	length = 0;
+	dropped = 0;
+	log_level = level;
+	telemetry_event(TELEMETRY_EVENT_INPUT_LOG, level);
+	return level;
+}
+
+void input_log_record(const InputEvent* event) {
+	if (event->action == INPUT_NONE || event->action == INPUT_COMMAND) {
+		return;
+	}
+	if (replaying) {
+		// No live actions are queued while replaying, so this is one of
+		// the replayed ones. The replay is over once the last one has
+		// been handled.
+		if (pending > 0) {
+			pending--;
+		}
+		if (pending == 0 && position >= length) {
+			replaying = 0;
+		}
+		return;
+	}
+	uint32_t delta = tick - last_tick;
+	last_tick = tick;
+	while (delta > INPUT_LOG_MAX_DELTA) {
+		add_entry(INPUT_LOG_GAP, INPUT_LOG_MAX_DELTA);
+		delta -= INPUT_LOG_MAX_DELTA;
+	}
+	add_entry(event->action, delta);
+}
+
+void input_log_tick(void) {
+	tick++;
+}
+
+uint8_t input_log_replay_next(void) {
+	replay_next = length > 0 && dropped == 0;
+	return replay_next;
+}
+
+uint8_t input_log_replaying(void) {
+	return replaying;
+}
+
+uint8_t input_log_next(uint8_t* action) {
+	while (replaying && position < length) {
+		uint16_t entry = entries[position];
+		uint32_t due = last_tick + (entry & INPUT_LOG_MAX_DELTA);
+		if (due > tick) {
+			break;
+		}
+		position++;
+		last_tick = due;
+		if ((entry >> INPUT_LOG_ACTION_SHIFT) != INPUT_LOG_GAP) {
+			*action = entry >> INPUT_LOG_ACTION_SHIFT;
+			pending++;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Writes a 16 bit value as 4 hex digits.
+ */
+static void write_hex(uint16_t value) {
+	char digits[4];
+	for (int8_t i = 3; i >= 0; i--) {
+		uint8_t digit = value & 0x0F;
+		digits[i] = digit < 10 ? '0' + digit : 'a' + digit - 10;
+		value >>= 4;
+	}
+	serial_write(digits, sizeof(digits));
+}
+
+void input_log_print(void) {
+	serial_write_P(PSTR("level "));
+	serial_write_uint(log_level);
+	serial_write_P(PSTR(" entries "));
+	serial_write_uint(length);
+	serial_write_P(PSTR(" dropped "));
+	serial_write_uint(dropped);
+	if (dropped > 0) {
+		serial_write_P(PSTR(" (incomplete, can't be replayed with !y)"));
+	}
+	clear_to_end_of_line();
+	for (uint8_t i = 0; i < length; i++) {
+		// 8 entries to a line
+		if (i % 8 == 0) {
+			serial_write_P(PSTR("\r\n"));
+		} else {
+			serial_write_P(PSTR(" "));
+		}
+		write_hex(entries[i]);
+	}
+	clear_to_end_of_line();
+	serial_write_P(PSTR("\r\n"));
+}
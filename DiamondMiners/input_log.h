@@ -0,0 +1,87 @@
+/*
+ * input_log.h
+ *
+ * Author: Matthew Chen
+ *
+ * Records the game actions of each game (from any input source) so the
+ * game can be played again exactly, for comparing the speed of two builds
+ * (with the Profile build's cycle counts) or finding out how a game went
+ * wrong. Times are in game ticks (GAME_TICK_MS each, see timer0.h) - the
+ * tick the game handled the action in - so a replay hands each action to
+ * the same tick as the recording, whatever the wall clock does. Each
+ * entry is 16 bits:
+ *		bits 12-15	the action (INPUT_*), or INPUT_LOG_GAP
+ *		bits 0-11	game ticks since the previous entry (up to 4095)
+ * A gap entry adds INPUT_LOG_MAX_DELTA ticks without an action, for
+ * longer waits. The first entry's time is from the start of the game.
+ * No ticks are played while the game is paused, so an action handled on
+ * the pause screen has the tick the game was paused in.
+ * Commands and keys that don't do anything aren't recorded. When the log
+ * is full the rest of the game isn't recorded (and the entries missed are
+ * counted). Such a log can't be replayed on the board, since the replay
+ * would carry on with live input where the log ends - send the game as
+ * telemetry (where every entry is sent) and replay it with
+ * tools/game_replay instead. While telemetry is on, each entry is also
+ * sent as a TELEMETRY_INPUT record.
+ * A replay feeds the log back through input_poll() in the ticks it was
+ * recorded in, in place of the buttons, joystick and terminal (terminal
+ * commands still work). Once every entry has been replayed, live input
+ * takes over again and is added to the end of the log. tools/game_replay
+ * replays a log on a PC.
+ */
+
+#ifndef INPUT_LOG_H_
+#define INPUT_LOG_H_
+
+#include <stdint.h>
+
+#include "input.h"
+
+// Entry fields
+#define INPUT_LOG_ACTION_SHIFT	12
+#define INPUT_LOG_MAX_DELTA		4095
+#define INPUT_LOG_GAP			15
+
+// Number of entries kept (2 bytes each)
+#ifndef INPUT_LOG_SIZE
+#define INPUT_LOG_SIZE 64
+#endif
+
+/* Starts the log for a new game on the given level and returns the level
+ * to play. If a replay has been asked for (input_log_replay_next()), the
+ * log is kept, replaying starts and the level it was recorded on is
+ * returned. Otherwise the log is emptied and recording starts.
+ */
+uint8_t input_log_start(uint8_t level);
+
+/* Counts a game tick. Call at the start of each tick, before input_poll().
+ */
+void input_log_tick(void);
+
+/* Adds an event that the game is about to handle to the log (unless it
+ * is being replayed or isn't a game action).
+ */
+void input_log_record(const InputEvent* event);
+
+/* Makes the next game replay the log. Returns 0 (and doesn't) if the log
+ * is empty or entries were dropped from it.
+ */
+uint8_t input_log_replay_next(void);
+
+/* Returns 1 while a log is being replayed. Stops being 1 once the game
+ * has handled every replayed action.
+ */
+uint8_t input_log_replaying(void);
+
+/* If the next replayed action was recorded in the current tick (or
+ * earlier), takes it from the log, sets action and returns 1. Otherwise
+ * returns 0.
+ */
+uint8_t input_log_next(uint8_t* action);
+
+/* Prints the log on the terminal: the level and number of entries, then
+ * the entries in hex (the format tools/game_replay reads).
+ */
+void input_log_print(void);
+
+#endif /* INPUT_LOG_H_ */
@@ -0,0 +1,83 @@
+/*
+ * isr_trace.h
+ *
+ * Author: Matthew Chen
+ *
+ * Marker pins for timing the interrupt handlers with a logic analyser or
+ * a simulator trace (simavr can write the pins to a VCD file). In the
+ * Trace build configuration (which defines ISR_TRACE) each traced handler
+ * sets its pin high on entry and low on exit, and the main program sets
+ * ISR_TRACE_PIN_CLI high while it has interrupts turned off in
+ * get_current_time(), get_fine_time() and the serial output functions.
+ * make -C tools isr_trace_test records the trace in simavr (with
+ * tools/sim_scenario), then tools/isr_trace reads it and reports how long
+ * each handler takes, whether any nest, how long interrupts are held off
+ * for and how late the 1ms timer interrupt runs. In other builds the macros are empty.
+ * Port D only has room for the first four handlers, so the others have
+ * their markers on the spare pins of port A. Those are next to the
+ * joystick's ADC inputs, so in the Trace build the joystick readings may
+ * be a little noisier. Only TIMER1_OVF (in the Profile build) has no
+ * marker.
+ * The pins are set with single sbi/cbi instructions, so the main program
+ * and the handlers can share the ports. The marker goes high after the
+ * handler's compiler generated register saves, so those aren't included.
+ */
+
+#ifndef ISR_TRACE_H_
+#define ISR_TRACE_H_
+
+#include <avr/io.h>
+
+// Marker pins (on port D)
+#define ISR_TRACE_PIN_TIMER0	2	// TIMER0_COMPA (timer0.c)
+#define ISR_TRACE_PIN_BUTTONS	3	// PCINT1 (buttons.c)
+#define ISR_TRACE_PIN_SERIAL_RX	5	// USART0_RX (serialio.c)
+#define ISR_TRACE_PIN_SERIAL_TX	6	// USART0_UDRE (serialio.c)
+#define ISR_TRACE_PIN_CLI		7	// main program has interrupts off
+// Marker pins (on port A)
+#define ISR_TRACE_PIN_ADC		2	// ADC (adc.c)
+#define ISR_TRACE_PIN_TIMER2	3	// TIMER2_COMPA (timer2.c)
+#define ISR_TRACE_PIN_EEPROM	4	// EE_READY (eeprom.c)
+
+#ifdef ISR_TRACE
+
+#define ISR_TRACE_ENTER(pin) (PORTD |= (1 << (pin)))
+#define ISR_TRACE_EXIT(pin) (PORTD &= ~(1 << (pin)))
+#define ISR_TRACE_ENTER_A(pin) (PORTA |= (1 << (pin)))
+#define ISR_TRACE_EXIT_A(pin) (PORTA &= ~(1 << (pin)))
+/* Marks the start and end of a time with interrupts off - only if they
+ * were on before (so not in an interrupt handler).
+ */
+#define ISR_TRACE_CLI_START(interrupts_were_on) \
+	do { if (interrupts_were_on) PORTD |= (1 << ISR_TRACE_PIN_CLI); } while (0)
+#define ISR_TRACE_CLI_END(interrupts_were_on) \
+	do { if (interrupts_were_on) PORTD &= ~(1 << ISR_TRACE_PIN_CLI); } while (0)
+
+static inline void init_isr_trace(void) {
+	PORTD &= ~((1 << ISR_TRACE_PIN_TIMER0) | (1 << ISR_TRACE_PIN_BUTTONS)
+			| (1 << ISR_TRACE_PIN_SERIAL_RX) | (1 << ISR_TRACE_PIN_SERIAL_TX)
+			| (1 << ISR_TRACE_PIN_CLI));
+	DDRD |= (1 << ISR_TRACE_PIN_TIMER0) | (1 << ISR_TRACE_PIN_BUTTONS)
+			| (1 << ISR_TRACE_PIN_SERIAL_RX) | (1 << ISR_TRACE_PIN_SERIAL_TX)
+			| (1 << ISR_TRACE_PIN_CLI);
+	PORTA &= ~((1 << ISR_TRACE_PIN_ADC) | (1 << ISR_TRACE_PIN_TIMER2)
+			| (1 << ISR_TRACE_PIN_EEPROM));
+	DDRA |= (1 << ISR_TRACE_PIN_ADC) | (1 << ISR_TRACE_PIN_TIMER2)
+			| (1 << ISR_TRACE_PIN_EEPROM);
+}
+
+#else
+
+#define ISR_TRACE_ENTER(pin)
+#define ISR_TRACE_EXIT(pin)
+#define ISR_TRACE_ENTER_A(pin)
+#define ISR_TRACE_EXIT_A(pin)
+#define ISR_TRACE_CLI_START(interrupts_were_on)
+#define ISR_TRACE_CLI_END(interrupts_were_on)
+
+static inline void init_isr_trace(void) {
+}
+
+#endif
+
+#endif /* ISR_TRACE_H_ */
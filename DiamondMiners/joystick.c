@@ -0,0 +1,171 @@
+/*
+ * joystick.c
+ *
+ * Author: Matthew Chen
+ *
+ * See joystick.h. The ADC is read through adc_read_joystick() so this never
+ * waits for a conversion.
+ */
+
+#include <stdlib.h>
+
+#include "joystick.h"
+#include "adc.h"
+#include "input.h"
+#include "latency.h"
+#include "timer0.h"
+
+// Number of readings averaged to find the centre
+#define CALIBRATION_SAMPLES 16
+
+#define JOYSTICK_QUEUE_MASK (JOYSTICK_QUEUE_SIZE - 1)
+
+// Resting position of each axis
+static uint16_t centre_x = 512;
+static uint16_t centre_y = 512;
+static uint16_t dead_zone = JOYSTICK_DEFAULT_DEAD_ZONE;
+
+// The direction currently being held and when it should next repeat
+static int8_t held = JOYSTICK_NONE;
+static uint32_t next_repeat_time;
+static uint16_t repeat_interval;
+// Set by joystick_clear() - ignore the stick until it is released
+static uint8_t wait_for_release;
+
+// Queue of moves. Only used from the main loop so it doesn't need to be
+// protected from interrupts.
+static int8_t move_queue[JOYSTICK_QUEUE_SIZE];
+static uint8_t queue_head;
+static uint8_t queue_tail;
+
+void joystick_calibrate(void) {
+	uint32_t sum_x = 0;
+	uint32_t sum_y = 0;
+	uint16_t x, y;
+	uint8_t samples = 0;
+	while (samples < CALIBRATION_SAMPLES) {
+		// Only count fresh readings
+		if (adc_read_joystick(&x, &y)) {
+			sum_x += x;
+			sum_y += y;
+			samples++;
+		}
+	}
+	centre_x = sum_x / CALIBRATION_SAMPLES;
+	centre_y = sum_y / CALIBRATION_SAMPLES;
+}
+
+void joystick_set_dead_zone(uint16_t zone) {
+	if (zone < JOYSTICK_HYSTERESIS) {
+		zone = JOYSTICK_HYSTERESIS;
+	}
+	dead_zone = zone;
+}
+
+/*
+ * Returns how far the stick is pushed in the given direction (negative if
+ * it is pushed the opposite way).
+ */
+static int16_t push_amount(int8_t direction, int16_t dx, int16_t dy) {
+	switch (direction) {
+		case JOYSTICK_RIGHT:
+			return dx;
+		case JOYSTICK_LEFT:
+			return -dx;
+		case JOYSTICK_DOWN:
+			return dy;
+		case JOYSTICK_UP:
+			return -dy;
+	}
+	return 0;
+}
+
+/*
+ * Returns the direction the stick is pushed furthest in, or JOYSTICK_NONE
+ * if it isn't pushed at least threshold from the centre.
+ */
+static int8_t direction_of(int16_t dx, int16_t dy, int16_t threshold) {
+	int16_t ax = abs(dx);
+	int16_t ay = abs(dy);
+	if (ax < threshold && ay < threshold) {
+		return JOYSTICK_NONE;
+	}
+	if (ax >= ay) {
+		return dx > 0 ? JOYSTICK_RIGHT : JOYSTICK_LEFT;
+	}
+	return dy > 0 ? JOYSTICK_DOWN : JOYSTICK_UP;
+}
+
+static void queue_move(int8_t direction, uint8_t is_repeat) {
+	if ((uint8_t)(queue_head - queue_tail) >= JOYSTICK_QUEUE_SIZE) {
+		if (is_repeat) {
+			return;
+		}
+		// Never lose a change of direction - replace the newest move instead
+		queue_head--;
+	}
+	move_queue[queue_head++ & JOYSTICK_QUEUE_MASK] = direction;
+	latency_stamp(INPUT_SOURCE_JOYSTICK);
+}
+
+void joystick_update(void) {
+	uint16_t x, y;
+	(void)adc_read_joystick(&x, &y);
+	int16_t dx = (int16_t)x - (int16_t)centre_x;
+	int16_t dy = (int16_t)y - (int16_t)centre_y;
+	int16_t release = dead_zone - JOYSTICK_HYSTERESIS;
+
+	if (wait_for_release) {
+		if (direction_of(dx, dy, release) == JOYSTICK_NONE) {
+			wait_for_release = 0;
+		}
+		return;
+	}
+
+	int8_t direction;
+	if (held != JOYSTICK_NONE && push_amount(held, dx, dy) >= release) {
+		// Still held. Only swap to another direction if the held one has
+		// dropped inside the dead zone and the other is fully pushed.
+		direction = held;
+		if (push_amount(held, dx, dy) < (int16_t)dead_zone) {
+			int8_t other = direction_of(dx, dy, dead_zone);
+			if (other != JOYSTICK_NONE) {
+				direction = other;
+			}
+		}
+	} else {
+		direction = direction_of(dx, dy, dead_zone);
+	}
+
+	uint32_t current_time = get_current_time();
+	if (direction != held) {
+		held = direction;
+		if (direction != JOYSTICK_NONE) {
+			queue_move(direction, 0);
+			next_repeat_time = current_time + JOYSTICK_REPEAT_DELAY;
+			repeat_interval = JOYSTICK_REPEAT_START;
+		}
+	} else if (direction != JOYSTICK_NONE &&
+			(int32_t)(current_time - next_repeat_time) >= 0) {
+		queue_move(direction, 1);
+		next_repeat_time = current_time + repeat_interval;
+		// Speed up the longer the stick is held
+		repeat_interval -= repeat_interval / 4;
+		if (repeat_interval < JOYSTICK_REPEAT_MIN) {
+			repeat_interval = JOYSTICK_REPEAT_MIN;
+		}
+	}
+}
+
+int8_t joystick_move(void) {
+	if (queue_tail == queue_head) {
+		return JOYSTICK_NONE;
+	}
+	return move_queue[queue_tail++ & JOYSTICK_QUEUE_MASK];
+}
+
+void joystick_clear(void) {
+	queue_tail = queue_head;
+	held = JOYSTICK_NONE;
+	wait_for_release = 1;
+}
@@ -0,0 +1,70 @@
+/*
+ * joystick.h
+ *
+ * Author: Matthew Chen
+ *
+ * Turns the raw joystick readings from adc.c into movement events.
+ * The centre position is measured at boot (joystick_calibrate()), so a
+ * joystick that doesn't rest exactly at 512 still works. The stick has to
+ * move further than the dead zone from the centre to register a direction
+ * and has to come back inside the dead zone less the hysteresis to release
+ * it, so a stick resting near the edge of the dead zone doesn't chatter.
+ * A direction is sent as soon as it is pushed (including a change from one
+ * direction straight to another), and while the stick is held it repeats,
+ * getting faster the longer it is held.
+ */
+
+#ifndef JOYSTICK_H_
+#define JOYSTICK_H_
+
+#include <stdint.h>
+
+#define JOYSTICK_NONE	(-1)
+#define JOYSTICK_RIGHT	0
+#define JOYSTICK_DOWN	1
+#define JOYSTICK_UP		2
+#define JOYSTICK_LEFT	3
+
+// Default distance (in ADC counts) from the centre before a direction registers
+#define JOYSTICK_DEFAULT_DEAD_ZONE 220
+// How far back inside the dead zone the stick must come to release a direction
+#define JOYSTICK_HYSTERESIS 40
+// Delay before the first repeat, then the repeat interval starts at
+// JOYSTICK_REPEAT_START and is multiplied by 3/4 after each repeat until
+// it reaches JOYSTICK_REPEAT_MIN (all in milliseconds)
+#define JOYSTICK_REPEAT_DELAY 400
+#define JOYSTICK_REPEAT_START 300
+#define JOYSTICK_REPEAT_MIN 100
+
+// Number of moves that can be waiting (must be a power of 2)
+#define JOYSTICK_QUEUE_SIZE 4
+
+/* Measures the resting position of the joystick by averaging readings from
+ * the ADC. Must be called with interrupts enabled (after init_adc()) and
+ * while nobody is touching the joystick. Takes a few milliseconds.
+ */
+void joystick_calibrate(void);
+
+/* Sets how far the joystick must be pushed from the centre before a
+ * direction registers. Values smaller than JOYSTICK_HYSTERESIS are
+ * increased to JOYSTICK_HYSTERESIS.
+ */
+void joystick_set_dead_zone(uint16_t dead_zone);
+
+/* Reads the latest joystick position (without waiting) and adds any
+ * movement (a new direction or a repeat) to the move queue. Should be
+ * called every time around the main loop.
+ */
+void joystick_update(void);
+
+/* Return the next joystick move (JOYSTICK_RIGHT, JOYSTICK_DOWN, JOYSTICK_UP
+ * or JOYSTICK_LEFT) or JOYSTICK_NONE if there are no moves waiting.
+ */
+int8_t joystick_move(void);
+
+/* Discards any moves waiting in the queue. The stick must be released and
+ * pushed again before another move is generated.
+ */
+void joystick_clear(void);
+
+#endif /* JOYSTICK_H_ */
@@ -0,0 +1,184 @@
+/*
+ * latency.c
+ *
+ * Author: Matthew Chen
+ *
+ * See latency.h.
+ */
+
+#include <string.h>
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
+
+#include "latency.h"
+#include "display.h"
+#include "histogram.h"
+#include "input.h"
+#include "serialio.h"
+#include "telemetry.h"
+#include "terminalio.h"
+#include "timer0.h"
+
+#define NOT_ARMED 0xFF
+
+typedef struct {
+	uint16_t buckets[LATENCY_BUCKETS];
+	uint16_t count;
+	uint16_t min;
+	uint16_t max;
+} SourceSamples;
+
+typedef struct {
+	uint8_t source;
+	LatencySummary summary;
+} LatencyRecord;
+
+// When the first unhandled input from each source arrived. A source's
+// time is only written (by interrupt handlers) while its bit in stamped
+// is clear, and only read by the game loop while it is set.
+static volatile uint16_t stamp_time[INPUT_NUM_SOURCES];
+static volatile uint8_t stamped;
+static uint8_t armed = NOT_ARMED;
+
+static SourceSamples samples[INPUT_NUM_SOURCES];
+
+static const char button_name[] PROGMEM = "Button";
+static const char serial_name[] PROGMEM = "Serial";
+static const char joystick_name[] PROGMEM = "Joystick";
+static const char* const source_names[INPUT_NUM_SOURCES] PROGMEM =
+		{button_name, serial_name, joystick_name};
+
+/*
+ * Returns the bucket for a value: values 0 and 1 have their own buckets,
+ * after that each power of two is split into a lower and upper half.
+ */
+static uint8_t bucket_of(uint16_t value) {
+	if (value < 2) {
+		return value;
+	}
+	uint8_t octave = 15;
+	while (!(value & 0x8000)) {
+		value <<= 1;
+		octave--;
+	}
+	return 2 * octave + ((value >> 14) & 1);
+}
+
+/*
+ * Returns the largest value that goes in a bucket.
+ */
+static uint16_t bucket_top(uint8_t bucket) {
+	if (bucket < 2) {
+		return bucket;
+	}
+	uint8_t octave = bucket >> 1;
+	uint16_t half = 1U << (octave - 1);
+	uint16_t bottom = (1U << octave) | ((bucket & 1) ? half : 0);
+	return bottom + (half - 1);
+}
+
+void latency_stamp(uint8_t source) {
+	uint8_t bit = 1 << source;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if (!(stamped & bit)) {
+			stamp_time[source] = get_fine_time();
+			stamped |= bit;
+		}
+	}
+}
+
+void latency_arm(uint8_t source) {
+	armed = (stamped & (1 << source)) ? source : NOT_ARMED;
+}
+
+void latency_pixel_sent(PixelColour colour) {
+	if (armed == NOT_ARMED || colour != MATRIX_COLOUR_PLAYER) {
+		return;
+	}
+	uint16_t elapsed = get_fine_time() - stamp_time[armed];
+	SourceSamples* s = &samples[armed];
+	armed = NOT_ARMED;
+
+	uint8_t bucket = bucket_of(elapsed);
+	if (s->buckets[bucket] < UINT16_MAX) {
+		s->buckets[bucket]++;
+	}
+	if (s->count == 0 || elapsed < s->min) {
+		s->min = elapsed;
+	}
+	if (elapsed > s->max) {
+		s->max = elapsed;
+	}
+	if (s->count < UINT16_MAX) {
+		s->count++;
+	}
+}
+
+void latency_done(uint8_t source) {
+	if (armed == source) {
+		armed = NOT_ARMED;
+	}
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		stamped &= ~(1 << source);
+	}
+}
+
+void latency_reset(void) {
+	memset(samples, 0, sizeof(samples));
+}
+
+/*
+ * Returns the value below which the given percentage of samples fall
+ * (to the resolution of the buckets).
+ */
+static uint16_t percentile(const SourceSamples* s, uint8_t percent) {
+	uint16_t target = ((uint32_t)s->count * percent + 99) / 100;
+	uint16_t seen = 0;
+	for (uint8_t i = 0; i < LATENCY_BUCKETS; i++) {
+		seen += s->buckets[i];
+		if (seen >= target) {
+			uint16_t top = bucket_top(i);
+			if (top > s->max) {
+				return s->max;
+			}
+			return top < s->min ? s->min : top;
+		}
+	}
+	return s->max;
+}
+
+void latency_summary(uint8_t source, LatencySummary* summary) {
+	const SourceSamples* s = &samples[source];
+	summary->count = s->count;
+	summary->min = s->min;
+	summary->max = s->max;
+	if (s->count) {
+		summary->p50 = percentile(s, 50);
+		summary->p99 = percentile(s, 99);
+	} else {
+		summary->p50 = 0;
+		summary->p99 = 0;
+	}
+}
+
+void latency_report(void) {
+	LatencyRecord record;
+	for (uint8_t source = 0; source < INPUT_NUM_SOURCES; source++) {
+		record.source = source;
+		latency_summary(source, &record.summary);
+		serial_write_P((const char*)pgm_read_word(&source_names[source]));
+		serial_write_P(PSTR(": n="));
+		serial_write_uint(record.summary.count);
+		serial_write_P(PSTR(" min="));
+		histogram_print_duration(record.summary.min);
+		serial_write_P(PSTR(" p50="));
+		histogram_print_duration(record.summary.p50);
+		serial_write_P(PSTR(" p99="));
+		histogram_print_duration(record.summary.p99);
+		serial_write_P(PSTR(" max="));
+		histogram_print_duration(record.summary.max);
+		clear_to_end_of_line();
+		serial_write_P(PSTR("\r\n"));
+		telemetry_send(TELEMETRY_LATENCY, &record, sizeof(record));
+	}
+}
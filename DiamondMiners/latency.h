@@ -0,0 +1,74 @@
+/*
+ * latency.h
+ *
+ * Author: Matthew Chen
+ *
+ * Measures input to photon latency: the time from an input arriving to
+ * the player being drawn in its new place on the LED matrix.
+ * The input side calls latency_stamp() as early as it can - the button
+ * pin change interrupt (presses and held repeats), the serial receive
+ * interrupt (every key) and joystick.c when the stick crosses its
+ * threshold or repeats. Only the first input from a source that hasn't
+ * been handled yet is stamped, so a burst of inputs is timed from its
+ * start.
+ * The game loop calls latency_arm() before making a move for an event and
+ * latency_done() after handling any event. While armed, ledmatrix.c calls
+ * latency_pixel_sent() once the SPI bytes for a pixel have gone; the first
+ * player coloured pixel ends the measurement.
+ * Samples are kept in a histogram per source with two buckets per power
+ * of two, so the median and 99th percentile are reported to within about
+ * 25%. The minimum and maximum are exact.
+ */
+
+#ifndef LATENCY_H_
+#define LATENCY_H_
+
+#include <stdint.h>
+#include "pixel_colour.h"
+
+#define LATENCY_BUCKETS 32
+
+/* Summary of the samples for a source, in get_fine_time() units
+ * (FINE_TIME_US microseconds)
+ */
+typedef struct {
+	uint16_t count;
+	uint16_t min;
+	uint16_t p50;
+	uint16_t p99;
+	uint16_t max;
+} LatencySummary;
+
+/* Records that an input from source (INPUT_SOURCE_*) has arrived.
+ * Safe to call from interrupt handlers.
+ */
+void latency_stamp(uint8_t source);
+
+/* Starts waiting for the player to be drawn in response to an input from
+ * source.
+ */
+void latency_arm(uint8_t source);
+
+/* Called by ledmatrix.c when a pixel has been sent to the matrix.
+ */
+void latency_pixel_sent(PixelColour colour);
+
+/* Finishes with the current input from source (call after every event,
+ * whether or not it moved the player) so the next input is stamped.
+ */
+void latency_done(uint8_t source);
+
+/* Forgets all of the samples.
+ */
+void latency_reset(void);
+
+/* Fills in the summary for source.
+ */
+void latency_summary(uint8_t source, LatencySummary* summary);
+
+/* Prints the summary for every source to the terminal from the current
+ * cursor position, and sends them as TELEMETRY_LATENCY records.
+ */
+void latency_report(void);
+
+#endif /* LATENCY_H_ */
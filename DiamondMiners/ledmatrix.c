@@ -4,11 +4,18 @@
  * Author: Peter Sutton
  * 
  * See the LED matrix Reference for details of the SPI commands used.
+ * Every pixel sent to the matrix is also passed to mirror.c so the board
+ * can be shown on the terminal. Single pixel and whole matrix updates are
+ * also passed to latency.c as each pixel is sent, to time when the player
+ * is drawn.
  */ 
 
 #include <avr/io.h>
 #include "ledmatrix.h"
 #include "spi.h"
+#include "mirror.h"
+#include "latency.h"
+#include "profile.h"
 
 #define CMD_UPDATE_ALL 0x00
 #define CMD_UPDATE_PIXEL 0x01
@@ -29,11 +36,14 @@ void ledmatrix_update_all(MatrixData data) {
 	for(uint8_t y=0; y<MATRIX_NUM_ROWS; y++) {
 		for(uint8_t x=0; x<MATRIX_NUM_COLUMNS; x++) {
 			(void)spi_send_byte(data[x][y]);
+			mirror_pixel(x, y, data[x][y]);
+			latency_pixel_sent(data[x][y]);
 		}
 	}
 }
 
 void ledmatrix_update_pixel(uint8_t x, uint8_t y, PixelColour pixel) {
+	PROFILE_FUNCTION(PROFILE_LEDMATRIX_UPDATE_PIXEL);
 	if(x >= MATRIX_NUM_COLUMNS || y >= MATRIX_NUM_ROWS) {
 		// Position isn't valid - we ignore the request.
 		return;
@@ -41,6 +51,8 @@ void ledmatrix_update_pixel(uint8_t x, uint8_t y, PixelColour pixel) {
 	(void)spi_send_byte(CMD_UPDATE_PIXEL);
 	(void)spi_send_byte( ((y & 0x07)<<4) | (x & 0x0F));
 	(void)spi_send_byte(pixel);
+	mirror_pixel(x, y, pixel);
+	latency_pixel_sent(pixel);
 }
 
 void ledmatrix_update_row(uint8_t y, MatrixRow row) {
@@ -52,6 +64,7 @@ void ledmatrix_update_row(uint8_t y, MatrixRow row) {
 	(void)spi_send_byte(y & 0x07);	// row number
 	for(uint8_t x = 0; x<MATRIX_NUM_COLUMNS; x++) {
 		(void)spi_send_byte(row[x]);
+		mirror_pixel(x, y, row[x]);
 	}
 }
 
@@ -64,6 +77,7 @@ void ledmatrix_update_column(uint8_t x, MatrixColumn col) {
 	(void)spi_send_byte(x & 0x0F); // column number
 	for(uint8_t y = 0; y<MATRIX_NUM_ROWS; y++) {
 		(void)spi_send_byte(col[y]);
+		mirror_pixel(x, y, col[y]);
 	}
 }
 
@@ -89,6 +103,11 @@ void ledmatrix_shift_display_down(void) {
 
 void ledmatrix_clear(void) {
 	(void)spi_send_byte(CMD_CLEAR_SCREEN);
+	for(uint8_t y = 0; y < MATRIX_NUM_ROWS; y++) {
+		for(uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++) {
+			mirror_pixel(x, y, COLOUR_BLACK);
+		}
+	}
 }
 
 void copy_matrix_column(MatrixColumn from, MatrixColumn to) {
@@ -0,0 +1,325 @@
+/*
+ * levels.c
+ *
+ * Author: Matthew Chen
+ *
+ * See levels.h. Each slot is
+ *		0		LEVEL_MARKER
+ *		1-2		CRC16 of the level (see crc.h)
+ *		3-		the level (LEVEL_SIZE bytes)
+ * A new upload first writes 0xFF over the marker, so the slot doesn't
+ * check out until the upload has finished. The level is checked as its
+ * :D frames arrive, and turned down at the :E frame if it couldn't be
+ * played: if the square the player starts on isn't empty, or there are
+ * no diamonds to find.
+ */
+
+#include <avr/pgmspace.h>
+
+#include "levels.h"
+#include "eeprom.h"
+#include "crc.h"
+#include "game.h"
+#include "serialio.h"
+
+#define LEVEL_MARKER	0xA5
+#define HEADER_SIZE		3
+#define SLOT_SIZE		(HEADER_SIZE + LEVEL_SIZE)
+// The longest frame (after the ':' and before the '\n'), a :D frame
+#define LINE_SIZE		13
+#define MAX_FRAME_DATA	4
+// Where the player starts in a packed level (the top row comes first)
+#define START_SQUARE	((HEIGHT - 1 - PLAYER_START_Y) * WIDTH + PLAYER_START_X)
+
+// The frame waiting for levels_update()
+#define FRAME_NONE		0
+#define FRAME_START		1
+#define FRAME_DATA		2
+#define FRAME_END		3
+
+#if EEPROM_LEVELS_SIZE < LEVEL_SLOTS * SLOT_SIZE
+#error EEPROM_LEVELS_SIZE is too small for the level slots
+#endif
+
+static const uint8_t level_objects[4] PROGMEM = {
+	EMPTY_SQUARE, BREAKABLE, UNBREAKABLE, DIAMOND
+};
+
+// The slots that hold a level that checks out (one bit per slot)
+static uint8_t valid;
+
+// The line being received (without the ':')
+static char line[LINE_SIZE];
+static uint8_t line_length;
+static uint8_t in_frame;
+
+// The last frame received
+static uint8_t frame;
+static uint8_t frame_slot;
+static uint8_t frame_offset;
+static uint8_t frame_length;
+static uint8_t frame_data[MAX_FRAME_DATA];
+static uint16_t frame_crc;
+
+// The upload in progress: the slot (or LEVEL_NO_SLOT), the bytes written
+// so far and their CRC and the offset of the last :D frame
+static uint8_t uploading = LEVEL_NO_SLOT;
+static uint8_t received;
+static uint16_t crc;
+static uint8_t last_offset;
+// What the upload's level has in it so far: the object the player starts
+// on (a LEVEL_CODE_*) and whether there are any diamonds
+static uint8_t start_code;
+static uint8_t has_diamond;
+
+static uint16_t slot_address(uint8_t slot) {
+	return EEPROM_LEVELS_START + slot * SLOT_SIZE;
+}
+
+static uint8_t read_byte(uint16_t address) {
+	uint8_t byte;
+	eeprom_read(address, &byte, 1);
+	return byte;
+}
+
+/*
+ * Returns 1 if the slot holds a whole level.
+ */
+static uint8_t check_slot(uint8_t slot) {
+	uint16_t address = slot_address(slot);
+	if (read_byte(address) != LEVEL_MARKER) {
+		return 0;
+	}
+	uint16_t check = crc_eeprom(address + HEADER_SIZE, LEVEL_SIZE);
+	return (check & 0xFF) == read_byte(address + 1)
+			&& (check >> 8) == read_byte(address + 2);
+}
+
+void init_levels(void) {
+	valid = 0;
+	for (uint8_t slot = 0; slot < LEVEL_SLOTS; slot++) {
+		if (check_slot(slot)) {
+			valid |= 1 << slot;
+		}
+	}
+}
+
+uint8_t level_uploaded(uint8_t level) {
+	return level < LEVEL_SLOTS && (valid & (1 << level));
+}
+
+uint8_t levels_load(uint8_t level, uint16_t playing_field[WIDTH][HEIGHT]) {
+	if (!level_uploaded(level)) {
+		return 0;
+	}
+	uint16_t address = slot_address(level) + HEADER_SIZE;
+	uint8_t square = 0;
+	for (uint8_t i = 0; i < LEVEL_SIZE; i++) {
+		uint8_t codes = read_byte(address + i);
+		for (uint8_t n = 0; n < 4; n++, square++) {
+			// The top row comes first
+			playing_field[square % WIDTH][HEIGHT - 1 - square / WIDTH] =
+					pgm_read_byte(&level_objects[codes >> 6]);
+			codes <<= 2;
+		}
+	}
+	return 1;
+}
+
+/*
+ * Looks through length bytes of the level, starting at byte offset, for
+ * the start square and diamonds.
+ */
+static void check_level(uint8_t offset, const uint8_t* data, uint8_t length) {
+	uint8_t square = offset * 4;
+	for (uint8_t i = 0; i < length; i++) {
+		uint8_t codes = data[i];
+		for (uint8_t n = 0; n < 4; n++, square++) {
+			uint8_t code = codes >> 6;
+			if (square == START_SQUARE) {
+				start_code = code;
+			}
+			if (code == LEVEL_CODE_DIAMOND) {
+				has_diamond = 1;
+			}
+			codes <<= 2;
+		}
+	}
+}
+
+/*
+ * Reads digits hex digits into value. Returns 0 if they aren't all hex
+ * digits.
+ */
+static uint8_t parse_hex(const char* digits, uint8_t count, uint16_t* value) {
+	*value = 0;
+	for (uint8_t i = 0; i < count; i++) {
+		char c = digits[i];
+		uint8_t digit;
+		if (c >= '0' && c <= '9') {
+			digit = c - '0';
+		} else if (c >= 'A' && c <= 'F') {
+			digit = c - 'A' + 10;
+		} else if (c >= 'a' && c <= 'f') {
+			digit = c - 'a' + 10;
+		} else {
+			return 0;
+		}
+		*value = (*value << 4) | digit;
+	}
+	return 1;
+}
+
+static void answer(uint8_t taken) {
+	serial_write(taken ? "+" : "-", 1);
+}
+
+/*
+ * Checks the line just received and keeps it for levels_update() if it is
+ * a frame, otherwise answers '-'.
+ */
+static void handle_line(void) {
+	uint16_t value;
+	if (frame != FRAME_NONE || line_length == 0 || line_length > LINE_SIZE) {
+		// The sender didn't wait for the answer, or the line is garbled
+		answer(0);
+		return;
+	}
+	switch (line[0]) {
+		case 'U':
+			if (line_length == 2 && parse_hex(&line[1], 1, &value)
+					&& value < LEVEL_SLOTS) {
+				frame_slot = value;
+				frame = FRAME_START;
+				return;
+			}
+			break;
+		case 'D': {
+			// The offset, 1 to MAX_FRAME_DATA bytes and the sum
+			uint8_t bytes = (line_length - 1) / 2;
+			if (uploading == LEVEL_NO_SLOT || (line_length - 1) % 2 != 0
+					|| bytes < 3 || bytes > MAX_FRAME_DATA + 2) {
+				break;
+			}
+			uint8_t sum = 0;
+			uint8_t i;
+			for (i = 0; i < bytes; i++) {
+				if (!parse_hex(&line[1 + 2 * i], 2, &value)) {
+					break;
+				}
+				sum += value;
+				if (i == 0) {
+					frame_offset = value;
+				} else if (i < bytes - 1) {
+					frame_data[i - 1] = value;
+				}
+			}
+			if (i == bytes && sum == 0) {
+				frame_length = bytes - 2;
+				frame = FRAME_DATA;
+				return;
+			}
+			break;
+		}
+		case 'E':
+			if (uploading != LEVEL_NO_SLOT && line_length == 5
+					&& parse_hex(&line[1], 4, &value)) {
+				frame_crc = value;
+				frame = FRAME_END;
+				return;
+			}
+			break;
+	}
+	answer(0);
+}
+
+uint8_t levels_receive(char c) {
+	if (!in_frame) {
+		if (c == ':') {
+			in_frame = 1;
+			line_length = 0;
+			return 1;
+		}
+		// Nothing else is taken while an upload is going
+		return uploading != LEVEL_NO_SLOT;
+	}
+	if (c == '\n') {
+		in_frame = 0;
+		handle_line();
+	} else if (line_length <= LINE_SIZE) {
+		// (A line that is too long is remembered as LINE_SIZE + 1)
+		if (line_length < LINE_SIZE) {
+			line[line_length] = c;
+		}
+		line_length++;
+	}
+	return 1;
+}
+
+uint8_t levels_update(void) {
+	uint8_t finished = LEVEL_NO_SLOT;
+	switch (frame) {
+		case FRAME_NONE:
+			return LEVEL_NO_SLOT;
+		case FRAME_START: {
+			uint8_t erased = 0xFF;
+			if (!eeprom_write(slot_address(frame_slot), &erased, 1)) {
+				return LEVEL_NO_SLOT;
+			}
+			valid &= ~(1 << frame_slot);
+			uploading = frame_slot;
+			received = 0;
+			crc = CRC_INIT;
+			last_offset = LEVEL_SIZE;
+			start_code = LEVEL_CODE_UNBREAKABLE;
+			has_diamond = 0;
+			answer(1);
+			break;
+		}
+		case FRAME_DATA:
+			if (frame_offset == last_offset
+					&& frame_offset + frame_length == received) {
+				// The answer to this frame was lost, so it was sent again
+				answer(1);
+			} else if (frame_offset != received
+					|| received + frame_length > LEVEL_SIZE) {
+				answer(0);
+			} else {
+				if (!eeprom_write(slot_address(uploading) + HEADER_SIZE
+						+ frame_offset, frame_data, frame_length)) {
+					// Answer once the EEPROM has caught up
+					return LEVEL_NO_SLOT;
+				}
+				crc = crc_block(crc, frame_data, frame_length);
+				check_level(frame_offset, frame_data, frame_length);
+				received += frame_length;
+				last_offset = frame_offset;
+				answer(1);
+			}
+			break;
+		case FRAME_END:
+			if (frame_crc != crc || (received != 0
+					&& (received != LEVEL_SIZE
+					|| start_code != LEVEL_CODE_EMPTY || !has_diamond))) {
+				uploading = LEVEL_NO_SLOT;
+				answer(0);
+				break;
+			}
+			if (received != 0) {
+				// The marker and CRC go last, once the level is written
+				uint8_t header[HEADER_SIZE] = {LEVEL_MARKER, crc & 0xFF,
+						crc >> 8};
+				if (!eeprom_write(slot_address(uploading), header,
+						HEADER_SIZE)) {
+					return LEVEL_NO_SLOT;
+				}
+				valid |= 1 << uploading;
+			}
+			finished = uploading;
+			uploading = LEVEL_NO_SLOT;
+			answer(1);
+			break;
+	}
+	frame = FRAME_NONE;
+	return finished;
+}
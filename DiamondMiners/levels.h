@@ -0,0 +1,86 @@
+/*
+ * levels.h
+ *
+ * Author: Matthew Chen
+ *
+ * Levels uploaded over the serial port into EEPROM, so the levels on a
+ * board can be changed without reprogramming it (tools/level_upload.c
+ * sends them). There is a slot for each level, and a level in its slot is
+ * played instead of the built in layout in game.c.
+ * A level only has 4 objects in it, so it is packed 2 bits a square
+ * (LEVEL_CODE_*), 4 squares a byte with the first in the top 2 bits. That
+ * is LEVEL_SIZE bytes rather than the 256 of the playing field. The
+ * squares go across each row from the left, starting with the top row
+ * (the way the layouts in game.c are written out).
+ *
+ * An upload is sent as lines of text (the serial input turns a '\r' into
+ * a '\n', so binary data wouldn't get through), each a frame of at most
+ * 15 characters and a '\n', with numbers in upper case hex:
+ *		:U<slot>					start uploading into slot (0 or 1)
+ *		:D<offset><data><sum>		1 to 4 bytes of the level starting at
+ *									offset (2 digits); sum makes the 8 bit
+ *									total of offset, data and sum 0
+ *		:E<crc>						finish, with the CRC16 of the whole
+ *									level (4 digits, see crc.h)
+ * The board answers every frame with '+' if it was taken or '-' if it
+ * wasn't (a garbled frame, or an :E whose CRC or size is wrong or whose
+ * level can't be played, which abandons the upload). The sender has to wait for the answer before
+ * sending the next frame, so there is never more than one frame in the
+ * 16 byte serial input buffer. The answer to a :D frame only comes once
+ * its data is in the EEPROM queue, which holds back the sender while the
+ * EEPROM (at 3.4ms a byte) catches up. A :D frame that is sent again
+ * because its answer was lost is answered but not written twice.
+ * An upload with no :D frames clears the slot, so the built in level is
+ * played again.
+ *
+ * In EEPROM each slot is a marker byte, the level's CRC16 and then the
+ * level itself. The marker and CRC are written after the level, so a slot
+ * whose upload was cut short doesn't check out and the built in level is
+ * played instead.
+ */
+
+#ifndef LEVELS_H_
+#define LEVELS_H_
+
+#include <stdint.h>
+#include "display.h"
+
+#define LEVEL_SLOTS		2
+#define LEVEL_SIZE		(WIDTH * HEIGHT / 4)
+#define LEVEL_NO_SLOT	0xFF
+
+// Objects in a packed level
+#define LEVEL_CODE_EMPTY		0
+#define LEVEL_CODE_BREAKABLE	1
+#define LEVEL_CODE_UNBREAKABLE	2
+#define LEVEL_CODE_DIAMOND		3
+
+/* Checks which slots hold a level. Call once at start up (with interrupts
+ * on).
+ */
+void init_levels(void);
+
+/* Returns 1 if an uploaded level will be played as level.
+ */
+uint8_t level_uploaded(uint8_t level);
+
+/* If an uploaded level is to be played as level, decodes it from EEPROM
+ * into playing_field (a square at a time, without reading it into RAM
+ * first) and returns 1. Otherwise returns 0 and leaves playing_field
+ * alone. Waits for any queued EEPROM writes to finish.
+ */
+uint8_t levels_load(uint8_t level, uint16_t playing_field[WIDTH][HEIGHT]);
+
+/* Takes a character from the serial port. Returns 1 if it was part of an
+ * upload (so shouldn't be handled as anything else), 0 if not. Once an
+ * upload has started every character is taken until it has finished.
+ */
+uint8_t levels_receive(char c);
+
+/* Writes the last frame received and answers it, once there is room in
+ * the EEPROM queue. Call regularly while uploads are taken. Returns the
+ * slot if an upload into it has just finished, otherwise LEVEL_NO_SLOT.
+ */
+uint8_t levels_update(void);
+
+#endif /* LEVELS_H_ */
@@ -0,0 +1,85 @@
+/*
+ * memory.c
+ *
+ * Author: Matthew Chen
+ *
+ * See memory.h.
+ */
+
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+
+#include "memory.h"
+#include "serialio.h"
+#include "terminalio.h"
+
+// Set by the linker: the start and end of .data and .bss, the end of the
+// static variables (.bss and .noinit) and the top of RAM
+extern uint8_t __data_start;
+extern uint8_t __data_end;
+extern uint8_t __bss_start;
+extern uint8_t __bss_end;
+extern uint8_t _end;
+extern uint8_t __stack;
+
+/*
+ * Fills the RAM between the static variables and the top of RAM with the
+ * canary value. This goes in .init1, which runs before the stack pointer
+ * is set up and r1 is cleared, so it has to be written in assembly and
+ * can't be called.
+ */
+void memory_paint(void) __attribute__((naked, used, section(".init1")));
+void memory_paint(void) {
+	__asm__ volatile (
+		"	ldi r30, lo8(_end)\n"
+		"	ldi r31, hi8(_end)\n"
+		"	ldi r24, %0\n"
+		"	ldi r25, hi8(__stack)\n"
+		"	rjmp 2f\n"
+		"1:	st Z+, r24\n"
+		"2:	cpi r30, lo8(__stack)\n"
+		"	cpc r31, r25\n"
+		"	brlo 1b\n"
+		"	breq 1b\n"
+		:: "M" (MEMORY_CANARY)
+	);
+}
+
+uint16_t memory_static_size(void) {
+	return (uint16_t)&_end - (uint16_t)&__data_start;
+}
+
+uint16_t memory_never_used(void) {
+	// The stack hasn't got past the first byte that isn't the canary
+	const uint8_t* p = &_end;
+	const uint8_t* top = (const uint8_t*)SP;
+	while (p <= top && *p == MEMORY_CANARY) {
+		p++;
+	}
+	return p - &_end;
+}
+
+uint16_t memory_stack_high_water(void) {
+	return ((uint16_t)&__stack - (uint16_t)&_end + 1) - memory_never_used();
+}
+
+uint16_t memory_free_now(void) {
+	return SP - (uint16_t)&_end;
+}
+
+void memory_report(void) {
+	serial_write_P(PSTR("Static "));
+	serial_write_uint(memory_static_size());
+	serial_write_P(PSTR(" (data "));
+	serial_write_uint((uint16_t)&__data_end - (uint16_t)&__data_start);
+	serial_write_P(PSTR(" bss "));
+	serial_write_uint((uint16_t)&__bss_end - (uint16_t)&__bss_start);
+	serial_write_P(PSTR(") stack max "));
+	serial_write_uint(memory_stack_high_water());
+	serial_write_P(PSTR(" free now "));
+	serial_write_uint(memory_free_now());
+	serial_write_P(PSTR(" never used "));
+	serial_write_uint(memory_never_used());
+	clear_to_end_of_line();
+	serial_write_P(PSTR("\r\n"));
+}
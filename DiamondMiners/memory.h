@@ -0,0 +1,47 @@
+/*
+ * memory.h
+ *
+ * Author: Matthew Chen
+ *
+ * Keeps an eye on how much of the 2KB of RAM is in use.
+ * At reset (before the stack is set up) every byte from the end of the
+ * static variables to the top of RAM is filled with MEMORY_CANARY. The
+ * stack grows down from the top of RAM, so the canary bytes left at the
+ * bottom of that region show how deep the stack has ever been.
+ * The sizes of .data and .bss come from the symbols the linker sets, so
+ * they are always those of the running program. tools/ramcheck.py gives
+ * the static RAM of each module from a build's map file, and checks that
+ * the worst case stack fits in the RAM left over.
+ */
+
+#ifndef MEMORY_H_
+#define MEMORY_H_
+
+#include <stdint.h>
+
+#define MEMORY_CANARY 0xC5
+
+/* Returns the number of bytes of static variables (.data and .bss).
+ */
+uint16_t memory_static_size(void);
+
+/* Returns the most bytes of stack that have been used since reset.
+ */
+uint16_t memory_stack_high_water(void);
+
+/* Returns the number of bytes between the static variables and the stack
+ * right now.
+ */
+uint16_t memory_free_now(void);
+
+/* Returns the number of bytes that have never been used by the stack -
+ * the least free RAM there has been.
+ */
+uint16_t memory_never_used(void);
+
+/* Prints the figures above (and the static size split into .data and
+ * .bss) on the terminal from the current cursor position.
+ */
+void memory_report(void);
+
+#endif /* MEMORY_H_ */
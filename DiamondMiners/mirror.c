@@ -0,0 +1,175 @@
+/*
+ * mirror.c
+ *
+ * Author: Matthew Chen
+ *
+ * See mirror.h.
+ */
+
+#include <string.h>
+
+#include "mirror.h"
+#include "ledmatrix.h"
+#include "serialio.h"
+#include "terminalio.h"
+
+// Most bytes a cursor move (ESC [ yy ; xx H) or a colour (ESC [ 4n m) takes
+#define CURSOR_MOVE_COST 8
+#define COLOUR_COST 5
+// Bytes needed to go back to normal colours at the end of a flush
+#define RESET_COST 4
+// Unchanged cells between two changed ones are redrawn (rather than moving
+// the cursor past them) if there are no more than this many
+#define MERGE_GAP 2
+
+// The colour of each LED and which ones need to be sent (bit x of
+// changed[y] is set if (x, y) has changed)
+static PixelColour colours[MATRIX_NUM_COLUMNS][MATRIX_NUM_ROWS];
+static uint16_t changed[MATRIX_NUM_ROWS];
+static uint8_t enabled = 1;
+
+/*
+ * Returns the background colour used on the terminal for an LED colour.
+ */
+static DisplayParameter terminal_colour(PixelColour colour) {
+	switch (colour) {
+		case COLOUR_BLACK:
+			return BG_BLACK;
+		case COLOUR_RED:
+			return BG_RED;
+		case COLOUR_LIGHT_RED:
+			return BG_MAGENTA;
+		case COLOUR_GREEN:
+			return BG_GREEN;
+		case COLOUR_LIGHT_GREEN:
+			return BG_CYAN;
+		case COLOUR_YELLOW:
+			return BG_YELLOW;
+		case COLOUR_LIGHT_YELLOW:
+			return BG_WHITE;
+		case COLOUR_ORANGE:
+		case COLOUR_LIGHT_ORANGE:
+			return BG_BLUE;
+	}
+	// Anything else - go by which of the red and green LEDs are on
+	if ((colour & 0x0F) == 0) {
+		return BG_GREEN;
+	} else if ((colour & 0xF0) == 0) {
+		return BG_RED;
+	}
+	return BG_YELLOW;
+}
+
+void mirror_pixel(uint8_t x, uint8_t y, PixelColour colour) {
+	if (x >= MATRIX_NUM_COLUMNS || y >= MATRIX_NUM_ROWS) {
+		return;
+	}
+	if (colours[x][y] != colour) {
+		colours[x][y] = colour;
+		changed[y] |= (1U << x);
+	}
+}
+
+void mirror_redraw_all(void) {
+	for (uint8_t y = 0; y < MATRIX_NUM_ROWS; y++) {
+		changed[y] = 0xFFFF;
+	}
+}
+
+void mirror_enable(uint8_t enable) {
+	enabled = enable;
+	if (enabled) {
+		mirror_redraw_all();
+	}
+}
+
+/*
+ * Sends the changed cells of row y, adding the bytes sent to *sent and
+ * keeping track of the colour the terminal is currently using in
+ * *current. Returns 0 if it ran out of budget before finishing the row.
+ */
+static uint8_t flush_row(uint8_t y, uint16_t* sent, uint16_t max_bytes,
+		DisplayParameter* current) {
+	char spaces[2 * MATRIX_NUM_COLUMNS];
+	memset(spaces, ' ', sizeof(spaces));
+	uint8_t x = 0;
+	while (x < MATRIX_NUM_COLUMNS && (changed[y] >> x)) {
+		if (!(changed[y] & (1U << x))) {
+			x++;
+			continue;
+		}
+		// Find the end of this run of changed cells
+		uint8_t end = x + 1;
+		for (uint8_t i = end; i < MATRIX_NUM_COLUMNS; i++) {
+			if (changed[y] & (1U << i)) {
+				if (i - end > MERGE_GAP) {
+					break;
+				}
+				end = i + 1;
+			}
+		}
+		if (*sent + CURSOR_MOVE_COST + COLOUR_COST + 2 > max_bytes) {
+			return 0;
+		}
+		move_terminal_cursor(MIRROR_LEFT + 2 * x, MIRROR_TOP + (MATRIX_NUM_ROWS - 1 - y));
+		*sent += CURSOR_MOVE_COST;
+
+		// Send the run as spans of the same colour
+		while (x < end) {
+			DisplayParameter colour = terminal_colour(colours[x][y]);
+			uint8_t span = 1;
+			while (x + span < end && terminal_colour(colours[x + span][y]) == colour) {
+				span++;
+			}
+			uint8_t cost = (colour != *current) ? COLOUR_COST : 0;
+			if (*sent + cost + 2 > max_bytes) {
+				return 0;
+			}
+			if (*sent + cost + 2 * span > max_bytes) {
+				span = (max_bytes - *sent - cost) / 2;
+			}
+			if (colour != *current) {
+				set_display_attribute(colour);
+				*current = colour;
+				*sent += COLOUR_COST;
+			}
+			serial_write(spaces, 2 * span);
+			*sent += 2 * span;
+			changed[y] &= ~((0xFFFFU >> (16 - span)) << x);
+			x += span;
+		}
+	}
+	return 1;
+}
+
+uint16_t mirror_flush(uint16_t max_bytes) {
+	if (!enabled) {
+		return 0;
+	}
+	// Back off while the UART is behind
+	uint16_t pending = serial_output_pending();
+	if (pending > MIRROR_BACKLOG_LIMIT) {
+		return 0;
+	}
+	if (max_bytes > SERIAL_OUTPUT_BUFFER_SIZE - pending) {
+		max_bytes = SERIAL_OUTPUT_BUFFER_SIZE - pending;
+	}
+	if (max_bytes <= RESET_COST) {
+		return 0;
+	}
+	max_bytes -= RESET_COST;
+
+	uint16_t sent = 0;
+	DisplayParameter current = TERM_RESET;
+	// Row 7 is at the top of the matrix
+	for (int8_t y = MATRIX_NUM_ROWS - 1; y >= 0; y--) {
+		if (changed[y] && !flush_row(y, &sent, max_bytes, &current)) {
+			break;
+		}
+	}
+	if (current != TERM_RESET) {
+		normal_display_mode();
+		sent += RESET_COST;
+	}
+	return sent;
+}
@@ -0,0 +1,54 @@
+/*
+ * mirror.h
+ *
+ * Author: Matthew Chen
+ *
+ * A copy of the LED matrix drawn on the serial terminal with ANSI
+ * background colours (two spaces per LED), so the board can be watched
+ * remotely.
+ * ledmatrix.c passes every pixel it sends to the matrix to mirror_pixel(),
+ * which just records the colour and marks the cell as changed. Once per
+ * frame mirror_flush() sends the changed cells: consecutive changed cells
+ * along a row are drawn after a single cursor move, and neighbouring cells
+ * of the same colour share one colour escape sequence. If the serial
+ * output buffer is already more than MIRROR_BACKLOG_LIMIT full the flush is
+ * skipped - changes keep being merged in RAM and are sent once the UART
+ * has caught up, so the mirror lags behind rather than slowing the game.
+ * (The ledmatrix_shift_display_* commands are not mirrored.)
+ */
+
+#ifndef MIRROR_H_
+#define MIRROR_H_
+
+#include <stdint.h>
+#include "pixel_colour.h"
+
+// Terminal position of the top left LED (column, row)
+#define MIRROR_LEFT	40
+#define MIRROR_TOP	3
+
+// Default number of bytes a flush may send
+#define MIRROR_BYTES_PER_FRAME 48
+// Skip flushing while more than this many bytes are waiting to be sent
+#define MIRROR_BACKLOG_LIMIT (SERIAL_OUTPUT_BUFFER_SIZE / 2)
+
+/* Record that the LED at (x, y) has been set to colour.
+ * Called by ledmatrix.c.
+ */
+void mirror_pixel(uint8_t x, uint8_t y, PixelColour colour);
+
+/* Mark every cell as changed, e.g. after the terminal has been cleared.
+ */
+void mirror_redraw_all(void);
+
+/* Turn the mirror on (non-zero) or off. When it is turned on the whole
+ * board is redrawn.
+ */
+void mirror_enable(uint8_t enable);
+
+/* Send changed cells to the terminal using no more than max_bytes bytes.
+ * Returns the number of bytes sent.
+ */
+uint16_t mirror_flush(uint16_t max_bytes);
+
+#endif /* MIRROR_H_ */
@@ -0,0 +1,152 @@
+/*
+ * persist.c
+ *
+ * Author: Matthew Chen
+ *
+ * See persist.h. The log is PERSIST_SLOTS slots of 8 bytes:
+ *		sequence number, key, data (PERSIST_DATA_SIZE bytes), CRC16
+ * The CRC (see crc.h) is of the first 6 bytes, so erased (0xFF) and half
+ * written slots are ignored. Slots are written in order, each with the
+ * sequence number after the last, so the newest slot is the one the next
+ * slot doesn't follow on from.
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "persist.h"
+#include "eeprom.h"
+#include "crc.h"
+
+#define SLOT_SIZE		8
+#define PERSIST_SLOTS	(EEPROM_PERSIST_SIZE / SLOT_SIZE)
+#define NO_SLOT			0xFF
+
+#if (PERSIST_SLOTS & (PERSIST_SLOTS - 1)) != 0 || PERSIST_SLOTS > 32
+#error The persist log must be a power of 2 slots, no more than 32
+#endif
+
+typedef struct {
+	uint8_t sequence;
+	uint8_t key;
+	uint8_t data[PERSIST_DATA_SIZE];
+	uint16_t crc;
+} Slot;
+
+// The newest data for each record and the slot it is in
+static uint8_t records[PERSIST_NUM_KEYS][PERSIST_DATA_SIZE];
+static uint8_t record_slot[PERSIST_NUM_KEYS];
+// Records that have changed but haven't been queued yet (one bit per key)
+static uint8_t dirty;
+// The newest slot and its sequence number
+static uint8_t newest;
+static uint8_t sequence;
+
+static uint16_t slot_crc(const Slot* slot) {
+	return crc_block(CRC_INIT, slot, offsetof(Slot, crc));
+}
+
+void init_persist(void) {
+	Slot slot;
+	uint32_t valid = 0;
+	uint8_t sequences[PERSIST_SLOTS];
+	uint8_t keys[PERSIST_SLOTS];
+	for (uint8_t i = 0; i < PERSIST_SLOTS; i++) {
+		eeprom_read(EEPROM_PERSIST_START + i * SLOT_SIZE, &slot, SLOT_SIZE);
+		if (slot.key < PERSIST_NUM_KEYS && slot.crc == slot_crc(&slot)) {
+			valid |= 1UL << i;
+			sequences[i] = slot.sequence;
+			keys[i] = slot.key;
+		}
+	}
+	// The newest slot is one that the next slot doesn't follow on from. If
+	// a damaged slot makes more than one look like that, take the one
+	// with the latest sequence number.
+	uint8_t found = 0;
+	newest = PERSIST_SLOTS - 1;
+	sequence = 0xFF;
+	for (uint8_t i = 0; i < PERSIST_SLOTS; i++) {
+		uint8_t next = (i + 1) & (PERSIST_SLOTS - 1);
+		if (!(valid & (1UL << i))) {
+			continue;
+		}
+		if ((valid & (1UL << next))
+				&& sequences[next] == (uint8_t)(sequences[i] + 1)) {
+			continue;
+		}
+		if (!found || (int8_t)(sequences[i] - sequence) > 0) {
+			newest = i;
+			sequence = sequences[i];
+			found = 1;
+		}
+	}
+	// Go through the slots oldest first so each record ends up with its
+	// newest copy
+	memset(records, 0, sizeof(records));
+	memset(record_slot, NO_SLOT, sizeof(record_slot));
+	dirty = 0;
+	for (uint8_t n = 1; n <= PERSIST_SLOTS; n++) {
+		uint8_t i = (newest + n) & (PERSIST_SLOTS - 1);
+		if (valid & (1UL << i)) {
+			record_slot[keys[i]] = i;
+		}
+	}
+	for (uint8_t key = 0; key < PERSIST_NUM_KEYS; key++) {
+		if (record_slot[key] != NO_SLOT) {
+			eeprom_read(EEPROM_PERSIST_START + record_slot[key] * SLOT_SIZE,
+					&slot, SLOT_SIZE);
+			memcpy(records[key], slot.data, PERSIST_DATA_SIZE);
+		}
+	}
+}
+
+void persist_get(uint8_t key, void* data) {
+	memcpy(data, records[key], PERSIST_DATA_SIZE);
+}
+
+void persist_set(uint8_t key, const void* data) {
+	if (memcmp(records[key], data, PERSIST_DATA_SIZE) == 0) {
+		return;
+	}
+	memcpy(records[key], data, PERSIST_DATA_SIZE);
+	dirty |= 1 << key;
+	persist_update();
+}
+
+/*
+ * Queues the record for key to be written to the slot after the newest.
+ */
+static void write_slot(uint8_t key) {
+	Slot slot;
+	uint8_t i = (newest + 1) & (PERSIST_SLOTS - 1);
+	slot.sequence = sequence + 1;
+	slot.key = key;
+	memcpy(slot.data, records[key], PERSIST_DATA_SIZE);
+	slot.crc = slot_crc(&slot);
+	eeprom_write(EEPROM_PERSIST_START + i * SLOT_SIZE, &slot, SLOT_SIZE);
+	newest = i;
+	sequence = slot.sequence;
+	record_slot[key] = i;
+}
+
+void persist_update(void) {
+	while (dirty && eeprom_write_space() >= SLOT_SIZE) {
+		// If the slot about to be written over holds the newest copy of
+		// a record, copy that record forward first
+		uint8_t next = (newest + 1) & (PERSIST_SLOTS - 1);
+		uint8_t key;
+		for (key = 0; key < PERSIST_NUM_KEYS; key++) {
+			if (record_slot[key] == next && !(dirty & (1 << key))) {
+				break;
+			}
+		}
+		if (key == PERSIST_NUM_KEYS) {
+			// Nothing to keep, so write a changed record
+			for (key = 0; !(dirty & (1 << key)); key++) {
+				;
+			}
+			dirty &= ~(1 << key);
+		}
+		write_slot(key);
+	}
+}
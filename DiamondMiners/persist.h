@@ -0,0 +1,57 @@
+/*
+ * persist.h
+ *
+ * Author: Matthew Chen
+ *
+ * Small records kept in EEPROM across power cycles (the settings and the
+ * best scores). Each record is a key and PERSIST_DATA_SIZE bytes of data.
+ * Saving a record adds a new copy to a circular log in EEPROM rather than
+ * writing over the old one, so the writes are spread over the whole log
+ * and no byte wears out much faster than the others. When the log wraps
+ * around, any record whose only copy would be written over is copied
+ * forward first. At start up the log is read once to find the newest
+ * copy of each record, and after that every record is kept in RAM (with
+ * the slot of its newest copy), so getting a record never touches the
+ * EEPROM. Writes go through eeprom.c's queue and never wait.
+ */
+
+#ifndef PERSIST_H_
+#define PERSIST_H_
+
+#include <stdint.h>
+
+// Record keys
+#define PERSIST_SETTINGS	0	// PERSIST_FLAG_* bits, then the level
+#define PERSIST_BEST_STEPS	1	// fewest steps to win each level (2 x 16 bit)
+#define PERSIST_HIGH_SCORE	2	// most diamonds found in a game on each
+								// level (2 x 16 bit)
+#define PERSIST_NUM_KEYS	3
+
+#define PERSIST_DATA_SIZE	4
+
+// Settings flags
+#define PERSIST_FLAG_MUTED	0x01
+#define PERSIST_FLAG_VISION	0x02
+
+/* Reads the log from EEPROM. Call once at start up (with interrupts on)
+ * before using the other functions.
+ */
+void init_persist(void);
+
+/* Copies the record's PERSIST_DATA_SIZE bytes into data (all 0 if it has
+ * never been saved).
+ */
+void persist_get(uint8_t key, void* data);
+
+/* Saves PERSIST_DATA_SIZE bytes of data as the record (if it has
+ * changed). The record is written as soon as there is room in the EEPROM
+ * queue.
+ */
+void persist_set(uint8_t key, const void* data);
+
+/* Writes any saved records still waiting for room in the EEPROM queue.
+ * Call regularly.
+ */
+void persist_update(void);
+
+#endif /* PERSIST_H_ */
@@ -0,0 +1,145 @@
+/*
+ * profile.c
+ *
+ * Author: Matthew Chen
+ *
+ * See profile.h.
+ */
+
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
+
+#include "profile.h"
+#include "serialio.h"
+#include "terminalio.h"
+
+#ifdef PROFILE
+
+typedef struct {
+	uint16_t calls;
+	uint32_t total;		// cycles
+	uint32_t max;		// cycles
+} ProfileEntry;
+
+static ProfileEntry table[PROFILE_NUM_FUNCTIONS];
+// Upper 16 bits of the cycle counter
+static volatile uint16_t overflows;
+// Cycles taken by entering and leaving a profiled function with nothing
+// in it (taken off each measurement)
+static uint16_t overhead;
+
+static const char move_player_name[] PROGMEM = "move_player";
+static const char dfs_name[] PROGMEM = "discoverable_dfs";
+static const char vision_name[] PROGMEM = "field_of_vision";
+static const char blow_bomb_name[] PROGMEM = "blow_bomb";
+static const char square_name[] PROGMEM = "update_square";
+static const char pixel_name[] PROGMEM = "ledmatrix_pixel";
+static const char put_char_name[] PROGMEM = "uart_put_char";
+static const char serial_write_name[] PROGMEM = "serial_write";
+static const char* const names[PROFILE_NUM_FUNCTIONS] PROGMEM = {
+	move_player_name, dfs_name, vision_name, blow_bomb_name, square_name,
+	pixel_name, put_char_name, serial_write_name
+};
+
+/*
+ * Returns the 32 bit cycle count.
+ */
+static uint32_t cycles(void) {
+	uint8_t interrupts_on = bit_is_set(SREG, SREG_I);
+	cli();
+	uint16_t low = TCNT1;
+	uint16_t high = overflows;
+	// The counter may have wrapped without the interrupt having run yet
+	if ((TIFR1 & (1<<TOV1)) && low < 0x8000) {
+		high++;
+	}
+	if (interrupts_on) {
+		sei();
+	}
+	return ((uint32_t)high << 16) | low;
+}
+
+void init_profile(void) {
+	// Normal mode, counting every clock cycle, interrupt on overflow.
+	// (timer1.c leaves the timer alone in the Profile build.)
+	TCCR1A = 0;
+	TCCR1B = (1<<CS10);
+	TIFR1 = (1<<TOV1);
+	TIMSK1 |= (1<<TOIE1);
+
+	// Time a profiled block with nothing in it
+	overhead = 0;
+	{
+		PROFILE_FUNCTION(0);
+	}
+	overhead = table[0].max;
+	memset(table, 0, sizeof(table));
+}
+
+ProfileSample profile_enter(uint8_t id) {
+	ProfileSample sample;
+	sample.id = id;
+	sample.start = cycles();
+	return sample;
+}
+
+void profile_exit(ProfileSample* sample) {
+	uint32_t elapsed = cycles() - sample->start;
+	elapsed = elapsed > overhead ? elapsed - overhead : 0;
+	ProfileEntry* entry = &table[sample->id];
+	// uart_put_char() is also called from the serial receive interrupt
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if (entry->calls < UINT16_MAX) {
+			entry->calls++;
+		}
+		entry->total = (entry->total + elapsed < entry->total) ?
+				UINT32_MAX : entry->total + elapsed;
+		if (elapsed > entry->max) {
+			entry->max = elapsed;
+		}
+	}
+}
+
+void profile_report(void) {
+	serial_write_P(PSTR("Function: calls total max avg (cycles)"));
+	clear_to_end_of_line();
+	serial_write_P(PSTR("\r\n"));
+	for (uint8_t i = 0; i < PROFILE_NUM_FUNCTIONS; i++) {
+		ProfileEntry entry;
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+			entry = table[i];
+			memset(&table[i], 0, sizeof(table[i]));
+		}
+		serial_write_P((const char*)pgm_read_word(&names[i]));
+		serial_write_P(PSTR(": "));
+		serial_write_uint(entry.calls);
+		serial_write_P(PSTR(" "));
+		serial_write_ulong(entry.total);
+		serial_write_P(PSTR(" "));
+		serial_write_ulong(entry.max);
+		serial_write_P(PSTR(" "));
+		serial_write_ulong(entry.calls ? entry.total / entry.calls : 0);
+		clear_to_end_of_line();
+		serial_write_P(PSTR("\r\n"));
+	}
+}
+
+ISR(TIMER1_OVF_vect) {
+	overflows++;
+}
+
+#else
+
+void init_profile(void) {
+}
+
+void profile_report(void) {
+	serial_write_P(PSTR("Not a profiling build"));
+	clear_to_end_of_line();
+	serial_write_P(PSTR("\r\n"));
+}
+
+#endif /* PROFILE */
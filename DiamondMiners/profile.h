@@ -0,0 +1,69 @@
+/*
+ * profile.h
+ *
+ * Author: Matthew Chen
+ *
+ * Per function cycle counts for finding where the frame time goes on the
+ * real board. Only the Profile build configuration (which defines
+ * PROFILE) collects anything - in other builds PROFILE_FUNCTION() is
+ * empty and the functions below do nothing.
+ * A profiled function starts with PROFILE_FUNCTION(id). That samples a
+ * cycle counter on entry, and (using the cleanup attribute, so every
+ * return is covered) again on exit, adding the cycles to the function's
+ * call count, total and maximum. Times include any functions it calls
+ * and any interrupts that happen while it runs.
+ * The cycle counter is timer 1 counting every clock cycle, extended to 32
+ * bits by its overflow interrupt, so the buzzer is silent in the Profile
+ * build. A function called both from the main program and from an
+ * interrupt handler (like uart_put_char(), which echoes input) can be
+ * profiled, but the interrupt's calls are also counted in the time of
+ * whatever main program function they interrupted.
+ */
+
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+#include <stdint.h>
+
+// Profiled functions
+#define PROFILE_MOVE_PLAYER				0
+#define PROFILE_DISCOVERABLE_DFS		1
+#define PROFILE_FIELD_OF_VISION			2	// maintain_field_of_vision()
+#define PROFILE_BLOW_BOMB				3
+#define PROFILE_UPDATE_SQUARE_COLOUR	4
+#define PROFILE_LEDMATRIX_UPDATE_PIXEL	5
+#define PROFILE_UART_PUT_CHAR			6
+#define PROFILE_SERIAL_WRITE			7
+#define PROFILE_NUM_FUNCTIONS			8
+
+#ifdef PROFILE
+
+typedef struct {
+	uint8_t id;
+	uint32_t start;
+} ProfileSample;
+
+ProfileSample profile_enter(uint8_t id);
+void profile_exit(ProfileSample* sample);
+
+#define PROFILE_FUNCTION(id) \
+	ProfileSample profile_sample __attribute__((cleanup(profile_exit))) = \
+			profile_enter(id)
+
+#else
+
+#define PROFILE_FUNCTION(id)
+
+#endif
+
+/* Starts the cycle counter (after init_timer1()).
+ */
+void init_profile(void);
+
+/* Prints the calls, total cycles, maximum cycles and average cycles of
+ * every profiled function on the terminal from the current cursor
+ * position, then resets them all.
+ */
+void profile_report(void);
+
+#endif /* PROFILE_H_ */
@@ -11,6 +11,7 @@
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include <avr/pgmspace.h>
+#include <avr/sleep.h>
 #include <stdio.h>
 
 #include "game.h"
@@ -18,33 +19,102 @@
 #include "ledmatrix.h"
 #include "buttons.h"
 #include "serialio.h"
+#include "adc.h"
+#include "joystick.h"
+#include "input.h"
+#include "input_log.h"
 #include "terminalio.h"
 #include "timer0.h"
 #include "timer1.h"
+#include "timer2.h"
+#include "sound.h"
+#include "status.h"
+#include "mirror.h"
+#include "telemetry.h"
+#include "histogram.h"
+#include "latency.h"
+#include "memory.h"
+#include "profile.h"
+#include "isr_trace.h"
+#include "flight.h"
+#include "eeprom.h"
+#include "persist.h"
+#include "snapshot.h"
+#include "levels.h"
 
 #define F_CPU 8000000L
 #define NO_BOMB UINT32_MAX
-#define NO_JOYSTICK_ACTION 512
-#define JOYSTICK_LOW 300
-#define JOYSTICK_HIGH 750
+// Terminal baud rate. serialio.c picks the closest rate the UART can do
+// (e.g. 38400, 250000 or 500000 for faster terminal updates).
+#define SERIAL_BAUD_RATE 19200
 #include <util/delay.h>
 
 // Function prototypes - these are defined below (after main()) in the order
 // given here
 void initialise_hardware(void);
 void start_screen(void);
+void start_screen_step(void);
 void new_game(void);
 void play_game(void);
+void run_game_ticks(void);
+void play_game_tick(void);
+void pause_game(void);
+void pause_step(void);
+void end_game(void);
 void handle_game_over(void);
+void handle_game_over_step(void);
+void render(void);
+void background_tasks(void);
+void wait_for_interrupt(void);
 void updateInfo(uint8_t cheatMode);
+void show_diamond_distance(void);
+void show_danger(void);
+void leds_off(void);
 void setUpPins();
 void nextLevel();
-uint16_t joystickDirX();
-uint16_t joystickDirY();
+void handle_command(char command);
+void load_settings(void);
+void save_settings(void);
+void save_scores(void);
+void show_scores(void);
+void clear_scores(uint8_t level);
+uint8_t resume_game(void);
 // Global variables
 uint16_t diamondCount = 0; // Count of how many diamonds
-uint16_t diamondDistance = -1; // Distance to nearest diamond
+uint16_t diamondDistance = -1; // Distance to nearest diamond shown on A7 (-1 if none)
+uint8_t danger = 0; // 1 if A5 is showing that the player is next to a bomb
 uint8_t level = 0;
+// How long the work done each time around the main loop and each move
+// take (see the 'h' command)
+Histogram loop_histogram;
+Histogram move_histogram;
+uint16_t loop_start_time; // get_fine_time() at the start of the current loop
+
+// The screens main() can be showing. Each has a function that shows it
+// and a step function that main() runs each time around its loop.
+#define SCREEN_START		0	// start_screen()
+#define SCREEN_PLAYING		1	// play_game()
+#define SCREEN_PAUSED		2	// pause_game()
+#define SCREEN_GAME_OVER	3	// handle_game_over()
+uint8_t screen;
+
+// The game is played a tick (GAME_TICK_MS) at a time. After a stall it
+// catches up, but by no more than this many ticks at once.
+#define MAX_CATCH_UP_TICKS 10
+// No move waiting to be drawn
+#define NO_MOVE_SOURCE 0xFF
+
+// The game being played (kept from one play_game_tick() to the next). Its
+// timers go by game_time, which only moves on when a tick is played.
+uint32_t game_time; // milliseconds of game played
+uint16_t ticks_run; // get_game_ticks() up to which the game has been played
+uint8_t game_number; // bumped each time play_game() starts a game
+uint8_t cheatMode; // 1 if cheat mode is enable else 0.
+uint8_t firstLoop; // Whether it is the first tick of the game.
+uint32_t last_flash_time, bomb_time;
+uint16_t bomb_flash_interval;
+uint8_t move_source = NO_MOVE_SOURCE; // input source of a move not drawn yet
+uint32_t game_over_time; // when the game over screen was shown
 
 /////////////////////////////// main //////////////////////////////////
 int main(void) {
@@ -52,317 +122,626 @@ int main(void) {
 	// interrupts.
 	initialise_hardware();
 	
-	// Show the splash screen message. Returns when display is complete
-	start_screen();
+	// Carry on with the game that was being played when the power went
+	// off, if there was one. Otherwise show the splash screen message.
+	if (resume_game()) {
+		play_game();
+	} else {
+		start_screen();
+	}
 	
-	// Loop forever,
+	// Loop forever. Each time around, run a step of whichever screen is
+	// showing (a step never waits for anything, it just handles what has
+	// happened since the last one - while playing, that is the game ticks
+	// that are due), draw what has changed on the LED matrix, do the work
+	// that goes on whatever the screen, then sleep until the next
+	// interrupt.
 	while(1) {
-		new_game();
-		play_game();
-		if (is_game_won()) {
-			nextLevel();
-		} else {
-			handle_game_over();
+		loop_start_time = get_fine_time();
+		switch (screen) {
+			case SCREEN_START:
+				start_screen_step();
+				break;
+			case SCREEN_PLAYING:
+				run_game_ticks();
+				break;
+			case SCREEN_PAUSED:
+				pause_step();
+				break;
+			case SCREEN_GAME_OVER:
+				handle_game_over_step();
+				break;
+		}
+		render();
+		background_tasks();
+		
+		// Time the work done this time around (not the sleep)
+		uint16_t loop_length = get_fine_time() - loop_start_time;
+		histogram_add(&loop_histogram, loop_length);
+		if (loop_length > FLIGHT_SLOW_LOOP_US / FINE_TIME_US) {
+			uint16_t ms = loop_length / (1000 / FINE_TIME_US);
+			flight_record(FLIGHT_SLOW_LOOP, ms > UINT8_MAX ? UINT8_MAX : ms);
 		}
+		wait_for_interrupt();
 	}
 }
 
 void initialise_hardware(void) {
 	ledmatrix_setup();
 	init_button_interrupts();
-	// Setup serial port for 19200 baud communication with no echo
+	// Setup serial port for SERIAL_BAUD_RATE baud communication with no echo
 	// of incoming characters
-	init_serial_stdio(19200,0);
+	init_serial_stdio(SERIAL_BAUD_RATE,0);
 	
 	setUpPins();
 	
+	init_adc();
+	init_sound();
 	init_timer0();
 	init_timer1();
+	init_timer2();
+	init_profile();
+	init_isr_trace();
+	init_eeprom();
 	// Turn on global interrupts
 	sei();
 	
-	 
+	// The joystick needs the ADC (and so interrupts) running to find its centre
+	joystick_calibrate();
+	
+	// Reading the saved settings and scores waits for the EEPROM, which
+	// needs interrupts on
+	init_persist();
+	load_settings();
+	init_levels();
 }
 
+/*
+ * Shows the start screen. start_screen_step() waits on it for a new game
+ * to be started.
+ */
 void start_screen(void) {
 	// Clear terminal screen and output a message
 	clear_terminal();
+	mirror_redraw_all();
 	move_terminal_cursor(10,10);
-	printf_P(PSTR("Diamond Miners"));
+	serial_write_P(PSTR("Diamond Miners"));
 	move_terminal_cursor(10,12);
-	printf_P(PSTR("CSSE2010/7201 project by Matthew Chen 46387110"));
+	serial_write_P(PSTR("CSSE2010/7201 project by Matthew Chen 46387110"));
+	show_scores();
 	
 	// Output the static start screen and wait for a push button 
 	// to be pushed or a serial input of 's'
 	start_display();
-	
-	// Wait until a button is pressed, or 's' is pressed on the terminal
-	while(1) {
-		// First check for if a 's' is pressed
-		// There are two steps to this
-		// 1) collect any serial input (if available)
-		// 2) check if the input is equal to the character 's'
-		char serial_input = -1;
-		if (serial_input_available()) {
-			serial_input = fgetc(stdin);
-		}
-		// If the serial input is 's', then exit the start screen
-		if (serial_input == 's' || serial_input == 'S') {
-			break;
-		}
-		// Next check for any button presses
-		int8_t btn = button_pushed();
-		if (btn != NO_BUTTON_PUSHED) {
-			break;
+	screen = SCREEN_START;
+}
+
+/*
+ * Starts a new game if a button is pressed, or 's' is pressed on the
+ * terminal. Levels can be uploaded over the serial port while the start
+ * screen is showing.
+ */
+void start_screen_step(void) {
+	// First check for if a 's' is pressed
+	// There are two steps to this
+	// 1) collect any serial input (if available) - all of it, so an
+	//    upload keeps up with the serial port
+	// 2) check if the input is equal to the character 's'
+	char serial_input = -1;
+	while (serial_input_available() && serial_input != 's'
+			&& serial_input != 'S') {
+		serial_input = fgetc(stdin);
+		// Characters that are part of a level upload are handled by
+		// levels.c
+		if (levels_receive(serial_input)) {
+			serial_input = -1;
 		}
 	}
+	// If the serial input is 's', or a button has been pushed, then
+	// leave the start screen
+	if (serial_input == 's' || serial_input == 'S'
+			|| button_pushed() != NO_BUTTON_PUSHED) {
+		new_game();
+		play_game();
+		return;
+	}
+	// Write the upload to EEPROM. A new level's scores start again.
+	uint8_t uploaded = levels_update();
+	if (uploaded != LEVEL_NO_SLOT) {
+		clear_scores(uploaded);
+		show_scores();
+	}
 }
 
 void new_game(void) {
 	// Clear the serial terminal
 	clear_terminal();
+	mirror_redraw_all();
+	status_init();
+	
+	// Start recording the game's input (or replaying it, which can change
+	// the level)
+	level = input_log_start(level);
 	
 	// Initialise the game and display
 	initialise_game(level);
+	diamondCount = 0;
+	snapshot_save_now(level, diamondCount);
+	
+	// Clear a button push, serial input or joystick move if any are waiting
+	input_clear();
 	
-	// Clear a button push or serial input if any are waiting
-	// (The cast to void means the return value is ignored.)
-	(void)button_pushed();
-	clear_serial_input_buffer();
+	// Turn field of vision back on if it was on last time. This goes
+	// through the input queue so the input log has it (a replay has it
+	// already).
+	uint8_t settings[PERSIST_DATA_SIZE];
+	persist_get(PERSIST_SETTINGS, settings);
+	if ((settings[0] & PERSIST_FLAG_VISION) && !is_field_of_vision_on()
+			&& !input_log_replaying()) {
+		input_add(INPUT_SOURCE_SERIAL, INPUT_VISION);
+	}
+	// Save the level (the other settings are saved when they change)
+	settings[1] = level;
+	persist_set(PERSIST_SETTINGS, settings);
 }
 
+/*
+ * Starts playing the game set up by new_game() (or resume_game()).
+ * run_game_ticks() then plays it until it's over.
+ */
 void play_game(void) {
-	
-	uint32_t last_flash_time, current_time, last_diamond_flash_time, bomb_time, last_joystick_time;
-	uint8_t btn; //the button pushed
-	uint8_t cheatMode = 0; // 1 if cheat mode is enable else 0.
-	uint16_t joystickX, joystickY, bomb_flash_interval;
-	uint8_t firstLoop = 1; // Whether it is the first loop of the game.
-	uint8_t valid_move_made = 0;		// Whether any valid move has been made during this loop
-	joystickX = NO_JOYSTICK_ACTION;
-	joystickY = NO_JOYSTICK_ACTION;
-	diamondCount = 0; 
-	last_flash_time = get_current_time();
-	last_diamond_flash_time = get_current_time();
-	last_joystick_time = 0;
-	bomb_time = NO_BOMB;
+	cheatMode = 0;
+	last_flash_time = game_time;
+	// A resumed game can have a bomb placed already (it gets its 2 seconds
+	// again)
+	bomb_time = bomb_active() ? game_time + 2000 : NO_BOMB;
 	bomb_flash_interval = 600;
+	firstLoop = 1;
+	leds_off();
 	updateInfo(cheatMode);
-	// We play the game until it's over
-	while(!is_game_over()) {
-		// We need to check if any button has been pushed, this will be
-		// NO_BUTTON_PUSHED if no button has been pushed
-		btn = button_pushed();
-		valid_move_made = 0;
-		// If the last joystick movement was taken greater than 0.5 seconds ago, we will take another joystick movement
-		// Note we allow change in direction to be instantly registered as movements as I think this make it
-		// more playable (as change in direction is likeable to change in keys pressed so should have instantaneous feedback)
-		// This occurs naturally.
-		if (get_current_time() - last_joystick_time > 500 || last_joystick_time == 0) {
-			joystickX = joystickDirX();
-			joystickY = joystickDirY();
-			if (joystickX >= JOYSTICK_HIGH || joystickX <= JOYSTICK_LOW) {
-				last_joystick_time = get_current_time();
-			} else if (joystickY >= JOYSTICK_HIGH || joystickY <= JOYSTICK_LOW) {
-				last_joystick_time = get_current_time();
-			} else {
-				last_joystick_time = 0;
-			}
-		} else {
-			joystickX = NO_JOYSTICK_ACTION;
-			joystickY = NO_JOYSTICK_ACTION;
-		}
-		
-		// Get keyboard input
-		char serial_input = -1;
-		if (serial_input_available()) {
-			serial_input = fgetc(stdin);
-		}
-		if (btn == BUTTON0_PUSHED || serial_input == 'd' || serial_input == 'D' || joystickX >= JOYSTICK_HIGH) {
-			// If button 0 is pushed, move right, i.e increase x by 1 and leave
-			// y the same
-			valid_move_made = move_player(1, 0);
-			if (is_game_won()) {
+	ticks_run = get_game_ticks();
+	game_number++;
+	screen = SCREEN_PLAYING;
+}
+
+/*
+ * Plays the game ticks that are due. After a stall (such as printing a
+ * report) the ticks that were missed are played straight away, so the
+ * game catches up with the clock. If it has fallen more than
+ * MAX_CATCH_UP_TICKS behind, the rest are skipped (the game slows down
+ * rather than racing to catch up).
+ */
+void run_game_ticks(void) {
+	uint8_t game = game_number;
+	uint16_t due = get_game_ticks() - ticks_run;
+	if (due > MAX_CATCH_UP_TICKS) {
+		ticks_run += due - MAX_CATCH_UP_TICKS;
+		due = MAX_CATCH_UP_TICKS;
+	}
+	// Stop if the game is paused or over, or a won game went on to the
+	// next level (play_game() has started its ticks from now, so the ones
+	// due here aren't owed to it)
+	while (due > 0 && screen == SCREEN_PLAYING && game_number == game) {
+		due--;
+		ticks_run++;
+		game_time += GAME_TICK_MS;
+		play_game_tick();
+	}
+}
+
+/*
+ * Plays one tick of the game: handles the inputs that have arrived since
+ * the last tick, then the flashing and the bomb.
+ */
+void play_game_tick(void) {
+	uint32_t current_time;
+	InputEvent event; // the input being handled
+	
+	// Collect everything from the buttons, the terminal and the joystick
+	// (joystick.c repeats a held direction, faster the longer it is
+	// held) and handle all of it, oldest first. The input log goes by
+	// game ticks, so a replay is handled in the same ticks.
+	input_log_tick();
+	input_poll();
+	while (input_get_event(&event)) {
+		int8_t dx = 0;
+		int8_t dy = 0;
+		uint8_t changed = 0; // whether the game needs saving
+		switch (event.action) {
+			case INPUT_MOVE_RIGHT:
+				// move right, i.e increase x by 1 and leave y the same
+				dx = 1;
 				break;
-			}
-			if (check_diamond() == 1) {
-				diamondCount ++;
-				updateInfo(cheatMode);
-			}
-		} if ((btn == BUTTON1_PUSHED || serial_input == 's' || serial_input == 'S' || joystickY >= JOYSTICK_HIGH) && valid_move_made == 0) {
-			// move down
-			valid_move_made = move_player(0, -1);
-			if (is_game_won()) {
-				break; // CHANGE THIS TO A BREAK
-			}
-			if (check_diamond() == 1) {
-				diamondCount ++;
-				updateInfo(cheatMode);
-			}
-		} if ((btn == BUTTON2_PUSHED || serial_input == 'w' || serial_input == 'W' || joystickY <= JOYSTICK_LOW) && valid_move_made == 0){
-			// move up
-			valid_move_made = move_player(0, 1);
-			if (is_game_won()) {
+			case INPUT_MOVE_DOWN:
+				dy = -1;
 				break;
-			}
-			if (check_diamond() == 1) {
-				diamondCount ++;
-				updateInfo(cheatMode);
-			}
-		} if ((btn == BUTTON3_PUSHED || serial_input == 'a' || serial_input == 'A' || joystickX <= JOYSTICK_LOW) && valid_move_made == 0) {
-			// move left
-			valid_move_made = move_player(-1, 0);
-			if (is_game_won()) {
+			case INPUT_MOVE_UP:
+				dy = 1;
 				break;
-			}
-			if (check_diamond() == 1) {
-				diamondCount ++;
+			case INPUT_MOVE_LEFT:
+				dx = -1;
+				break;
+			case INPUT_INSPECT:
+				// Inspect wall
+				inspect_wall(cheatMode);
+				changed = 1;
+				break;
+			case INPUT_CHEAT:
+				cheatMode = !cheatMode;
 				updateInfo(cheatMode);
-			}
-		} else if (serial_input == 'e' || serial_input == 'E') {
-			// Inspect wall
-			inspect_wall(cheatMode);
-		} else if (serial_input == 'c' || serial_input == 'C') {
-			cheatMode = !cheatMode;
-			updateInfo(cheatMode);
-		} else if (serial_input == ' ') {
-			if (place_bomb() == 1) {
-				bomb_time = get_current_time() + 2000; // set bomb time to 2 secs from now
-			}
-		} else if (serial_input == 'p' || serial_input == 'P') {
-			uint8_t paused_bomb_time = bomb_time - get_current_time();
-			uint8_t paused_last_diamond_flash_time = get_current_time() - last_diamond_flash_time;
-			if (is_muted() != 1) {
-				toggle_sound();
-			}
-			while (serial_input == 'p' || serial_input == 'P') {
-				serial_input = -1;
-				if (serial_input_available()) {
-					serial_input = fgetc(stdin);
+				break;
+			case INPUT_BOMB:
+				if (place_bomb() == 1) {
+					bomb_time = game_time + 2000; // set bomb time to 2 secs from now
+					changed = 1;
+					telemetry_event(TELEMETRY_EVENT_BOMB_PLACED, 0);
+					flight_record(FLIGHT_BOMB_PLACED, 0);
 				}
+				break;
+			case INPUT_PAUSE:
+				pause_game();
+				break;
+			case INPUT_VISION:
+				toggle_field_of_vision();
+				save_settings();
+				changed = 1;
+				break;
+			case INPUT_MUTE:
+				toggle_sound();
+				save_settings();
+				break;
+			case INPUT_COMMAND:
+				handle_command(event.key);
+				break;
+		}
+		// Finish timing the input once the move has been drawn by
+		// render() (or straight away if the event wasn't a move)
+		if (dx == 0 && dy == 0) {
+			if (event.source != move_source) {
+				latency_done(event.source);
 			}
-			while (serial_input != 'p' && serial_input != 'P') {
-				serial_input = -1;
-				if (serial_input_available()) {
-					serial_input = fgetc(stdin);
-				}
+		} else {
+			// Only one move is timed at a time
+			if (move_source != NO_MOVE_SOURCE && move_source != event.source) {
+				latency_done(move_source);
 			}
-
-			while (serial_input == 'p' || serial_input == 'P') {
-				serial_input = -1;
-				if (serial_input_available()) {
-					serial_input = fgetc(stdin);
+			uint16_t move_time = get_fine_time();
+			latency_arm(event.source);
+			uint8_t moved = move_player(dx, dy);
+			histogram_add(&move_histogram, get_fine_time() - move_time);
+			move_source = event.source;
+			flight_record(FLIGHT_MOVE, (event.source << 4) | event.action
+					| (moved ? FLIGHT_MOVED : 0));
+			changed = 1;
+			if (!is_game_won()) {
+				if (check_diamond() == 1) {
+					diamondCount ++;
+					updateInfo(cheatMode);
+					telemetry_event(TELEMETRY_EVENT_DIAMOND, diamondCount);
+					flight_record(FLIGHT_DIAMOND, diamondCount);
 				}
+				show_diamond_distance();
 			}
-			bomb_time = get_current_time() + paused_bomb_time;
-			last_diamond_flash_time = get_current_time() - paused_last_diamond_flash_time;
-		} else if (serial_input == 'f' || serial_input == 'F') {
-			toggle_field_of_vision();
-		} else if (serial_input == 'm' || serial_input == 'M') {
-			toggle_sound();
 		}
+		// Save the game now this event has been handled (with the diamond
+		// it found counted)
+		if (changed) {
+			snapshot_save(level, diamondCount);
+		}
+		if (is_game_won()) {
+			break;
+		}
+		// Anything else that has arrived is for the pause screen
+		if (screen == SCREEN_PAUSED) {
+			return;
+		}
+	}
+	if (is_game_won()) {
+		end_game();
+		return;
+	}
 
+	current_time = game_time;
+	if(current_time >= last_flash_time + 500) {
+		// 500ms (0.5 second) has passed since the last time we
+		// flashed the cursor, so flash the cursor
+		flash_facing();
+		
+		// Update the most recent time the cursor was flashed
+		last_flash_time = current_time;
+	}
 	
-
-		current_time = get_current_time();
-		if(current_time >= last_flash_time + 500) {
-			// 500ms (0.5 second) has passed since the last time we
-			// flashed the cursor, so flash the cursor
-			flash_facing();
-			
-			// Update the most recent time the cursor was flashed
-			last_flash_time = current_time;
+	// The diamond LED is blinked by timer 2 (show_diamond_distance() is
+	// called after each move)
+	show_danger();
+	
+	// Check if there is a bomb active
+	if(bomb_active()) {
+		if (current_time >= bomb_time) {
+			blow_bomb();
+			play_blow_bomb();
+			snapshot_save(level, diamondCount);
+			telemetry_event(TELEMETRY_EVENT_BOMB_BLOWN, 0);
+			flight_record(FLIGHT_BOMB_BLOWN, 0);
 		}
-		
-		// Flash for diamond distance when cheat mode is on
-		if(diamondDistance != -1 && cheatMode == 1) {
-			// Flash speed at 250 * the diamond distance (note it is 125 here as we toggle pin on and off so full period is 250)
-			if (current_time >= last_diamond_flash_time + 125 * diamond_distance()) {
-				PORTA ^= (1 << PORTA7); // toggle A7 pin
-				
-				// Update the most recent time the cursor was flashed
-				last_diamond_flash_time = current_time;
-			}
-			
+		if (current_time >= bomb_time + 50) {
+			bomb_animation_middle();
 		}
-		
-		// Check if there is a bomb active
-		if(bomb_active()) {
-			if (in_danger()) {
-				PORTA |= (1 << PORTA5); // turn on A5 pin
-				} else {
-				PORTA &= ~(1 << PORTA5); // turn off A5 pin
-			}
-			if (current_time >= bomb_time) {
-				blow_bomb();
-				play_blow_bomb();
-			}
-			if (current_time >= bomb_time + 50) {
-				bomb_animation_middle();
-			}
-			if (current_time >= bomb_time + 100) {
-				bomb_animation_end();
-				// reset bomb flash speed
-				bomb_flash_interval = 600;
-				bomb_time = NO_BOMB;
-			}
-			if (current_time >= bomb_time - bomb_flash_interval) {
-				if (bomb_flash_interval > 75) {
-					bomb_flash_interval /= 1.5;
-				}
-				flash_bomb();
+		if (current_time >= bomb_time + 100) {
+			bomb_animation_end();
+			snapshot_save(level, diamondCount);
+			// reset bomb flash speed
+			bomb_flash_interval = 600;
+			bomb_time = NO_BOMB;
+		}
+		if (current_time >= bomb_time - bomb_flash_interval) {
+			if (bomb_flash_interval > 75) {
+				bomb_flash_interval /= 1.5;
 			}
+			flash_bomb();
 		}
-		if (firstLoop) {
-			play_start_game();
-			firstLoop = 0;
+	}
+	if (firstLoop) {
+		play_start_game();
+		telemetry_event(TELEMETRY_EVENT_GAME_START, level);
+		flight_record(FLIGHT_GAME_START, level);
+		firstLoop = 0;
+	}
+	if (is_game_over()) {
+		end_game();
+	}
+}
+
+/*
+ * Pauses the game. pause_step() throws away anything else that arrives
+ * until the game is unpaused.
+ */
+void pause_game(void) {
+	if (is_muted() != 1) {
+		toggle_sound();
+	}
+	screen = SCREEN_PAUSED;
+}
+
+void pause_step(void) {
+	InputEvent event;
+	input_poll();
+	while (input_get_event(&event)) {
+		if (event.action == INPUT_PAUSE) {
+			input_clear();
+			// No ticks were played while the game was paused, so its
+			// timers carry on from where they were. Don't catch up.
+			ticks_run = get_game_ticks();
+			screen = SCREEN_PLAYING;
+			return;
 		}
+	}
+}
 
+/*
+ * We get here if the game is over. Goes on to the next level if it was
+ * won, otherwise shows the game over screen.
+ */
+void end_game(void) {
+	leds_off();
+	telemetry_event(TELEMETRY_EVENT_GAME_OVER, is_game_won());
+	flight_record(FLIGHT_GAME_OVER, is_game_won());
+	save_scores();
+	// So a finished game isn't resumed
+	snapshot_save_finished(level, diamondCount);
+	snapshot_update();
+	if (is_game_won()) {
+		nextLevel();
+		new_game();
+		play_game();
+	} else {
+		handle_game_over();
 	}
-	// We get here if the game is over.
 }
 
 void handle_game_over() {
 	clear_terminal();
+	mirror_redraw_all();
+	// The status fields aren't on this screen
+	status_init();
 	move_terminal_cursor(10,14);
-	printf_P(PSTR("GAME OVER"));
+	serial_write_P(PSTR("GAME OVER"));
 	move_terminal_cursor(10,15);
-	printf_P(PSTR("Press a button to start again"));
+	serial_write_P(PSTR("Press a button to start again"));
 	play_game_over();
+	// Send the last few seconds of the game for looking at later
+	if (telemetry_enabled()) {
+		flight_dump();
+	}
+	game_over_time = get_current_time();
+	screen = SCREEN_GAME_OVER;
+}
+
+/*
+ * Finishes off the bomb animation (if the bomb ended the game) and starts
+ * a new game when a button is pressed.
+ */
+void handle_game_over_step(void) {
+	if (button_pushed() != NO_BUTTON_PUSHED) {
+		new_game();
+		play_game();
+		return;
+	}
 	uint32_t current_time = get_current_time();
-	uint32_t time_since_end = current_time;
-	while(button_pushed() == NO_BUTTON_PUSHED) {
-		current_time = get_current_time();
-		if (current_time >= time_since_end + 50) {
-			bomb_animation_middle();
-		}
-		if (current_time >= time_since_end + 100) {
-			bomb_animation_end();
-		}
+	if (current_time >= game_over_time + 50) {
+		bomb_animation_middle();
+	}
+	if (current_time >= game_over_time + 100) {
+		bomb_animation_end();
+	}
+}
+
+/*
+ * Draws what has changed on the LED matrix, and finishes timing the move
+ * that was drawn (see latency.h).
+ */
+void render(void) {
+	display_flush();
+	if (move_source != NO_MOVE_SOURCE) {
+		latency_done(move_source);
+		move_source = NO_MOVE_SOURCE;
 	}
-	new_game();
+}
+
+/*
+ * The work that goes on whatever screen is showing: sending the status
+ * fields, the LED matrix mirror and telemetry to the terminal a little at
+ * a time (without waiting for the UART), and writing the saved settings
+ * and scores and the game snapshot to EEPROM.
+ */
+void background_tasks(void) {
+	status_flush(STATUS_BYTES_PER_FRAME);
+	mirror_flush(MIRROR_BYTES_PER_FRAME);
+	telemetry_frame();
+	persist_update();
+	snapshot_update();
+}
+
+/*
+ * Sleeps until the next interrupt. Timer 0 interrupts every millisecond,
+ * and a button, the joystick, the serial port and the EEPROM all wake the
+ * CPU up too, so nothing waits long. The CPU only runs when there is
+ * something to do.
+ */
+void wait_for_interrupt(void) {
+	set_sleep_mode(SLEEP_MODE_IDLE);
+	sleep_mode();
 }
 
 /*
  * Updates visible info (e.g. cheat mode enabled, distance, diamond count, etc)
  */
 void updateInfo(uint8_t cheatMode) {
-		// Update terminal info
-		clear_terminal();
-		move_terminal_cursor(10,10);
+		// Update terminal info. This only changes the status fields -
+		// play_game() sends whatever has changed a little at a time
 		if (cheatMode == 1) {
-			printf_P(PSTR("CHEATMODE ENABLED"));
+			status_set_text_P(STATUS_CHEAT_MODE, PSTR("CHEATMODE ENABLED"));
 		} else {
-			printf_P(PSTR("CHEATMODE DISABLED"));
-			PORTA &= ~(1 << PORTA7); // turn A7 pin off
-		}
-		if (diamond_distance() == -1) {				// for case where no diamonds on map but cheat mode is on
-			PORTA &= ~(1 << PORTA7); // turn A7 pin off
+			status_set_text_P(STATUS_CHEAT_MODE, PSTR("CHEATMODE DISABLED"));
 		}
+		show_diamond_distance();
 			
-		move_terminal_cursor(10,12);
-		printf_P(PSTR("Diamond Count %d"), diamondCount);
-		diamondDistance = diamond_distance();
+		status_set_uint(STATUS_DIAMONDS, PSTR("Diamond Count "), diamondCount);
+}
+
+/*
+ * Blinks the diamond LED (A7) with a period of 250ms times the distance
+ * to the nearest diamond while cheat mode is on, otherwise (or if there
+ * are no diamonds left) turns it off. Timer 2 blinks it, so it only has
+ * to be told when the distance changes.
+ */
+void show_diamond_distance(void) {
+	uint16_t distance = cheatMode == 1 ? diamond_distance() : (uint16_t)-1;
+	if (distance == diamondDistance) {
+		return;
+	}
+	diamondDistance = distance;
+	if (distance == (uint16_t)-1) {
+		blinker_set(BLINKER_DIAMOND, 0, 0);
+	} else {
+		blinker_set(BLINKER_DIAMOND, 250 * distance, 50);
+	}
+}
+
+/*
+ * Blinks the bomb danger LED (A5) quickly while the player is next to a
+ * placed bomb, otherwise turns it off.
+ */
+void show_danger(void) {
+	uint8_t now = bomb_active() && in_danger();
+	if (now == danger) {
+		return;
+	}
+	danger = now;
+	if (now) {
+		blinker_set(BLINKER_DANGER, 200, 50);
+	} else {
+		blinker_set(BLINKER_DANGER, 0, 0);
+	}
+}
+
+/*
+ * Turns both indicator LEDs off (at the start and end of a game).
+ */
+void leds_off(void) {
+	diamondDistance = -1;
+	danger = 0;
+	blinker_set(BLINKER_DIAMOND, 0, 0);
+	blinker_set(BLINKER_DANGER, 0, 0);
+}
+
+/*
+ * Handles a command typed on the terminal (INPUT_COMMAND_PREFIX followed
+ * by the command key)
+ * t - turn binary telemetry on or off
+ * f - send the flight recorder's events as telemetry (see flight.h)
+ * h - show the loop and move time histograms (and send them as telemetry)
+ * i - show the input log of this game (see input_log.h)
+ * l - show the input to photon latency of each input source
+ * m - show the RAM use (stack high water mark, free RAM, static RAM)
+ * p - show and reset the function cycle counts (Profile build only)
+ * r - reset the histograms and latency measurements
+ * y - replay the input log in the next game (if it is complete)
+ */
+void handle_command(char command) {
+	switch (command) {
+		case 't':
+			telemetry_enable(!telemetry_enabled());
+			break;
+		case 'f':
+			flight_dump();
+			loop_start_time = get_fine_time();
+			break;
+		case 'h':
+			move_terminal_cursor(1, 20);
+			histogram_print(&loop_histogram, PSTR("Loop time"));
+			histogram_print(&move_histogram, PSTR("Move time"));
+			histogram_send(&loop_histogram, HISTOGRAM_LOOP);
+			histogram_send(&move_histogram, HISTOGRAM_MOVE);
+			// Don't count the time spent printing as a slow loop
+			loop_start_time = get_fine_time();
+			break;
+		case 'i':
+			move_terminal_cursor(1, 20);
+			input_log_print();
+			loop_start_time = get_fine_time();
+			break;
+		case 'l':
+			move_terminal_cursor(1, 20);
+			latency_report();
+			loop_start_time = get_fine_time();
+			break;
+		case 'm':
+			move_terminal_cursor(1, 20);
+			memory_report();
+			loop_start_time = get_fine_time();
+			break;
+		case 'p':
+			move_terminal_cursor(1, 20);
+			profile_report();
+			loop_start_time = get_fine_time();
+			break;
+		case 'r':
+			histogram_reset(&loop_histogram);
+			histogram_reset(&move_histogram);
+			latency_reset();
+			break;
+		case 'y':
+			move_terminal_cursor(1, 20);
+			if (input_log_replay_next()) {
+				serial_write_P(PSTR("The next game replays the input log"));
+			} else {
+				serial_write_P(PSTR("The input log is empty or incomplete - not replaying it"));
+			}
+			clear_to_end_of_line();
+			loop_start_time = get_fine_time();
+			break;
+	}
 }
 
 /*
@@ -372,56 +751,119 @@ void updateInfo(uint8_t cheatMode) {
 void setUpPins() {
 	// Set A pins to be outputs for LEDs and CC control for SSD and JOYSTICK CONTROL
 	// A7 is for LED steps blinker, A6 is for CC, A5 is for bomb danger LED, A0 is for U/D, A1 is for L/R
+	// (The joystick ADC itself is set up by init_adc())
 	DDRA = (1 << DDRA5) | (1 << DDRA6) | (1 << DDRA7);
 	// Set C pins to be outputs for SSD
 	DDRC = 0xFF;
-	
-	// SETUP FOR JOYSTICK. COPY AND PASTED FROM LAB 16
-	// Set up ADC - AVCC reference, right adjust
-	// Input selection doesn't matter yet - we'll swap this around in the while
-	// loop below.
-	ADMUX = (1<<REFS0);
-	// Turn on the ADC (but don't start a conversion yet). Choose a clock
-	// divider of 64. (The ADC clock must be somewhere
-	// between 50kHz and 200kHz. We will divide our 8MHz clock by 64
-	// to give us 125kHz.)
-	ADCSRA = (1<<ADEN)|(1<<ADPS2)|(1<<ADPS1);
 }
 
 /*
- * Some sort of direction thing. Currently using polling. May need to use interrupts instead.
- */ 
-uint16_t joystickDirX() {
-	ADMUX &= ~1; //turn off first bit
-	// Start the ADC conversion
-	ADCSRA |= (1<<ADSC);
-			
-	while(ADCSRA & (1<<ADSC)) {
-		; /* Wait until conversion finished */
+ * Goes to next level
+ */
+void nextLevel() {
+	level ^= 1;
+}
+
+/*
+ * Sets the level and mute from the saved settings (field of vision is
+ * turned back on by new_game())
+ */
+void load_settings(void) {
+	uint8_t settings[PERSIST_DATA_SIZE];
+	persist_get(PERSIST_SETTINGS, settings);
+	level = settings[1] & 1;
+	if ((settings[0] & PERSIST_FLAG_MUTED) && is_muted() != 1) {
+		toggle_sound();
 	}
-	return ADC;
 }
 
 /*
- * Some sort of direction thing. Currently using polling. May need to use interrupts instead.
- */ 
-uint16_t joystickDirY() {
-	ADMUX |= 1;		//turn on first bit
-	// Start the ADC conversion
-	ADCSRA |= (1<<ADSC);
-			
-	while(ADCSRA & (1<<ADSC)) {
-		; /* Wait until conversion finished */
+ * Saves the level, mute and field of vision so they are the same after
+ * the power is turned off and on
+ */
+void save_settings(void) {
+	uint8_t settings[PERSIST_DATA_SIZE] = {0};
+	if (is_muted() == 1) {
+		settings[0] |= PERSIST_FLAG_MUTED;
+	}
+	if (is_field_of_vision_on()) {
+		settings[0] |= PERSIST_FLAG_VISION;
 	}
-	return ADC;
+	settings[1] = level;
+	persist_set(PERSIST_SETTINGS, settings);
 }
 
+/*
+ * Saves the steps taken (if the game was won in fewer steps than before)
+ * and the diamonds found (if more than before) on this level
+ */
+void save_scores(void) {
+	uint16_t scores[PERSIST_DATA_SIZE / 2];
+	if (is_game_won()) {
+		persist_get(PERSIST_BEST_STEPS, scores);
+		if (scores[level] == 0 || get_steps() < scores[level]) {
+			scores[level] = get_steps();
+			persist_set(PERSIST_BEST_STEPS, scores);
+		}
+	}
+	persist_get(PERSIST_HIGH_SCORE, scores);
+	if (diamondCount > scores[level]) {
+		scores[level] = diamondCount;
+		persist_set(PERSIST_HIGH_SCORE, scores);
+	}
+}
 
+/*
+ * Shows the best scores on each level on the start screen
+ */
+void show_scores(void) {
+	uint16_t steps[PERSIST_DATA_SIZE / 2];
+	uint16_t diamonds[PERSIST_DATA_SIZE / 2];
+	persist_get(PERSIST_BEST_STEPS, steps);
+	persist_get(PERSIST_HIGH_SCORE, diamonds);
+	for (uint8_t i = 0; i < 2; i++) {
+		move_terminal_cursor(10, 14 + i);
+		serial_write_P(PSTR("Level "));
+		serial_write_uint(i + 1);
+		if (level_uploaded(i)) {
+			serial_write_P(PSTR(" (uploaded)"));
+		}
+		serial_write_P(PSTR(": most diamonds "));
+		serial_write_uint(diamonds[i]);
+		if (steps[i] != 0) {
+			serial_write_P(PSTR(", won in "));
+			serial_write_uint(steps[i]);
+			serial_write_P(PSTR(" steps"));
+		}
+		clear_to_end_of_line();
+	}
+}
 
 /*
- * Goes to next level
+ * Forgets the best scores on a level (when a new level is uploaded in its
+ * place)
  */
-void nextLevel() {
-	level ^= 1;
-	new_game();
+void clear_scores(uint8_t level) {
+	uint16_t scores[PERSIST_DATA_SIZE / 2];
+	persist_get(PERSIST_BEST_STEPS, scores);
+	scores[level] = 0;
+	persist_set(PERSIST_BEST_STEPS, scores);
+	persist_get(PERSIST_HIGH_SCORE, scores);
+	scores[level] = 0;
+	persist_set(PERSIST_HIGH_SCORE, scores);
+}
+
+/*
+ * Restores the game from its EEPROM snapshot (see snapshot.h) if the
+ * power went off part way through it. Returns 1 if it did.
+ */
+uint8_t resume_game(void) {
+	if (!snapshot_restore(&level, &diamondCount)) {
+		return 0;
+	}
+	clear_terminal();
+	mirror_redraw_all();
+	status_init();
+	input_clear();
+	return 1;
 }
\ No newline at end of file
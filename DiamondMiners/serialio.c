@@ -18,42 +18,66 @@
  * The function input_available() can be used to test whether there is
  * input available to read from stdin.
  *
+ * Modified by Matthew Chen: double speed (U2X) baud rates, power of 2
+ * buffers with 16 bit indices, overrun/high water statistics and
+ * serial_write() which copies whole strings into the output buffer
+ * instead of going through printf one character at a time. Received
+ * characters are stamped for latency.c. Profiling hooks (profile.h) and
+ * trace markers (isr_trace.h). Overruns are recorded by the flight
+ * recorder (flight.h).
  */
 
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
+
+#include "serialio.h"
+#include "input.h"
+#include "latency.h"
+#include "profile.h"
+#include "isr_trace.h"
+#include "flight.h"
 
 /* System clock rate in Hz. (L at the end indicates this is a long constant) */
 #define SYSCLK 8000000L
 
 /* Global variables */
-/* Circular buffer to hold outgoing characters. The insert_pos variable
- * keeps track of the position (0 to OUTPUT_BUFFER_SIZE-1) that the next
- * outgoing character should be written to. bytes_in_buffer keeps
- * count of the number of characters currently stored in the buffer 
- * (ranging from 0 to OUTPUT_BUFFER_SIZE). This number of bytes immediately
- * prior to the current insert_pos are the bytes waiting to be output.
- * If the insert_pos reaches the end of the buffer it will wrap around
- * to the beginning (assuming those bytes have been output).
- * NOTE - OUTPUT_BUFFER_SIZE can not be larger than 255 without changing
- * the type of the variables below (currently defined as 8 bit unsigned ints).
+/* Circular buffer to hold outgoing characters. out_head is the total
+ * number of characters ever added to the buffer and out_tail is the
+ * total number ever removed (both wrap around at 65536) so
+ * out_head - out_tail is the number of characters waiting and the
+ * buffer positions are these counts masked by SERIAL_OUTPUT_BUFFER_SIZE-1.
+ * Only uart_put_char() changes out_head and only the UDR empty interrupt
+ * handler changes out_tail. The indices are 16 bits so they can't be
+ * read or written in one instruction - outside the interrupt handlers
+ * they are only accessed with interrupts off.
  */
-#define OUTPUT_BUFFER_SIZE 255
-volatile char out_buffer[OUTPUT_BUFFER_SIZE];
-volatile uint8_t out_insert_pos;
-volatile uint8_t bytes_in_out_buffer;
+#define OUTPUT_MASK (SERIAL_OUTPUT_BUFFER_SIZE - 1)
+static volatile char out_buffer[SERIAL_OUTPUT_BUFFER_SIZE];
+static volatile uint16_t out_head;
+static volatile uint16_t out_tail;
 
 /* Circular buffer to hold incoming characters. Works on same principle
- * as output buffer
+ * as output buffer (the receive interrupt handler changes input_head,
+ * uart_get_char() changes input_tail).
  */
-#define INPUT_BUFFER_SIZE 16
-volatile char input_buffer[INPUT_BUFFER_SIZE];
-volatile uint8_t input_insert_pos;
-volatile uint8_t bytes_in_input_buffer;
-volatile uint8_t input_overrun;
+#define INPUT_MASK (SERIAL_INPUT_BUFFER_SIZE - 1)
+static volatile char input_buffer[SERIAL_INPUT_BUFFER_SIZE];
+static volatile uint16_t input_head;
+static volatile uint16_t input_tail;
+
+#if (SERIAL_OUTPUT_BUFFER_SIZE & OUTPUT_MASK) || (SERIAL_INPUT_BUFFER_SIZE & INPUT_MASK)
+#error "Serial buffer sizes must be powers of 2"
+#endif
+
+/* Overrun and high water statistics */
+static volatile SerialStats stats;
 
 /* Variable to keep track of whether incoming characters are to be echoed
  * back or not.
@@ -72,28 +96,52 @@ static int uart_get_char(FILE*);
 static FILE myStream = FDEV_SETUP_STREAM(uart_put_char, uart_get_char,
 		_FDEV_SETUP_RW);
 
+/* Works out the baud rate register value for a UART clock divisor of 16
+ * (normal speed) or 8 (double speed), rounding to the nearest value.
+ * The error (in baud) of the rate we'd actually get is stored in error.
+ */
+static uint16_t ubrr_for(long baudrate, uint8_t divisor, long* error) {
+	long ubrr = (SYSCLK + (divisor * baudrate) / 2) / (divisor * baudrate) - 1;
+	if(ubrr < 0) {
+		ubrr = 0;
+	} else if(ubrr > 4095) {
+		ubrr = 4095;
+	}
+	long actual = SYSCLK / (divisor * (ubrr + 1));
+	*error = labs(actual - baudrate);
+	return ubrr;
+}
+
 void init_serial_stdio(long baudrate, int8_t echo) {
 	uint16_t ubrr;
+	long normal_error, double_error;
 	/*
 	 * Initialise our buffers
 	*/
-	out_insert_pos = 0;
-	bytes_in_out_buffer = 0;
-	input_insert_pos = 0;
-	bytes_in_input_buffer = 0;
-	input_overrun = 0;
+	out_head = out_tail = 0;
+	input_head = input_tail = 0;
+	serial_reset_stats();
 	
 	/*
 	 * Record whether we're going to echo characters or not
 	*/
 	do_echo = echo;
 	
-	/* Configure the serial port baud rate */
-	/* (This differs from the datasheet formula so that we get 
-	 * rounding to the nearest integer while using integer division
-	 * (which truncates)).
+	/* Configure the serial port baud rate. We work out the closest we
+	 * can get to the requested rate at normal speed (UART clock divided
+	 * by 16) and at double speed (U2X, divided by 8) and use whichever is
+	 * closer. Normal speed is preferred if they are equally close as the
+	 * receiver samples each bit more times. Double speed allows rates up
+	 * to 1Mbaud at 8MHz (e.g. 250k and 500k baud are exact).
 	*/
-	ubrr = ((SYSCLK / (8 * baudrate)) + 1)/2 - 1;
+	ubrr = ubrr_for(baudrate, 16, &normal_error);
+	uint16_t double_ubrr = ubrr_for(baudrate, 8, &double_error);
+	if(double_error < normal_error) {
+		UCSR0A |= (1<<U2X0);
+		ubrr = double_ubrr;
+	} else {
+		UCSR0A &= ~(1<<U2X0);
+	}
 	UBRR0 = ubrr;
 	
 	/*
@@ -119,17 +167,182 @@ void init_serial_stdio(long baudrate, int8_t echo) {
 }
 
 int8_t serial_input_available(void) {
-	return (bytes_in_input_buffer != 0);
+	uint8_t available;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		available = (input_head != input_tail);
+	}
+	return available;
 }
 
 void clear_serial_input_buffer(void) {
 	/* Just adjust our buffer data so it looks empty */
-	input_insert_pos = 0;
-	bytes_in_input_buffer = 0;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		input_tail = input_head;
+	}
+}
+
+uint16_t serial_output_pending(void) {
+	uint16_t pending;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		pending = out_head - out_tail;
+	}
+	return pending;
+}
+
+void serial_get_stats(SerialStats* copy) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		copy->tx_overrun = stats.tx_overrun;
+		copy->tx_stalls = stats.tx_stalls;
+		copy->tx_high_water = stats.tx_high_water;
+		copy->rx_overrun = stats.rx_overrun;
+		copy->rx_uart_overrun = stats.rx_uart_overrun;
+		copy->rx_high_water = stats.rx_high_water;
+	}
+}
+
+void serial_reset_stats(void) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		stats.tx_overrun = 0;
+		stats.tx_stalls = 0;
+		stats.tx_high_water = 0;
+		stats.rx_overrun = 0;
+		stats.rx_uart_overrun = 0;
+		stats.rx_high_water = 0;
+	}
+}
+
+/* Waits until there is space in the output buffer and returns how much
+ * there is, or returns 0 if the buffer is full and interrupts are off (so
+ * it will never empty).
+ */
+static uint16_t wait_for_output_space(void) {
+	uint16_t pending;
+	uint8_t waited = 0;
+	while(1) {
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+			pending = out_head - out_tail;
+		}
+		if(pending < SERIAL_OUTPUT_BUFFER_SIZE) {
+			return SERIAL_OUTPUT_BUFFER_SIZE - pending;
+		}
+		if(!bit_is_set(SREG, SREG_I)) {
+			return 0;
+		}
+		if(!waited) {
+			waited = 1;
+			ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+				stats.tx_stalls++;
+			}
+		}
+	}
+}
+
+/* Makes count characters that have been copied in after out_head
+ * available to the ISR.
+ */
+static void commit_output(uint16_t count) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		out_head += count;
+		uint16_t pending = out_head - out_tail;
+		if(pending > stats.tx_high_water) {
+			stats.tx_high_water = pending;
+		}
+		UCSR0B |= (1 << UDRIE0);
+	}
+}
+
+/* Copies len characters into the output buffer, from RAM or program
+ * memory depending on from_progmem. Each piece is copied with a single
+ * memcpy - there are only two pieces if the free space wraps around the
+ * end of the buffer (more if we have to wait for space).
+ * The main program is the only thing that adds to the output buffer
+ * (unless echo is on) and the ISR never touches the free part of the
+ * buffer, so the copying is done with interrupts on - they are only
+ * turned off to read out_tail and update out_head.
+ */
+static void write_chars(const char* buf, uint16_t len, uint8_t from_progmem) {
+	while(len) {
+		uint16_t space = wait_for_output_space();
+		if(space == 0) {
+			ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+				stats.tx_overrun += len;
+			}
+			flight_record(FLIGHT_TX_OVERRUN, 0);
+			return;
+		}
+		/* With echo on the receive ISR may also add characters, so
+		 * then we keep interrupts off while we copy.
+		 */
+		uint8_t interrupts_enabled = bit_is_set(SREG, SREG_I);
+		if(do_echo) {
+			cli();
+			ISR_TRACE_CLI_START(interrupts_enabled);
+			space = SERIAL_OUTPUT_BUFFER_SIZE - (out_head - out_tail);
+		}
+		uint16_t head = out_head & OUTPUT_MASK;
+		uint16_t count = SERIAL_OUTPUT_BUFFER_SIZE - head;
+		if(count > space) {
+			count = space;
+		}
+		if(count > len) {
+			count = len;
+		}
+		if(from_progmem) {
+			memcpy_P((char*)&out_buffer[head], buf, count);
+		} else {
+			memcpy((char*)&out_buffer[head], buf, count);
+		}
+		commit_output(count);
+		if(do_echo && interrupts_enabled) {
+			ISR_TRACE_CLI_END(interrupts_enabled);
+			sei();
+		}
+		buf += count;
+		len -= count;
+	}
+}
+
+void serial_write(const char* buf, uint16_t len) {
+	PROFILE_FUNCTION(PROFILE_SERIAL_WRITE);
+	write_chars(buf, len, 0);
+}
+
+void serial_write_P(const char* str) {
+	write_chars(str, strlen_P(str), 1);
+}
+
+uint8_t serial_format_uint(char* buf, uint16_t value) {
+	char digits[5];
+	uint8_t n = 0;
+	do {
+		digits[n++] = '0' + (value % 10);
+		value /= 10;
+	} while(value);
+	for(uint8_t i = 0; i < n; i++) {
+		buf[i] = digits[n - 1 - i];
+	}
+	return n;
+}
+
+void serial_write_uint(uint16_t value) {
+	char buf[5];
+	serial_write(buf, serial_format_uint(buf, value));
+}
+
+void serial_write_ulong(uint32_t value) {
+	char digits[10];
+	uint8_t n = sizeof(digits);
+	do {
+		digits[--n] = '0' + (value % 10);
+		value /= 10;
+	} while(value);
+	serial_write(&digits[n], sizeof(digits) - n);
 }
 
 static int uart_put_char(char c, FILE* stream) {
+	PROFILE_FUNCTION(PROFILE_UART_PUT_CHAR);
 	uint8_t interrupts_enabled;
+	uint16_t pending;
 	
 	/* Add the character to the buffer for transmission (if there 
 	 * is space to do so). If not we wait until the buffer has space.
@@ -144,71 +357,67 @@ static int uart_put_char(char c, FILE* stream) {
 	 * abort - we don't output the character since the buffer will
 	 * never be emptied if interrupts are disabled. If the buffer is full
 	 * and interrupts are enabled then we loop until the buffer has 
-	 * enough space. The bytes_in_buffer variable will get modified by the
+	 * enough space. out_tail will get modified by the
 	 * ISR which extracts bytes from the buffer.
 	*/
 	interrupts_enabled = bit_is_set(SREG, SREG_I);
-	while(bytes_in_out_buffer >= OUTPUT_BUFFER_SIZE) {
+	cli();
+	ISR_TRACE_CLI_START(interrupts_enabled);
+	pending = out_head - out_tail;
+	if(pending >= SERIAL_OUTPUT_BUFFER_SIZE) {
 		if(!interrupts_enabled) {
+			stats.tx_overrun++;
+			flight_record(FLIGHT_TX_OVERRUN, 0);
 			return 1;
 		}		
-		/* else do nothing */
+		stats.tx_stalls++;
+		do {
+			/* Let the ISR run while we wait */
+			ISR_TRACE_CLI_END(interrupts_enabled);
+			sei();
+			cli();
+			ISR_TRACE_CLI_START(interrupts_enabled);
+			pending = out_head - out_tail;
+		} while(pending >= SERIAL_OUTPUT_BUFFER_SIZE);
 	}
 	
-	/* Add the character to the buffer for transmission if there
-	 * is space to do so. We advance the insert_pos to the next
-	 * character position. If this is beyond the end of the buffer
-	 * we wrap around back to the beginning of the buffer 
-	 * NOTE: we disable interrupts before modifying the buffer. This
-	 * prevents the ISR from modifying the buffer at the same time.
-	 * We reenable them if they were enabled when we entered the
-	 * function.
+	/* Add the character to the buffer for transmission. We advance the
+	 * head to the next character position. Interrupts are off so the ISR
+	 * can't look at the buffer at the same time. We reenable them if they
+	 * were enabled when we entered the function.
 	*/	
-	cli();
-	out_buffer[out_insert_pos++] = c;
-	bytes_in_out_buffer++;
-	if(out_insert_pos == OUTPUT_BUFFER_SIZE) {
-		/* Wrap around buffer pointer if necessary */
-		out_insert_pos = 0;
+	out_buffer[out_head & OUTPUT_MASK] = c;
+	out_head++;
+	pending++;
+	if(pending > stats.tx_high_water) {
+		stats.tx_high_water = pending;
 	}
 	/* Reenable interrupts (UDR Empty interrupt may have been
 	 * disabled) - we ensure it is now enabled so that it will
 	 * fire and deal with the next character in the buffer. */
 	UCSR0B |= (1 << UDRIE0);
+	ISR_TRACE_CLI_END(interrupts_enabled);
 	if(interrupts_enabled) {
 		sei();
 	}
 	return 0;
 }
 
-int uart_get_char(FILE* stream) {
+static int uart_get_char(FILE* stream) {
 	/* Wait until we've received a character */
-	while(bytes_in_input_buffer == 0) {
+	while(!serial_input_available()) {
 		/* do nothing */
 	}
 	
 	/*
-	 * Turn interrupts off and remove a character from the input
-	 * buffer. We reenable interrupts if they were on.
-	 * The pending character is the one which is byte_in_input_buffer
-	 * characters before the insert position (taking into account
-	 * that we may need to wrap around).
+	 * Remove the oldest character from the input buffer. Only the ISR
+	 * changes input_head and it never touches the slot at input_tail
+	 * while there is a character in it, so we only need interrupts off
+	 * to update the 16 bit tail.
 	 */
-	uint8_t interrupts_enabled = bit_is_set(SREG, SREG_I);
-	cli();
-	char c;
-	if(input_insert_pos - bytes_in_input_buffer < 0) {
-		/* Need to wrap around */
-		c = input_buffer[input_insert_pos - bytes_in_input_buffer
-				+ INPUT_BUFFER_SIZE];
-	} else {
-		c = input_buffer[input_insert_pos - bytes_in_input_buffer];
-	}
-	
-	/* Decrement our count of bytes in the input buffer */
-	bytes_in_input_buffer--;
-	if(interrupts_enabled) {
-		sei();
+	char c = input_buffer[input_tail & INPUT_MASK];
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		input_tail++;
 	}	
 	return c;
 }
@@ -219,29 +428,14 @@ int uart_get_char(FILE* stream) {
  */
 ISR(USART0_UDRE_vect) 
 {
+	ISR_TRACE_ENTER(ISR_TRACE_PIN_SERIAL_TX);
 	/* Check if we have data in our buffer */
-	if(bytes_in_out_buffer > 0) {
-		/* Yes we do - remove the pending byte and output it
-		 * via the UART. The pending byte (character) is the
-		 * one which is "bytes_in_buffer" characters before the 
-		 * insert_pos (taking into account that we may 
-		 * need to wrap around to the end of the buffer).
-		 */
-		char c;
-		if(out_insert_pos - bytes_in_out_buffer < 0) {
-			/* Need to wrap around */
-			c = out_buffer[out_insert_pos - bytes_in_out_buffer
-				+ OUTPUT_BUFFER_SIZE];
-		} else {
-			c = out_buffer[out_insert_pos - bytes_in_out_buffer];
-		}
-		/* Decrement our count of the number of bytes in the 
-		 * buffer 
+	if(out_head != out_tail) {
+		/* Yes we do - remove the oldest byte and output it
+		 * via the UART.
 		 */
-		bytes_in_out_buffer--;
-		
-		/* Output the character via the UART */
-		UDR0 = c;
+		UDR0 = out_buffer[out_tail & OUTPUT_MASK];
+		out_tail++;
 	} else {
 		/* No data in the buffer. We disable the UART Data
 		 * Register Empty interrupt because otherwise it 
@@ -251,6 +445,7 @@ ISR(USART0_UDRE_vect)
 		 */
 		UCSR0B &= ~(1<<UDRIE0);
 	}
+	ISR_TRACE_EXIT(ISR_TRACE_PIN_SERIAL_TX);
 }
 
 /*
@@ -261,27 +456,35 @@ ISR(USART0_UDRE_vect)
 
 ISR(USART0_RX_vect) 
 {
-	/* Read the character - we ignore the possibility of overrun. */
+	ISR_TRACE_ENTER(ISR_TRACE_PIN_SERIAL_RX);
+	/* Check whether the UART itself lost a character (this happens if
+	 * interrupts were off for longer than a character time) and then
+	 * read the character. The flag must be read before UDR0.
+	 */
+	if(UCSR0A & (1<<DOR0)) {
+		stats.rx_uart_overrun++;
+		flight_record(FLIGHT_RX_OVERRUN, 1);
+	}
 	char c;
 	c = UDR0;
+	latency_stamp(INPUT_SOURCE_SERIAL);
 		
-	if(do_echo && bytes_in_out_buffer < OUTPUT_BUFFER_SIZE) {
-		/* If echoing is enabled and there is output buffer
-		 * space, echo the received character back to the UART.
-		 * (If there is no output buffer space, characters
-		 * will be lost.)
+	if(do_echo) {
+		/* If echoing is enabled, echo the received character back to
+		 * the UART. (If there is no output buffer space, the character
+		 * will be lost and counted as a transmit overrun.)
 		 */
 		uart_put_char(c, 0);
 	}
 	
 	/* 
-	 * Check if we have space in our buffer. If not, set the overrun
-	 * flag and throw away the character. (We never clear the 
-	 * overrun flag - it's up to the programmer to check/clear
-	 * this flag if desired.)
+	 * Check if we have space in our buffer. If not, count the overrun
+	 * and throw away the character.
 	 */
-	if(bytes_in_input_buffer >= INPUT_BUFFER_SIZE) {
-		input_overrun = 1;
+	uint16_t pending = input_head - input_tail;
+	if(pending >= SERIAL_INPUT_BUFFER_SIZE) {
+		stats.rx_overrun++;
+		flight_record(FLIGHT_RX_OVERRUN, 0);
 	} else {
 		/* If the character is a carriage return, turn it into a
 		 * linefeed 
@@ -293,11 +496,12 @@ ISR(USART0_RX_vect)
 		/* 
 		 * There is room in the input buffer 
 		 */
-		input_buffer[input_insert_pos++] = c;
-		bytes_in_input_buffer++;
-		if(input_insert_pos == INPUT_BUFFER_SIZE) {
-			/* Wrap around buffer pointer if necessary */
-			input_insert_pos = 0;
+		input_buffer[input_head & INPUT_MASK] = c;
+		input_head++;
+		pending++;
+		if(pending > stats.rx_high_water) {
+			stats.rx_high_water = pending;
 		}
 	}
+	ISR_TRACE_EXIT(ISR_TRACE_PIN_SERIAL_RX);
 }
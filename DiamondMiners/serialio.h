@@ -18,10 +18,35 @@
 
 #include <stdint.h>
 
+/* Buffer sizes (in characters). Each must be a power of 2, no larger
+ * than 32768. They can be overridden by defining them for the build.
+ */
+#ifndef SERIAL_OUTPUT_BUFFER_SIZE
+#define SERIAL_OUTPUT_BUFFER_SIZE 256
+#endif
+#ifndef SERIAL_INPUT_BUFFER_SIZE
+#define SERIAL_INPUT_BUFFER_SIZE 16
+#endif
+
+/* Counts of lost characters and the fullest each buffer has been
+ * (since init_serial_stdio() or serial_reset_stats())
+ */
+typedef struct {
+	uint16_t tx_overrun;		// output characters discarded (buffer full with interrupts off)
+	uint16_t tx_stalls;			// times output had to wait for space in the buffer
+	uint16_t tx_high_water;		// most characters ever waiting to be sent
+	uint16_t rx_overrun;		// input characters discarded (input buffer full)
+	uint16_t rx_uart_overrun;	// input characters lost by the UART (data overrun)
+	uint16_t rx_high_water;		// most characters ever waiting to be read
+} SerialStats;
+
 /* Initialise serial IO using the UART. baudrate specifies the desired
  * baud rate (e.g. 19200) and echo determines whether incoming characters
  * are echoed back to the UART output as they are received (zero means no
- * echo, non-zero means echo)
+ * echo, non-zero means echo). Double speed mode is used automatically if
+ * it gets closer to the requested rate, so rates up to 500000 baud can be
+ * used with the 8MHz clock (38400 is within 0.2%, 250000 and 500000
+ * are exact).
  */
 void init_serial_stdio(long baudrate, int8_t echo);
 
@@ -36,4 +61,42 @@ int8_t serial_input_available(void);
  */
 void clear_serial_input_buffer(void);
 
+/* Write len bytes from buf to the serial port without going through
+ * stdio. The bytes are copied straight into the output buffer in as few
+ * pieces as possible (no translation of \n to \r\n is done). If the
+ * buffer fills up this waits for space if interrupts are enabled, or
+ * discards the rest (counting it as a transmit overrun) if they are not.
+ */
+void serial_write(const char* buf, uint16_t len);
+
+/* As for serial_write() but writes a null terminated string stored in
+ * program memory, e.g. serial_write_P(PSTR("Hello")).
+ */
+void serial_write_P(const char* str);
+
+/* Write value as decimal digits (no leading zeros) without using printf.
+ */
+void serial_write_uint(uint16_t value);
+
+/* Write the decimal digits of value into buf (which must have room for
+ * 5 characters) and return how many were written. No terminator is added.
+ */
+uint8_t serial_format_uint(char* buf, uint16_t value);
+
+/* As for serial_write_uint() but for 32 bit values.
+ */
+void serial_write_ulong(uint32_t value);
+
+/* Return the number of characters waiting to be sent.
+ */
+uint16_t serial_output_pending(void);
+
+/* Copy the overrun and high water statistics into stats.
+ */
+void serial_get_stats(SerialStats* stats);
+
+/* Set all of the statistics back to 0.
+ */
+void serial_reset_stats(void);
+
 #endif /* SERIALIO_H_ */
\ No newline at end of file
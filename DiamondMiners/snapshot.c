@@ -0,0 +1,284 @@
+/*
+ * snapshot.c
+ *
+ * Author: Matthew Chen
+ *
+ * See snapshot.h. A snapshot is
+ *		0		SNAPSHOT_MAGIC
+ *		1		sequence number (one more than the previous copy's)
+ *		2		level
+ *		3-8		player x and y, facing x and y, bomb x and y
+ *		9		steps
+ *		10		flags (SNAPSHOT_FLAG_*)
+ *		11-12	diamonds found (low byte first)
+ *		13		0
+ *		14-141	the squares, column by column: the object in bits 0-3,
+ *				discovered in bit 4 and visible in bit 5
+ *		142-143	CRC16 of bytes 0-141 (see crc.h)
+ * The CRC is written last, so a copy that was only partly written when
+ * the power went doesn't check out. A game is finished when it has been
+ * lost or won (SNAPSHOT_FLAG_OVER). A bomb that was placed is restored
+ * with its full 2 seconds to go (play_game() starts the timer again).
+ */
+
+#include "snapshot.h"
+#include "eeprom.h"
+#include "crc.h"
+#include "game.h"
+#include "display.h"
+#include "timer0.h"
+
+#define SNAPSHOT_MAGIC		0xD5
+#define HEADER_SIZE			14
+#define CRC_POSITION		(SNAPSHOT_IMAGE_SIZE - 2)
+#define SNAPSHOT_FLAG_VISION	0x01
+#define SNAPSHOT_FLAG_OVER		0x02
+#define SQUARE_DISCOVERED	0x10
+#define SQUARE_VISIBLE		0x20
+#define SQUARE_OBJECT		0x0F
+#define NO_BOMB				UINT8_MAX
+// Bytes packed at a time
+#define SNAPSHOT_CHUNK		16
+// position when no copy is being written
+#define IDLE				0xFF
+
+#if HEADER_SIZE + WIDTH * HEIGHT + 2 != SNAPSHOT_IMAGE_SIZE
+#error SNAPSHOT_IMAGE_SIZE is wrong for the playing field size
+#endif
+#if EEPROM_SNAPSHOT_SIZE < SNAPSHOT_COPIES * SNAPSHOT_IMAGE_SIZE
+#error EEPROM_SNAPSHOT_SIZE is too small for the snapshots
+#endif
+
+static uint8_t saved_level;
+static uint16_t saved_diamonds;
+static uint8_t saved_finished;
+static uint8_t changed;
+// 1 if the next copy is started without waiting for SNAPSHOT_INTERVAL
+static uint8_t urgent;
+// When the last copy was started
+static uint32_t started_time;
+// The copy being written, how far through it is and the CRC of the bytes
+// so far
+static uint8_t copy;
+static uint8_t position = IDLE;
+static uint16_t crc;
+// Sequence number of the newest complete copy
+static uint8_t sequence;
+
+static uint16_t copy_address(uint8_t which) {
+	return EEPROM_SNAPSHOT_START + which * SNAPSHOT_IMAGE_SIZE;
+}
+
+/*
+ * Returns byte i of the snapshot of the current game (before the CRC).
+ */
+static uint8_t image_byte(uint8_t i) {
+	const GameState* state = get_game_state();
+	if (i >= HEADER_SIZE) {
+		i -= HEADER_SIZE;
+		uint8_t x = i / HEIGHT;
+		uint8_t y = i % HEIGHT;
+		uint8_t square = state->playing_field[x][y] & SQUARE_OBJECT;
+		if (state->discovered[x][y]) {
+			square |= SQUARE_DISCOVERED;
+		}
+		if (state->visible[x][y]) {
+			square |= SQUARE_VISIBLE;
+		}
+		return square;
+	}
+	switch (i) {
+		case 0:
+			return SNAPSHOT_MAGIC;
+		case 1:
+			return sequence + 1;
+		case 2:
+			return saved_level;
+		case 3:
+			return state->player_x;
+		case 4:
+			return state->player_y;
+		case 5:
+			return state->facing_x;
+		case 6:
+			return state->facing_y;
+		case 7:
+			return state->bomb_x;
+		case 8:
+			return state->bomb_y;
+		case 9:
+			return state->steps;
+		case 10:
+			return (state->vision_field_on ? SNAPSHOT_FLAG_VISION : 0)
+					| (saved_finished || state->game_over ? SNAPSHOT_FLAG_OVER : 0);
+		case 11:
+			return saved_diamonds & 0xFF;
+		case 12:
+			return saved_diamonds >> 8;
+	}
+	return 0;
+}
+
+void snapshot_save(uint8_t level, uint16_t diamonds) {
+	saved_level = level;
+	saved_diamonds = diamonds;
+	saved_finished = 0;
+	changed = 1;
+}
+
+void snapshot_save_now(uint8_t level, uint16_t diamonds) {
+	snapshot_save(level, diamonds);
+	urgent = 1;
+}
+
+void snapshot_save_finished(uint8_t level, uint16_t diamonds) {
+	snapshot_save_now(level, diamonds);
+	saved_finished = 1;
+}
+
+void snapshot_update(void) {
+	if (changed) {
+		uint32_t current_time = get_current_time();
+		if (urgent || current_time - started_time >= SNAPSHOT_INTERVAL) {
+			// Start the copy again from the beginning
+			changed = 0;
+			urgent = 0;
+			started_time = current_time;
+			position = 0;
+			crc = CRC_INIT;
+		} else {
+			// Leave the copy being written (it would mix two states) until
+			// the next one can be started
+			position = IDLE;
+			return;
+		}
+	}
+	while (position < SNAPSHOT_IMAGE_SIZE) {
+		uint8_t chunk[SNAPSHOT_CHUNK];
+		uint8_t len = eeprom_write_space();
+		if (len > SNAPSHOT_CHUNK) {
+			len = SNAPSHOT_CHUNK;
+		}
+		if (len > SNAPSHOT_IMAGE_SIZE - position) {
+			len = SNAPSHOT_IMAGE_SIZE - position;
+		}
+		if (len == 0) {
+			return;
+		}
+		for (uint8_t i = 0; i < len; i++) {
+			uint8_t n = position + i;
+			if (n < CRC_POSITION) {
+				chunk[i] = image_byte(n);
+				crc = crc_update(crc, chunk[i]);
+			} else {
+				chunk[i] = n == CRC_POSITION ? crc & 0xFF : crc >> 8;
+			}
+		}
+		eeprom_write(copy_address(copy) + position, chunk, len);
+		position += len;
+	}
+	if (position == SNAPSHOT_IMAGE_SIZE) {
+		// Done - the next one goes in the next copy
+		sequence++;
+		copy = (copy + 1) % SNAPSHOT_COPIES;
+		position = IDLE;
+	}
+}
+
+/*
+ * Reads byte i of a copy.
+ */
+static uint8_t read_byte(uint8_t which, uint8_t i) {
+	uint8_t byte;
+	eeprom_read(copy_address(which) + i, &byte, 1);
+	return byte;
+}
+
+/*
+ * Returns 1 if a copy is a whole snapshot of a game that can be carried
+ * on with.
+ */
+static uint8_t check_copy(uint8_t which, uint8_t* finished) {
+	if (read_byte(which, 0) != SNAPSHOT_MAGIC) {
+		return 0;
+	}
+	uint16_t check = crc_eeprom(copy_address(which), CRC_POSITION);
+	if ((check & 0xFF) != read_byte(which, CRC_POSITION)
+			|| (check >> 8) != read_byte(which, CRC_POSITION + 1)) {
+		return 0;
+	}
+	for (uint8_t i = HEADER_SIZE; i < CRC_POSITION; i++) {
+		if ((read_byte(which, i) & SQUARE_OBJECT) > BOMB) {
+			return 0;
+		}
+	}
+	uint8_t player_x = read_byte(which, 3);
+	uint8_t player_y = read_byte(which, 4);
+	uint8_t bomb_x = read_byte(which, 7);
+	if (read_byte(which, 2) > 1 || !in_bounds(player_x, player_y)
+			|| (bomb_x != NO_BOMB && !in_bounds(bomb_x, read_byte(which, 8)))) {
+		return 0;
+	}
+	*finished = (read_byte(which, 10) & SNAPSHOT_FLAG_OVER) != 0;
+	return 1;
+}
+
+uint8_t snapshot_restore(uint8_t* level, uint16_t* diamonds) {
+	// Carry on from the newest copy, and write over the one after it next
+	uint8_t newest = IDLE;
+	uint8_t finished = 0;
+	for (uint8_t which = 0; which < SNAPSHOT_COPIES; which++) {
+		uint8_t which_finished;
+		if (check_copy(which, &which_finished) && (newest == IDLE
+				|| (int8_t)(read_byte(which, 1) - read_byte(newest, 1)) > 0)) {
+			newest = which;
+			finished = which_finished;
+		}
+	}
+	if (newest == IDLE) {
+		return 0;
+	}
+	sequence = read_byte(newest, 1);
+	copy = (newest + 1) % SNAPSHOT_COPIES;
+	if (finished) {
+		return 0;
+	}
+
+	GameState* state = get_game_state();
+	uint8_t header[HEADER_SIZE];
+	eeprom_read(copy_address(newest), header, HEADER_SIZE);
+	for (uint8_t x = 0; x < WIDTH; x++) {
+		for (uint8_t y = 0; y < HEIGHT; y++) {
+			uint8_t square = read_byte(newest, HEADER_SIZE + x * HEIGHT + y);
+			state->playing_field[x][y] = square & SQUARE_OBJECT;
+			state->discovered[x][y] = (square & SQUARE_DISCOVERED) != 0;
+			state->visible[x][y] = (square & SQUARE_VISIBLE) != 0;
+		}
+	}
+	*level = header[2];
+	state->player_x = header[3];
+	state->player_y = header[4];
+	state->facing_x = header[5];
+	state->facing_y = header[6];
+	state->bomb_x = header[7];
+	state->bomb_y = header[8];
+	state->steps = header[9];
+	state->vision_field_on = (header[10] & SNAPSHOT_FLAG_VISION) != 0;
+	state->game_over = 0;
+	state->facing_visible = 1;
+	state->bomb_visible = 1;
+	state->game_initialised = 1;
+	*diamonds = header[11] | (header[12] << 8);
+	saved_level = *level;
+	saved_diamonds = *diamonds;
+
+	// Every square changes, so display_flush() sends the whole field at
+	// once rather than a square at a time
+	initialise_display();
+	for (uint8_t x = 0; x < WIDTH; x++) {
+		for (uint8_t y = 0; y < HEIGHT; y++) {
+			update_square_colour(x, y, get_displayed_object(x, y));
+		}
+	}
+	return 1;
+}
@@ -0,0 +1,64 @@
+/*
+ * snapshot.h
+ *
+ * Author: Matthew Chen
+ *
+ * Keeps a copy of the game in EEPROM so that a board that loses power
+ * part way through a game carries on where it was when it comes back.
+ * The snapshot is the whole game state packed into SNAPSHOT_IMAGE_SIZE
+ * bytes (one byte per square for the object and whether it has been
+ * discovered and is visible, then the positions, steps, level, diamonds
+ * found and a CRC). There are SNAPSHOT_COPIES copies that are written in
+ * turn, so losing power while one is being written leaves the others to
+ * fall back on.
+ * snapshot_save() marks the game as changed, and snapshot_update() (called
+ * from the game loop) packs a little at a time into eeprom.c's queue.
+ * Bytes that haven't changed since that copy was last written aren't
+ * written again (eeprom.c skips them), so a move only costs the few
+ * squares and positions it changed. If the game changes again before a
+ * copy is finished, the copy starts again so it never mixes two states.
+ * The sequence number and CRC change in every copy though, so to spread
+ * the wear (EEPROM cells last about 100,000 writes) a copy is started at
+ * most every SNAPSHOT_INTERVAL ms and the copies take turns. A board that
+ * loses power can lose the last few seconds of its game.
+ */
+
+#ifndef SNAPSHOT_H_
+#define SNAPSHOT_H_
+
+#include <stdint.h>
+
+#define SNAPSHOT_IMAGE_SIZE 144
+#define SNAPSHOT_COPIES 4
+#define SNAPSHOT_INTERVAL 5000
+
+/* Marks the game as changed, so it will be saved (with the level and the
+ * number of diamonds found, which aren't part of the game state) within
+ * SNAPSHOT_INTERVAL ms.
+ */
+void snapshot_save(uint8_t level, uint16_t diamonds);
+
+/* Like snapshot_save(), but starts saving straight away. For the start of
+ * a game.
+ */
+void snapshot_save_now(uint8_t level, uint16_t diamonds);
+
+/* Starts saving the game straight away, marked as finished (won or lost)
+ * so it isn't carried on with.
+ */
+void snapshot_save_finished(uint8_t level, uint16_t diamonds);
+
+/* Saves as much of the game as there is room for in the EEPROM queue.
+ * Call regularly.
+ */
+void snapshot_update(void);
+
+/* Call once at start up (with interrupts on). Finds the newest snapshot
+ * and, if it is of a game that hasn't finished, loads it into the game
+ * state, draws it (the next display_flush() sends it to the LED matrix
+ * in one update), sets level and diamonds and returns 1. Otherwise
+ * returns 0 and leaves the game state alone.
+ */
+uint8_t snapshot_restore(uint8_t* level, uint16_t* diamonds);
+
+#endif /* SNAPSHOT_H_ */
@@ -0,0 +1,251 @@
+/*
+ * sound.c
+ *
+ * Author: Matthew Chen
+ *
+ * Sequencer for the music and SFX channels. See sound.h for the
+ * priority/preemption rules.
+ * The main program only ever adds requests to a small circular buffer
+ * (it is the only writer of the head index and the timer interrupt is the
+ * only writer of the tail index) so no interrupts need to be turned off
+ * to request a sound.
+ */
+
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+
+#include "sound.h"
+#include "timer1.h"
+
+// Marks the end of the notes of an effect
+#define NOTE_END 0xFF
+
+// How many milliseconds each voice gets the buzzer for when both
+// channels are sounding at the same time (must be a power of 2)
+#define SOUND_MUX_PERIOD 4
+
+#define SOUND_QUEUE_MASK (SOUND_QUEUE_SIZE - 1)
+
+// timer1 periods (1MHz clock) for each of the NOTE_* values in timer1.h.
+// Index 0 (NO_NOTE) is unused.
+static const uint16_t note_periods[8] PROGMEM = {
+	0,
+	1000000UL / 262,	// NOTE_C
+	1000000UL / 293,	// NOTE_D
+	1000000UL / 330,	// NOTE_E
+	1000000UL / 349,	// NOTE_F
+	1000000UL / 391,	// NOTE_G
+	1000000UL / 440,	// NOTE_A
+	1000000UL / 494		// NOTE_B
+};
+
+static const uint8_t start_game_notes[] PROGMEM =
+		{NOTE_C, NOTE_D, NOTE_E, NOTE_F, NOTE_G, NO_NOTE, NOTE_C, NOTE_END};
+static const uint8_t game_over_notes[] PROGMEM =
+		{NOTE_F, NOTE_E, NO_NOTE, NOTE_A, NOTE_A, NOTE_A, NOTE_A, NOTE_END};
+static const uint8_t found_diamond_notes[] PROGMEM =
+		{NOTE_C, NOTE_E, NOTE_G, NOTE_END};
+static const uint8_t blow_bomb_notes[] PROGMEM =
+		{NOTE_A, NOTE_G, NOTE_F, NOTE_E, NOTE_D, NOTE_END};
+
+typedef struct {
+	const uint8_t* notes;	// notes (in program memory) ending with NOTE_END
+	uint8_t interval;		// milliseconds per note
+	uint8_t priority;		// higher priority effects preempt lower ones
+	uint8_t channel;		// SOUND_CHANNEL_MUSIC or SOUND_CHANNEL_SFX
+} SoundEffect;
+
+// Indexed by the SOUND_* effect numbers in sound.h
+static const SoundEffect effects[SOUND_NUM_EFFECTS] PROGMEM = {
+	{start_game_notes, 200, 0, SOUND_CHANNEL_MUSIC},
+	{game_over_notes, 150, 0, SOUND_CHANNEL_MUSIC},
+	{found_diamond_notes, 200, 1, SOUND_CHANNEL_SFX},
+	{blow_bomb_notes, 120, 2, SOUND_CHANNEL_SFX}
+};
+
+// The state of one channel
+typedef struct {
+	const uint8_t* next;	// next note to play, 0 if the channel is idle
+	uint8_t note;			// note currently sounding (NO_NOTE if resting)
+	uint8_t interval;
+	uint8_t remaining;		// milliseconds until the next note
+	uint8_t priority;
+} Voice;
+
+static Voice music;
+static Voice sfx;
+
+// Requests from the main program. Written by sound_play(), read by the ISR.
+static volatile uint8_t request_queue[SOUND_QUEUE_SIZE];
+static volatile uint8_t request_head;
+static volatile uint8_t request_tail;
+static volatile uint8_t request_dropped;
+static volatile uint8_t stop_requested;
+
+// SFX waiting for the SFX channel. Only used by the ISR.
+static uint8_t pending_queue[SOUND_QUEUE_SIZE];
+static uint8_t pending_head;
+static uint8_t pending_tail;
+static volatile uint8_t pending_dropped;
+
+// What the buzzer is currently playing and which voice has it
+static uint8_t output_note;
+static uint8_t mux_count;
+
+void init_sound(void) {
+	music.next = 0;
+	music.note = NO_NOTE;
+	sfx.next = 0;
+	sfx.note = NO_NOTE;
+	request_head = request_tail = 0;
+	pending_head = pending_tail = 0;
+	request_dropped = pending_dropped = 0;
+	stop_requested = 0;
+	output_note = NO_NOTE;
+	mux_count = 0;
+}
+
+void sound_play(uint8_t effect) {
+	uint8_t head = request_head;
+	if ((uint8_t)(head - request_tail) >= SOUND_QUEUE_SIZE) {
+		request_dropped++;
+		return;
+	}
+	request_queue[head & SOUND_QUEUE_MASK] = effect;
+	// Only publish the new head once the entry has been written
+	request_head = head + 1;
+}
+
+void sound_stop_all(void) {
+	stop_requested = 1;
+}
+
+uint8_t sound_dropped_count(void) {
+	return request_dropped + pending_dropped;
+}
+
+static void voice_start(Voice* voice, uint8_t effect) {
+	const SoundEffect* e = &effects[effect];
+	voice->next = (const uint8_t*)pgm_read_word(&e->notes);
+	voice->interval = pgm_read_byte(&e->interval);
+	voice->priority = pgm_read_byte(&e->priority);
+	voice->note = NO_NOTE;
+	voice->remaining = 0; // first note plays straight away
+}
+
+static void voice_step(Voice* voice) {
+	if (!voice->next) {
+		return;
+	}
+	if (voice->remaining) {
+		voice->remaining--;
+		return;
+	}
+	uint8_t note = pgm_read_byte(voice->next);
+	if (note == NOTE_END) {
+		voice->next = 0;
+		voice->note = NO_NOTE;
+	} else {
+		voice->note = note;
+		voice->next++;
+		voice->remaining = voice->interval - 1;
+	}
+}
+
+// Decides what happens to an SFX that wants the SFX channel. Returns 1 if
+// it was started.
+static uint8_t sfx_offer(uint8_t effect) {
+	if (!sfx.next || pgm_read_byte(&effects[effect].priority) > sfx.priority) {
+		// Channel is free, or this effect preempts the current one
+		voice_start(&sfx, effect);
+		return 1;
+	}
+	return 0;
+}
+
+void sound_tick(void) {
+	if (stop_requested) {
+		stop_requested = 0;
+		music.next = 0;
+		music.note = NO_NOTE;
+		sfx.next = 0;
+		sfx.note = NO_NOTE;
+		pending_tail = pending_head;
+		request_tail = request_head;
+	}
+
+	// Take any new requests
+	while (request_tail != request_head) {
+		uint8_t effect = request_queue[request_tail & SOUND_QUEUE_MASK];
+		request_tail++;
+		if (effect >= SOUND_NUM_EFFECTS) {
+			continue;
+		}
+		if (pgm_read_byte(&effects[effect].channel) == SOUND_CHANNEL_MUSIC) {
+			voice_start(&music, effect);
+		} else if (!sfx_offer(effect)) {
+			if ((uint8_t)(pending_head - pending_tail) >= SOUND_QUEUE_SIZE) {
+				pending_dropped++;
+			} else {
+				pending_queue[pending_head++ & SOUND_QUEUE_MASK] = effect;
+			}
+		}
+	}
+
+	// Start the next waiting SFX once the channel is free
+	if (!sfx.next && pending_tail != pending_head) {
+		voice_start(&sfx, pending_queue[pending_tail++ & SOUND_QUEUE_MASK]);
+	}
+
+	voice_step(&music);
+	voice_step(&sfx);
+
+	// Work out which note should be on the buzzer. If both channels are
+	// sounding we swap between them every SOUND_MUX_PERIOD milliseconds.
+	uint8_t note;
+	if (music.note != NO_NOTE && sfx.note != NO_NOTE) {
+		mux_count++;
+		note = (mux_count & SOUND_MUX_PERIOD) ? music.note : sfx.note;
+	} else if (sfx.note != NO_NOTE) {
+		note = sfx.note;
+	} else {
+		note = music.note;
+	}
+
+	if (note != output_note) {
+		output_note = note;
+		if (note == NO_NOTE) {
+			sound_off();
+		} else {
+			set_tone(pgm_read_word(&note_periods[note]));
+		}
+	}
+}
+
+/*
+ * Plays the C E G jingle when a diamond is found.
+ */
+void play_found_diamond() {
+	sound_play(SOUND_FOUND_DIAMOND);
+}
+
+/*
+ * Plays jingle for starting game
+ */
+void play_start_game() {
+	sound_play(SOUND_START_GAME);
+}
+
+/*
+ * Plays game over jingle.
+ */
+void play_game_over() {
+	sound_play(SOUND_GAME_OVER);
+}
+
+/*
+ * Plays blow_bomb jingle.
+ */
+void play_blow_bomb() {
+	sound_play(SOUND_BLOW_BOMB);
+}
@@ -0,0 +1,92 @@
+/*
+ * sound.h
+ *
+ * Author: Matthew Chen
+ *
+ * Two voice sound sequencer for the buzzer on OC1B.
+ * There is a music channel (longer jingles such as the start game and
+ * game over tunes) and a sound effect (SFX) channel (short effects such
+ * as finding a diamond or a bomb going off). Each effect has a priority:
+ * a higher priority effect preempts the effect currently on the SFX
+ * channel, anything else waits in a small queue until the channel is free.
+ * A new music jingle always replaces the current one.
+ * When both channels have a note sounding the output alternates between
+ * them every few milliseconds (time multiplexing), so neither one cuts
+ * the other off.
+ * All of the sequencing is done by sound_tick() which is called from the
+ * timer0 interrupt every millisecond. Notes are looked up from a
+ * precomputed table of timer1 periods so no maths is done at runtime.
+ */
+
+#ifndef SOUND_H_
+#define SOUND_H_
+
+#include <stdint.h>
+
+// Sound channels
+#define SOUND_CHANNEL_MUSIC 0
+#define SOUND_CHANNEL_SFX	1
+
+// Effects that can be played (indexes into the effect table in sound.c)
+#define SOUND_START_GAME	0
+#define SOUND_GAME_OVER		1
+#define SOUND_FOUND_DIAMOND 2
+#define SOUND_BLOW_BOMB		3
+#define SOUND_NUM_EFFECTS	4
+
+// Number of SFX that can be waiting for the SFX channel (must be a power of 2)
+#define SOUND_QUEUE_SIZE 4
+
+/*
+ * Resets both channels and the queue of pending effects.
+ * Should be called before the timer0 interrupt is enabled.
+ */
+void init_sound(void);
+
+/*
+ * Requests an effect (one of the SOUND_* effects above) to be played.
+ * This only records the request - the priority/preemption decision is
+ * made by sound_tick() in the timer interrupt. Requests made while the
+ * request queue is full are discarded.
+ */
+void sound_play(uint8_t effect);
+
+/*
+ * Stops both channels and discards anything still waiting to be played.
+ */
+void sound_stop_all(void);
+
+/*
+ * Advances the sequencer by one millisecond. Must only be called from
+ * the timer0 interrupt handler.
+ */
+void sound_tick(void);
+
+/*
+ * Returns the number of effects that were discarded because the queue
+ * was full.
+ */
+uint8_t sound_dropped_count(void);
+
+/*
+ * Sets jingle to be for when you find diamond.
+ */
+void play_found_diamond();
+
+/*
+ * Sets jingle to be for when you start game
+ */
+void play_start_game();
+
+/*
+ * Plays game over jingle.
+ */
+void play_game_over();
+
+/*
+ * Plays blow bomb jingle. (The bomb has a higher priority than finding
+ * a diamond so it will cut a diamond jingle short.)
+ */
+void play_blow_bomb();
+
+#endif /* SOUND_H_ */
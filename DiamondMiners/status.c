@@ -0,0 +1,121 @@
+/*
+ * status.c
+ *
+ * Author: Matthew Chen
+ *
+ * See status.h.
+ */
+
+#include <string.h>
+#include <avr/pgmspace.h>
+
+#include "status.h"
+#include "serialio.h"
+#include "terminalio.h"
+
+// Most bytes a cursor move can take (ESC [ yy ; xx H)
+#define CURSOR_MOVE_COST 8
+
+typedef struct {
+	uint8_t x;		// terminal column of the first character
+	uint8_t y;		// terminal row
+} StatusField;
+
+// Where each field goes (indexed by the STATUS_* field numbers)
+static const StatusField fields[STATUS_NUM_FIELDS] PROGMEM = {
+	{10, 10},	// STATUS_CHEAT_MODE
+	{10, 12}	// STATUS_DIAMONDS
+};
+
+// What each field should show and what the terminal is showing. A 0 in
+// shown means we don't know what is there.
+static char wanted[STATUS_NUM_FIELDS][STATUS_FIELD_WIDTH];
+static char shown[STATUS_NUM_FIELDS][STATUS_FIELD_WIDTH];
+// One bit per field that may need redrawing
+static uint8_t dirty;
+
+void status_init(void) {
+	memset(wanted, ' ', sizeof(wanted));
+	memset(shown, 0, sizeof(shown));
+	dirty = 0;
+}
+
+/*
+ * Copies a program memory string and then the digits of a number (if
+ * there are any) into the field, padding the rest with spaces.
+ */
+static void set_field(uint8_t field, const char* text, const char* digits,
+		uint8_t num_digits) {
+	char* dest = wanted[field];
+	uint8_t len = 0;
+	char c;
+	while (len < STATUS_FIELD_WIDTH && (c = pgm_read_byte(text++))) {
+		dest[len++] = c;
+	}
+	for (uint8_t i = 0; i < num_digits && len < STATUS_FIELD_WIDTH; i++) {
+		dest[len++] = digits[i];
+	}
+	while (len < STATUS_FIELD_WIDTH) {
+		dest[len++] = ' ';
+	}
+	dirty |= (1 << field);
+}
+
+void status_set_text_P(uint8_t field, const char* text) {
+	set_field(field, text, 0, 0);
+}
+
+void status_set_uint(uint8_t field, const char* label, uint16_t value) {
+	char digits[5];
+	set_field(field, label, digits, serial_format_uint(digits, value));
+}
+
+uint16_t status_flush(uint16_t max_bytes) {
+	// Never send more than fits in the output buffer without waiting
+	uint16_t space = SERIAL_OUTPUT_BUFFER_SIZE - serial_output_pending();
+	if (max_bytes > space) {
+		max_bytes = space;
+	}
+	uint16_t sent = 0;
+	for (uint8_t field = 0; field < STATUS_NUM_FIELDS; field++) {
+		if (!(dirty & (1 << field))) {
+			continue;
+		}
+		char* want = wanted[field];
+		char* have = shown[field];
+		uint8_t i = 0;
+		while (i < STATUS_FIELD_WIDTH) {
+			if (want[i] == have[i]) {
+				i++;
+				continue;
+			}
+			// Find the end of this run of changes. Changes separated by
+			// fewer unchanged characters than a cursor move costs are
+			// cheaper to send together.
+			uint8_t end = i + 1;
+			for (uint8_t j = end; j < STATUS_FIELD_WIDTH; j++) {
+				if (want[j] != have[j]) {
+					if (j - end >= CURSOR_MOVE_COST) {
+						break;
+					}
+					end = j + 1;
+				}
+			}
+			// Only send what fits in this frame's budget
+			if (sent + CURSOR_MOVE_COST >= max_bytes) {
+				return sent;
+			}
+			if (end - i > max_bytes - sent - CURSOR_MOVE_COST) {
+				end = i + (max_bytes - sent - CURSOR_MOVE_COST);
+			}
+			move_terminal_cursor(pgm_read_byte(&fields[field].x) + i,
+					pgm_read_byte(&fields[field].y));
+			serial_write(&want[i], end - i);
+			memcpy(&have[i], &want[i], end - i);
+			sent += CURSOR_MOVE_COST + (end - i);
+			i = end;
+		}
+		dirty &= ~(1 << field);
+	}
+	return sent;
+}
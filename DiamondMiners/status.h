@@ -0,0 +1,55 @@
+/*
+ * status.h
+ *
+ * Author: Matthew Chen
+ *
+ * Status lines on the serial terminal (cheat mode, diamond count, ...)
+ * that are only redrawn where they have changed.
+ * Each field has a fixed position and width on the terminal. Setting a
+ * field only changes a copy in RAM - status_flush() (called once per
+ * frame) compares that with what is already on the terminal and sends a
+ * cursor move plus just the characters that differ. Setting a field
+ * several times between flushes only sends the final text. Each flush
+ * sends at most a given number of bytes, and never more than there is
+ * room for in the serial output buffer, so updating the status never
+ * makes the game wait for the UART. Anything left over is sent by the
+ * next flush.
+ */
+
+#ifndef STATUS_H_
+#define STATUS_H_
+
+#include <stdint.h>
+
+// Fields (indexes into the field table in status.c)
+#define STATUS_CHEAT_MODE	0
+#define STATUS_DIAMONDS		1
+#define STATUS_NUM_FIELDS	2
+
+// Widest a field can be (longer text is cut off)
+#define STATUS_FIELD_WIDTH	20
+
+// Default number of bytes a flush may send
+#define STATUS_BYTES_PER_FRAME 32
+
+/* Forget what is on the terminal (call after the terminal has been
+ * cleared) and blank every field. The next flushes redraw everything
+ * that is set.
+ */
+void status_init(void);
+
+/* Sets a field to a string stored in program memory, e.g.
+ * status_set_text_P(STATUS_CHEAT_MODE, PSTR("CHEATMODE ENABLED"))
+ */
+void status_set_text_P(uint8_t field, const char* text);
+
+/* Sets a field to a label (in program memory) followed by a number.
+ */
+void status_set_uint(uint8_t field, const char* label, uint16_t value);
+
+/* Sends changes to the terminal, using no more than max_bytes bytes.
+ * Returns the number of bytes sent.
+ */
+uint16_t status_flush(uint16_t max_bytes);
+
+#endif /* STATUS_H_ */
@@ -0,0 +1,224 @@
+/*
+ * telemetry.c
+ *
+ * Author: Matthew Chen
+ *
+ * See telemetry.h. A record is COBS encoded as it is built, straight into
+ * one frame buffer, and then handed to serial_write() in one piece, so
+ * sending a record costs a pass over its bytes plus the CRC.
+ */
+
+#include <string.h>
+#include <avr/pgmspace.h>
+
+#include "telemetry.h"
+#include "serialio.h"
+#include "input.h"
+#include "timer0.h"
+#include "crc.h"
+
+typedef struct {
+	const char* name;
+	const char* format;
+	const char* fields;
+} RecordSchema;
+
+static const char counters_name[] PROGMEM = "counters";
+static const char counters_format[] PROGMEM = "LHHHHHH";
+static const char counters_fields[] PROGMEM =
+		"time,loops,input_ovf,tx_ovf,tx_high,rx_ovf,dropped";
+static const char event_name[] PROGMEM = "event";
+static const char event_format[] PROGMEM = "LBH";
+static const char event_fields[] PROGMEM = "time,type,arg";
+static const char histogram_name[] PROGMEM = "histogram";
+static const char histogram_format[] PROGMEM = "BH*";
+static const char histogram_fields[] PROGMEM = "id,buckets";
+static const char latency_name[] PROGMEM = "latency";
+static const char latency_format[] PROGMEM = "BHHHHH";
+static const char latency_fields[] PROGMEM = "source,count,min,p50,p99,max";
+static const char input_name[] PROGMEM = "input";
+static const char input_format[] PROGMEM = "H";
+static const char input_fields[] PROGMEM = "entry";
+static const char flight_name[] PROGMEM = "flight";
+static const char flight_format[] PROGMEM = "LBB";
+static const char flight_fields[] PROGMEM = "time,type,arg";
+
+// Layout of each record (indexed by record id, TELEMETRY_SCHEMA is unused)
+static const RecordSchema schema[TELEMETRY_NUM_RECORDS] PROGMEM = {
+	{0, 0, 0},
+	{counters_name, counters_format, counters_fields},
+	{event_name, event_format, event_fields},
+	{histogram_name, histogram_format, histogram_fields},
+	{latency_name, latency_format, latency_fields},
+	{input_name, input_format, input_fields},
+	{flight_name, flight_format, flight_fields}
+};
+
+typedef struct {
+	uint32_t time;
+	uint16_t loops;
+	uint16_t input_overflow;
+	uint16_t tx_overrun;
+	uint16_t tx_high_water;
+	uint16_t rx_overrun;
+	uint16_t dropped;
+} CountersRecord;
+
+typedef struct {
+	uint32_t time;
+	uint8_t type;
+	uint16_t arg;
+} EventRecord;
+
+// The frame being built: leading 0, COBS encoded record id, sequence
+// number, payload and CRC, then the trailing 0. Frames are always shorter
+// than 254 bytes so a COBS block never has to be split.
+static uint8_t frame[TELEMETRY_MAX_PAYLOAD + 8];
+static uint8_t frame_length;
+// Where the code byte for the current COBS block is
+static uint8_t code_position;
+
+static uint8_t enabled;
+static uint8_t sequence;
+static uint16_t dropped;
+static uint16_t loops;
+static uint32_t last_counters_time;
+
+/*
+ * COBS encodes byte into the frame.
+ */
+static void frame_put(uint8_t byte) {
+	if (byte == 0) {
+		frame[code_position] = frame_length - code_position;
+		code_position = frame_length++;
+	} else {
+		frame[frame_length++] = byte;
+	}
+}
+
+void telemetry_enable(uint8_t enable) {
+	enabled = enable;
+	if (enabled) {
+		loops = 0;
+		last_counters_time = get_current_time();
+		telemetry_send_schema();
+	}
+}
+
+uint8_t telemetry_enabled(void) {
+	return enabled;
+}
+
+/*
+ * Copies a program memory string (and its terminator) to dest if there is
+ * room for it before end. Returns the position after it.
+ */
+static uint8_t* copy_string_P(uint8_t* dest, uint8_t* end, const char* str) {
+	uint8_t len = strlen_P(str) + 1;
+	if (len > end - dest) {
+		return dest;
+	}
+	memcpy_P(dest, str, len);
+	return dest + len;
+}
+
+void telemetry_send_schema(void) {
+	uint8_t payload[TELEMETRY_MAX_PAYLOAD];
+	uint8_t* end = payload + TELEMETRY_MAX_PAYLOAD;
+	for (uint8_t id = 1; id < TELEMETRY_NUM_RECORDS; id++) {
+		uint8_t* p = payload;
+		*p++ = id;
+		p = copy_string_P(p, end, (const char*)pgm_read_word(&schema[id].name));
+		p = copy_string_P(p, end, (const char*)pgm_read_word(&schema[id].format));
+		p = copy_string_P(p, end, (const char*)pgm_read_word(&schema[id].fields));
+		// The decoder can't make sense of the other records without these
+		telemetry_send_wait(TELEMETRY_SCHEMA, payload, p - payload);
+	}
+}
+
+/*
+ * Builds the frame for a record in frame[] (and frame_length).
+ */
+static void build_frame(uint8_t record, const void* payload, uint8_t len) {
+	if (len > TELEMETRY_MAX_PAYLOAD) {
+		len = TELEMETRY_MAX_PAYLOAD;
+	}
+	frame[0] = 0;
+	code_position = 1;
+	frame_length = 2;
+	uint16_t crc = CRC_INIT;
+	crc = crc_update(crc, record);
+	frame_put(record);
+	crc = crc_update(crc, sequence);
+	frame_put(sequence);
+	const uint8_t* bytes = payload;
+	for (uint8_t i = 0; i < len; i++) {
+		crc = crc_update(crc, bytes[i]);
+		frame_put(bytes[i]);
+	}
+	frame_put(crc & 0xFF);
+	frame_put(crc >> 8);
+	// Finish the last block and end the frame
+	frame[code_position] = frame_length - code_position;
+	frame[frame_length++] = 0;
+}
+
+uint8_t telemetry_send(uint8_t record, const void* payload, uint8_t len) {
+	if (!enabled) {
+		return 0;
+	}
+	build_frame(record, payload, len);
+	// Don't make the game wait for the UART
+	if (serial_output_pending() + frame_length > SERIAL_OUTPUT_BUFFER_SIZE) {
+		dropped++;
+		return 0;
+	}
+	serial_write((const char*)frame, frame_length);
+	sequence++;
+	return 1;
+}
+
+uint8_t telemetry_send_wait(uint8_t record, const void* payload, uint8_t len) {
+	if (!enabled) {
+		return 0;
+	}
+	build_frame(record, payload, len);
+	while (serial_output_pending() + frame_length > SERIAL_OUTPUT_BUFFER_SIZE) {
+		;
+	}
+	serial_write((const char*)frame, frame_length);
+	sequence++;
+	return 1;
+}
+
+void telemetry_event(uint8_t type, uint16_t arg) {
+	EventRecord event;
+	event.time = get_current_time();
+	event.type = type;
+	event.arg = arg;
+	telemetry_send(TELEMETRY_EVENT, &event, sizeof(event));
+}
+
+void telemetry_frame(void) {
+	if (!enabled) {
+		return;
+	}
+	loops++;
+	uint32_t current_time = get_current_time();
+	if (current_time - last_counters_time < TELEMETRY_COUNTER_PERIOD) {
+		return;
+	}
+	SerialStats stats;
+	serial_get_stats(&stats);
+	CountersRecord counters;
+	counters.time = current_time;
+	counters.loops = loops;
+	counters.input_overflow = input_overflow_count();
+	counters.tx_overrun = stats.tx_overrun;
+	counters.tx_high_water = stats.tx_high_water;
+	counters.rx_overrun = stats.rx_overrun;
+	counters.dropped = dropped;
+	telemetry_send(TELEMETRY_COUNTERS, &counters, sizeof(counters));
+	loops = 0;
+	last_counters_time = current_time;
+}
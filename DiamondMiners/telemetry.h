@@ -0,0 +1,89 @@
+/*
+ * telemetry.h
+ *
+ * Author: Matthew Chen
+ *
+ * Binary telemetry records sent over the same serial port as the
+ * terminal. Each record is framed as
+ *		0x00, COBS(record id, sequence number, payload, CRC16), 0x00
+ * COBS encoding removes every 0 byte from the frame, and terminal text
+ * never contains 0 either, so a decoder can pull frames out of the stream
+ * (and pass the text through). The CRC is the CRC16 of crc.h, sent low
+ * byte first. Multi byte fields are little endian.
+ * Record layouts are described by schema records (id TELEMETRY_SCHEMA),
+ * sent whenever telemetry is turned on. The payload of a schema record is
+ * the id of the record it describes followed by three null terminated
+ * strings: the record name, the field format and the comma separated
+ * field names. Format characters are B (8 bit), H (16 bit), L (32 bit),
+ * and * (repeat the previous type until the end of the record).
+ * tools/telemetry_decode.c decodes the stream on a PC.
+ * Telemetry is off at power on. Records are only sent from the main loop
+ * (not from interrupt handlers).
+ */
+
+#ifndef TELEMETRY_H_
+#define TELEMETRY_H_
+
+#include <stdint.h>
+
+// Record ids
+#define TELEMETRY_SCHEMA		0
+#define TELEMETRY_COUNTERS		1	// periodic counters (see telemetry_frame())
+#define TELEMETRY_EVENT			2	// something happened in the game
+#define TELEMETRY_HISTOGRAM		3	// histogram id then bucket counts
+#define TELEMETRY_LATENCY		4	// input to photon latency of a source
+#define TELEMETRY_INPUT			5	// an input log entry (see input_log.h)
+#define TELEMETRY_FLIGHT		6	// a flight recorder event (see flight.h)
+#define TELEMETRY_NUM_RECORDS	7
+
+// Event types for TELEMETRY_EVENT records
+#define TELEMETRY_EVENT_GAME_START	0
+#define TELEMETRY_EVENT_DIAMOND		1	// arg is the diamond count
+#define TELEMETRY_EVENT_BOMB_PLACED 2
+#define TELEMETRY_EVENT_BOMB_BLOWN	3
+#define TELEMETRY_EVENT_GAME_OVER	4	// arg is 1 if the game was won
+#define TELEMETRY_EVENT_INPUT_LOG	5	// input log started, arg is the level
+
+// Largest payload a record can have
+#define TELEMETRY_MAX_PAYLOAD 72
+
+// How often (in milliseconds) telemetry_frame() sends the counters
+#define TELEMETRY_COUNTER_PERIOD 250
+
+/* Turn telemetry on (non-zero) or off. Turning it on sends the schema.
+ */
+void telemetry_enable(uint8_t enable);
+
+/* Returns 1 if telemetry is on.
+ */
+uint8_t telemetry_enabled(void);
+
+/* Sends a schema record for every record type. Waits for room in the
+ * serial output buffer rather than dropping any.
+ */
+void telemetry_send_schema(void);
+
+/* Sends a record with the given id and payload (len must be no more than
+ * TELEMETRY_MAX_PAYLOAD). Does nothing if telemetry is off. The record is
+ * dropped (and counted, see the counters record) rather than sent if the
+ * frame doesn't fit in the serial output buffer, so this never waits for
+ * the UART. Returns 1 if it was sent, 0 if it was dropped.
+ */
+uint8_t telemetry_send(uint8_t record, const void* payload, uint8_t len);
+
+/* Like telemetry_send(), but waits for room in the serial output buffer
+ * rather than dropping the record. For records that must get through
+ * (e.g. the schema).
+ */
+uint8_t telemetry_send_wait(uint8_t record, const void* payload, uint8_t len);
+
+/* Sends a TELEMETRY_EVENT record.
+ */
+void telemetry_event(uint8_t type, uint16_t arg);
+
+/* Call once per main loop iteration. Counts the iterations and every
+ * TELEMETRY_COUNTER_PERIOD milliseconds sends a TELEMETRY_COUNTERS record.
+ */
+void telemetry_frame(void);
+
+#endif /* TELEMETRY_H_ */
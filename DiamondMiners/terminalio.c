@@ -2,61 +2,82 @@
  * terminalio.c
  *
  * Author: Peter Sutton
+ * Modified by Matthew Chen: sequences are sent with serial_write() rather
+ * than printf
  */
 
-#include <stdio.h>
 #include <stdint.h>
 
 #include <avr/pgmspace.h>
 
 #include "terminalio.h"
+#include "serialio.h"
+
+/*
+ * Sends ESC [ followed by one or two numbers (separated by ;) and the
+ * final character of the escape sequence, in a single serial_write().
+ */
+static void write_escape(uint16_t first, uint16_t second, uint8_t numbers,
+		char final) {
+	char seq[15];
+	uint8_t len = 0;
+	seq[len++] = '\x1b';
+	seq[len++] = '[';
+	len += serial_format_uint(&seq[len], first);
+	if(numbers == 2) {
+		seq[len++] = ';';
+		len += serial_format_uint(&seq[len], second);
+	}
+	seq[len++] = final;
+	serial_write(seq, len);
+}
 
 void move_terminal_cursor(int x, int y) {
-    printf_P(PSTR("\x1b[%d;%dH"), y, x);
+	write_escape(y, x, 2, 'H');
 }
 
 void normal_display_mode(void) {
-	printf_P(PSTR("\x1b[0m"));
+	serial_write_P(PSTR("\x1b[0m"));
 }
 
 void reverse_video(void) {
-	printf_P(PSTR("\x1b[7m"));
+	serial_write_P(PSTR("\x1b[7m"));
 }
 
 void clear_terminal(void) {
-	printf_P(PSTR("\x1b[2J"));
+	serial_write_P(PSTR("\x1b[2J"));
 }
 
 void clear_to_end_of_line(void) {
-	printf_P(PSTR("\x1b[K"));
+	serial_write_P(PSTR("\x1b[K"));
 }
 
 void set_display_attribute(DisplayParameter parameter) {
-	printf_P(PSTR("\x1b[%dm"), parameter);
+	write_escape(parameter, 0, 1, 'm');
 }
 
 void hide_cursor() {
-	printf_P(PSTR("\x1b[?25l"));
+	serial_write_P(PSTR("\x1b[?25l"));
 }
 
 void show_cursor() {
-	printf_P(PSTR("\x1b[?25h"));
+	serial_write_P(PSTR("\x1b[?25h"));
 }
 
 void enable_scrolling_for_whole_display(void) {
-	printf_P(PSTR("\x1b[r"));
+	serial_write_P(PSTR("\x1b[r"));
 }
 
 void set_scroll_region(int8_t y1, int8_t y2) {
-	printf_P(PSTR("\x1b[%d;%dr"), y1, y2);
+	write_escape(y1, y2, 2, 'r');
 }
 
 void scroll_down(void) {
-	printf_P(PSTR("\x1bM"));	// ESC-M
+	serial_write_P(PSTR("\x1bM"));	// ESC-M
 }
 
 void scroll_up(void) {
-	printf_P(PSTR("\x1b\x44"));	// ESC-D
+	serial_write_P(PSTR("\x1b\x44"));	// ESC-D
 }
 
 void draw_horizontal_line(int8_t y, int8_t start_x, int8_t end_x) {
@@ -64,10 +85,7 @@ void draw_horizontal_line(int8_t y, int8_t start_x, int8_t end_x) {
 	move_terminal_cursor(start_x, y);
 	reverse_video();
 	for(i=start_x; i <= end_x; i++) {
-		printf(" ");	/* No need to use printf_P - printing 
-						 * a single character gets optimised
-						 * to a putchar call 
-						 */
+		serial_write(" ", 1);
 	}
 	normal_display_mode();
 }
@@ -77,10 +95,9 @@ void draw_vertical_line(int8_t x, int8_t start_y, int8_t end_y) {
 	move_terminal_cursor(x, start_y);
 	reverse_video();
 	for(i=start_y; i < end_y; i++) {
-		printf(" ");
-		/* Move down one and back to the left one */
-		printf_P(PSTR("\x1b[B\x1b[D"));
+		/* Print a space then move down one and back to the left one */
+		serial_write_P(PSTR(" \x1b[B\x1b[D"));
 	}
-	printf(" ");
+	serial_write(" ", 1);
 	normal_display_mode();
 }
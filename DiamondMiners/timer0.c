@@ -14,28 +14,24 @@
 #include "timer0.h"
 #include "game.h"
 #include "timer1.h"
+#include "sound.h"
+#include "buttons.h"
+#include "isr_trace.h"
 
 #define NO_SOUND_OFF UINT32_MAX
 
 /* Our internal clock tick count - incremented every 
  * millisecond. Will overflow every ~49 days. */
 static volatile uint32_t clockTicks;
+/* Game ticks (every GAME_TICK_MS milliseconds) and the milliseconds
+ * since the last one */
+static volatile uint16_t gameTicks;
+static uint8_t gameTickMs;
 /* Seven segment display values */
 uint8_t seven_seg[10] = { 63,6,91,79,102,109,125,7,127,111};
 	
 uint32_t sound_off_time = NO_SOUND_OFF;
 
-// A struct for a jingle of up to 8 notes
-struct Jingle {
-	int notes[8];
-	uint8_t play_jingle;
-	uint8_t count;
-	uint32_t interval;
-	uint32_t next_play;
-} jingle;
-
-
-
 /* Set up timer 0 to generate an interrupt every 1ms. 
  * We will divide the clock by 64 and count up to 124.
  * We will therefore get an interrupt every 64 x 125
@@ -87,16 +83,58 @@ uint32_t get_current_time(void) {
 	 */
 	uint8_t interruptsOn = bit_is_set(SREG, SREG_I);
 	cli();
+	ISR_TRACE_CLI_START(interruptsOn);
 	returnValue = clockTicks;
+	ISR_TRACE_CLI_END(interruptsOn);
 	if(interruptsOn) {
 		sei();
 	}
 	return returnValue;
 }
 
+uint16_t get_game_ticks(void) {
+	uint8_t interruptsOn = bit_is_set(SREG, SREG_I);
+	cli();
+	ISR_TRACE_CLI_START(interruptsOn);
+	uint16_t ticks = gameTicks;
+	ISR_TRACE_CLI_END(interruptsOn);
+	if(interruptsOn) {
+		sei();
+	}
+	return ticks;
+}
+
+uint16_t get_fine_time(void) {
+	uint8_t interruptsOn = bit_is_set(SREG, SREG_I);
+	cli();
+	ISR_TRACE_CLI_START(interruptsOn);
+	uint16_t ticks = clockTicks;
+	uint8_t count = TCNT0;
+	/* If the counter has just wrapped but the interrupt hasn't run yet
+	 * the millisecond count is one behind */
+	if ((TIFR0 & (1<<OCF0A)) && count < 62) {
+		ticks++;
+	}
+	ISR_TRACE_CLI_END(interruptsOn);
+	if(interruptsOn) {
+		sei();
+	}
+	/* 125 counts of 8us per millisecond */
+	return ticks * 125 + count;
+}
+
 ISR(TIMER0_COMPA_vect) {
+	ISR_TRACE_ENTER(ISR_TRACE_PIN_TIMER0);
 	/* Increment our clock tick count */
 	clockTicks++;
+	/* Count the game ticks */
+	if (++gameTickMs == GAME_TICK_MS) {
+		gameTickMs = 0;
+		gameTicks++;
+	}
+	
+	/* Button debouncing and auto repeat */
+	buttons_tick(clockTicks);
 	
 	
 	
@@ -121,49 +159,14 @@ ISR(TIMER0_COMPA_vect) {
 			sound_off_time = NO_SOUND_OFF;
 			sound_off();
 		}
-		
-		/* For playing jingles */
-		if (jingle.play_jingle == 1) {
-			if (clockTicks > jingle.next_play) {
-				if (jingle.notes[jingle.count] == -1 || jingle.count > 7) {
-					jingle.play_jingle = 0;
-					sound_off();
-				} else {
-					jingle.next_play = clockTicks + jingle.interval;	
-					switch (jingle.notes[jingle.count]) {
-						case NOTE_A:
-							play_A();
-							break;
-						case NOTE_B:
-							play_B();
-							break;
-						case NOTE_C:
-							play_C();
-							break;
-						case NOTE_D:
-							play_D();
-							break;
-						case NOTE_E:
-							play_E();
-							break;
-						case NOTE_F:
-							play_F();
-							break;
-						case NOTE_G:
-							play_G();
-							break;
-						case NO_NOTE:
-							sound_off();
-					}
-					jingle.count ++;
-				}
-			}
-		}
 	} else {
 		/* No digits displayed -  display is blank */
 		PORTC = 0;
 	}
 	
+	/* Sequence the music and sound effects */
+	sound_tick();
+	ISR_TRACE_EXIT(ISR_TRACE_PIN_TIMER0);
 }
 
 /* 
@@ -175,50 +178,3 @@ void time_till_sound_off(uint32_t time) {
 	sound_off_time = clockTicks + time;
 }
 
-
-/*
- * Sets jingle to C E and G and calls for it to be played.
- */
-void play_found_diamond() {
-	uint8_t count = 0;
-	uint8_t play_jingle = 1;
-	uint32_t interval = 200;
-	uint32_t next_play = 0;
-	jingle = (struct Jingle) {{NOTE_C, NOTE_E, NOTE_G, -1, -1, -1, -1, -1}, play_jingle, count, interval, next_play};
-	
-}
-
-/*
- * Plays jingle for starting game
- */
-void play_start_game() {
-	uint8_t count = 0;
-	uint8_t play_jingle = 1;
-	uint32_t interval = 200;
-	uint32_t next_play = 0;
-	jingle = (struct Jingle) {{NOTE_C, NOTE_D, NOTE_E, NOTE_F, NOTE_G, NO_NOTE, NOTE_C, -1}, play_jingle, count, interval, next_play};
-	
-}
-
-/*
- * Plays game over jingle.
- */
-void play_game_over() {
-	uint8_t count = 0;
-	uint8_t play_jingle = 1;
-	uint32_t interval = 150;
-	uint32_t next_play = 0;
-	jingle = (struct Jingle) {{NOTE_F, NOTE_E, NO_NOTE, NOTE_A, NOTE_A, NOTE_A, NOTE_A, -1}, play_jingle, count, interval, next_play};
-}
-
-/*
- * Plays blow_bomb jingle.
- *
- */
-void play_blow_bomb() {
-	uint8_t count = 0;
-	uint8_t play_jingle = 1;
-	uint32_t interval = 120;
-	uint32_t next_play = 0;
-	jingle = (struct Jingle) {{NOTE_A, NOTE_G, NOTE_F, NOTE_E, NOTE_D, -1, -1, -1}, play_jingle, count, interval, next_play};
-}
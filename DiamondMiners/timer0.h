@@ -30,37 +30,30 @@ void init_timer0(void);
  */
 uint32_t get_current_time(void);
 
-
 /* Author: Matthew Chen
- * Sets time at which to switch off sound.
- * Parameters:
- *		time: time in milleseconds after current time to switch sound off.
+ * Return a free running 16 bit time in units of FINE_TIME_US microseconds
+ * (made from the millisecond count and the timer 0 counter). It wraps
+ * around about every half second, so it is only useful for timing short
+ * things - take the difference of two values (as a uint16_t).
  */
-void time_till_sound_off(uint32_t time);
+#define FINE_TIME_US 8
+uint16_t get_fine_time(void);
 
-/*
- * Author: Matthew Chen
- * Sets jingle to be for when you find diamond.
- */
-void play_found_diamond();
-
-/*
- * Author: Matthew Chen
- * Sets jingle to be for when you start game
+/* Author: Matthew Chen
+ * The game is played in fixed steps (ticks) of GAME_TICK_MS milliseconds,
+ * 100 a second. Returns the number of ticks since the timer was
+ * initialised (wrapping around about every 11 minutes, so take the
+ * difference of two values as a uint16_t).
  */
-void play_start_game();
+#define GAME_TICK_MS 10
+uint16_t get_game_ticks(void);
 
-/*
- * Author: Matthew Chen
- * Plays game over jingle.
- */
-void play_game_over();
 
-/*
- * Author: Matthew Chen
- * Plays blow bomb jingle. (Will be covered over by game over jingle
- * if player incurs a game over due to bomb).
+/* Author: Matthew Chen
+ * Sets time at which to switch off sound.
+ * Parameters:
+ *		time: time in milleseconds after current time to switch sound off.
  */
-void play_blow_bomb();
+void time_till_sound_off(uint32_t time);
 
 #endif
\ No newline at end of file
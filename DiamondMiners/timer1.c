@@ -71,15 +71,21 @@ void toggle_sound() {
 }
 
 void sound_off() {
+#ifndef PROFILE
 	// Sets port to normal operation, OC1B disconnected
 	TCCR1A = 0;
 	TCCR1B = 0;
+#endif
 	
 	// Port must also be turned back to input (to prevent static sound)
 	DDRD &= ~(1<<4);
 }
 
 void sound_on() {
+#ifdef PROFILE
+	// Timer 1 is the cycle counter for profile.c
+	return;
+#endif
 	if (muted) {
 		return;
 	}
@@ -147,6 +153,19 @@ void play_sound(uint16_t f, uint16_t dc) {
 	sound_on();
 }
 
+/*
+ * Sets the buzzer to a tone with a 50% duty cycle without doing any
+ * maths. Used by the sound sequencer (from an interrupt) with periods
+ * from a precomputed table.
+ * Parameters:
+ *		period: length of one cycle in timer1 clocks (1MHz, so microseconds)
+ */
+void set_tone(uint16_t period) {
+	OCR1A = period - 1;
+	OCR1B = (period >> 1) - 1;
+	sound_on();
+}
+
 uint8_t is_muted() {
 	return muted;
 }
@@ -9,13 +9,15 @@
  * set_sound(). 
  * timer1 relies on timer0 (though unless you're modifying timer1, you don't need to worry about this.)
  * I have provided some functions to make specific pitches (so you can play simple music in C major or A natural minor)
- * as well as some specific jingles. The jingles are found in timer1.c not here though...
+ * The jingles (and the music/SFX channels that play them) are found in sound.c.
  */ 
 
 
 #ifndef TIMER1_H_
 #define TIMER1_H_
 
+#include <stdint.h>
+
 #define NO_NOTE 0
 #define NOTE_C 1
 #define NOTE_D 2
@@ -51,6 +53,13 @@ void toggle_sound();
 void set_sound(uint16_t f, uint16_t dc, uint32_t time);
 
 
+/*
+ * Plays a tone with a 50% duty cycle until sound_off() is called.
+ * Parameters:
+ *		period: length of one cycle in microseconds (timer1 counts at 1MHz)
+ */
+void set_tone(uint16_t period);
+
 /*
  * Return if sound is muted.
  */
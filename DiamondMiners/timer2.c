@@ -0,0 +1,115 @@
+/*
+ * timer2.c
+ *
+ * Author: Matthew Chen
+ *
+ * See timer2.h. Timer 2 counts at 31.25kHz (CLK/256) up to 249, so its
+ * compare interrupt comes every 8ms. Each blinker counts the interrupts
+ * through its period, turning its LED on at the start and off after
+ * on_ticks. The LEDs are set and cleared with a single instruction from
+ * the main program and an interrupt handler can't be interrupted, so the
+ * port can be shared with timer 0 (which switches A6).
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "timer2.h"
+#include "isr_trace.h"
+
+typedef struct {
+	uint16_t period;	// in ticks, 0 if not blinking
+	uint16_t on_ticks;	// ticks the LED is on each period
+	uint16_t count;		// ticks into the period
+} Blinker;
+
+static Blinker blinkers[NUM_BLINKERS];
+
+static void led_on(uint8_t blinker) {
+	if (blinker == BLINKER_DIAMOND) {
+		PORTA |= (1 << PORTA7);
+	} else {
+		PORTA |= (1 << PORTA5);
+	}
+}
+
+static void led_off(uint8_t blinker) {
+	if (blinker == BLINKER_DIAMOND) {
+		PORTA &= ~(1 << PORTA7);
+	} else {
+		PORTA &= ~(1 << PORTA5);
+	}
+}
+
+void init_timer2(void) {
+	for (uint8_t i = 0; i < NUM_BLINKERS; i++) {
+		blinkers[i].period = 0;
+		led_off(i);
+	}
+	TCNT2 = 0;
+	OCR2A = 249;
+	// Clear on compare match (CTC mode), CLK/256. The interrupt is turned
+	// on by blinker_set().
+	TCCR2A = (1 << WGM21);
+	TCCR2B = (1 << CS22) | (1 << CS21);
+	TIMSK2 &= ~(1 << OCIE2A);
+}
+
+void blinker_set(uint8_t blinker, uint16_t period, uint8_t duty) {
+	if (blinker >= NUM_BLINKERS) {
+		return;
+	}
+	uint16_t ticks = period / BLINKER_TICK_MS;
+	// The on time is worked out here so the interrupt handler only counts
+	uint16_t on_ticks = ((uint32_t)ticks * duty) / 100;
+	if (ticks == 0 || duty == 0 || on_ticks >= ticks) {
+		ticks = 0;
+	} else if (on_ticks == 0) {
+		// Too short to see, but the LED is meant to blink
+		on_ticks = 1;
+	}
+
+	uint8_t interrupts_were_on = bit_is_set(SREG, SREG_I);
+	cli();
+	ISR_TRACE_CLI_START(interrupts_were_on);
+	Blinker* b = &blinkers[blinker];
+	b->period = ticks;
+	b->on_ticks = on_ticks;
+	b->count = 0;
+	if (duty == 0) {
+		led_off(blinker);
+	} else {
+		led_on(blinker);
+	}
+	// Only interrupt while something is blinking
+	uint8_t blinking = 0;
+	for (uint8_t i = 0; i < NUM_BLINKERS; i++) {
+		blinking |= blinkers[i].period != 0;
+	}
+	if (blinking) {
+		TIMSK2 |= (1 << OCIE2A);
+	} else {
+		TIMSK2 &= ~(1 << OCIE2A);
+	}
+	ISR_TRACE_CLI_END(interrupts_were_on);
+	if (interrupts_were_on) {
+		sei();
+	}
+}
+
+ISR(TIMER2_COMPA_vect) {
+	ISR_TRACE_ENTER_A(ISR_TRACE_PIN_TIMER2);
+	for (uint8_t i = 0; i < NUM_BLINKERS; i++) {
+		Blinker* b = &blinkers[i];
+		if (b->period == 0) {
+			continue;
+		}
+		if (++b->count == b->period) {
+			b->count = 0;
+			led_on(i);
+		} else if (b->count == b->on_ticks) {
+			led_off(i);
+		}
+	}
+	ISR_TRACE_EXIT_A(ISR_TRACE_PIN_TIMER2);
+}
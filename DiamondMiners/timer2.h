@@ -0,0 +1,45 @@
+/*
+ * timer2.h
+ *
+ * Author: Matthew Chen
+ *
+ * Blinks the indicator LEDs on port A from the timer 2 compare interrupt,
+ * so the main program only has to say how fast each one blinks (when
+ * that changes) rather than toggle them itself. Each blinker has its own
+ * period and duty cycle, and runs independently of the others. The LEDs
+ * aren't on the timer's own output compare pins (OC2A and OC2B are D7
+ * and D6), so the interrupt handler switches them.
+ * Timer 2 interrupts every BLINKER_TICK_MS milliseconds, and only while
+ * a blinker is blinking (an LED that is just on or off doesn't need it).
+ */
+
+#ifndef TIMER2_H_
+#define TIMER2_H_
+
+#include <stdint.h>
+
+#define BLINKER_TICK_MS	8
+
+// The blinkers
+#define BLINKER_DIAMOND	0	// A7 - distance to the nearest diamond (cheat mode)
+#define BLINKER_DANGER	1	// A5 - the player is next to a bomb
+#define NUM_BLINKERS	2
+
+/* Sets up timer 2 with every LED off. The LED pins have to be outputs
+ * (setUpPins() in project.c).
+ */
+void init_timer2(void);
+
+/*
+ * Sets a blinker's pattern. It starts again at the beginning of a period
+ * with the LED on.
+ * Parameters:
+ *		blinker: BLINKER_*
+ *		period: length of one blink (on and off) in milliseconds, rounded
+ *				to BLINKER_TICK_MS (0 for an LED that doesn't blink)
+ *		duty: percentage of the period the LED is on (0 is off, 100 or
+ *				more is on all the time)
+ */
+void blinker_set(uint8_t blinker, uint16_t period, uint8_t duty);
+
+#endif /* TIMER2_H_ */
@@ -0,0 +1,311 @@
+/*
+ * game_fuzz.c
+ *
+ * Author: Matthew Chen
+ *
+ * Fuzz target for the game rules (DiamondMiners/game.c built for the PC,
+ * as for game_sim.c). Each input byte is one step of a game:
+ *	bits 0-2	0-3 move right, left, up, down; 4 inspect (cheat mode if
+ *				bit 3 is set); 5 place a bomb; 6 toggle field of vision;
+ *				7 let time pass
+ *	bits 3-7	for 7, how long: (value + 1) * 25ms
+ * Time passing flashes the cursor and the bomb and sets off the bomb 2
+ * seconds after it was placed, much as play_game() does. The game
+ * stops at the end of the input or when it is won or lost.
+ * After every step these must hold (otherwise the target aborts):
+ * - the player is in bounds, on an empty square, a diamond or their bomb
+ * - every visible square has been discovered
+ * - there are never more diamonds than before
+ * - the bomb is in bounds (or there is none) and every square holds a
+ *   real object
+ * - the bomb blast only changed squares of the playing field within one
+ *   square of the bomb, and didn't hide any square. A blast past the edge
+ *   of the field lands in the next column, or in visible[] just after the
+ *   field, where the guard bytes can't see it.
+ * - nothing outside the game state has been written (the state sits
+ *   between guard bytes)
+ * Reading past the edge of the field can't be seen from the state - only
+ * the libFuzzer build (with the address and undefined behaviour
+ * sanitizers) catches that.
+ * Built with clang -fsanitize=fuzzer this is a libFuzzer target
+ * (make game_fuzz_libfuzzer). Otherwise (make game_fuzz) it has its own
+ * main that runs the files given, or -n random inputs from seed -s,
+ * saving any input that fails as crash-<number>, and reports runs per
+ * second.
+ *
+ * Usage: game_fuzz [-n runs] [-s seed] [file...]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../DiamondMiners/game.h"
+
+#define NO_BOMB UINT8_MAX
+#define BOMB_DELAY 2000			// ms, as in play_game()
+#define FLASH_INTERVAL 500		// ms
+#define TIME_STEP 25			// ms
+#define GUARD_SIZE 64
+#define GUARD_BYTE 0xA5
+
+static struct {
+	uint8_t before[GUARD_SIZE];
+	GameState state;
+	uint8_t after[GUARD_SIZE];
+} arena;
+
+// The input being run and how far through it we are (for failure reports)
+static const uint8_t* input;
+static size_t input_size;
+static size_t position;
+
+void initialise_display(void) {
+}
+
+void update_square_colour(uint8_t x, uint8_t y, uint16_t object) {
+	(void)x;
+	(void)y;
+	(void)object;
+}
+
+void play_found_diamond(void) {
+}
+
+#ifndef FUZZ_LIBFUZZER
+static unsigned long run_number;
+
+static void save_input(void) {
+	char name[32];
+	snprintf(name, sizeof(name), "crash-%lu", run_number);
+	FILE* f = fopen(name, "wb");
+	if (f) {
+		fwrite(input, 1, input_size, f);
+		fclose(f);
+		fprintf(stderr, "input saved as %s\n", name);
+	}
+}
+#endif
+
+static void fail(const char* what) {
+	fprintf(stderr, "game_fuzz: %s after step %zu of %zu\n", what, position,
+			input_size);
+#ifndef FUZZ_LIBFUZZER
+	save_input();
+#endif
+	abort();
+}
+
+/*
+ * Checks the invariants and returns the number of diamonds.
+ */
+static uint16_t check_invariants(uint16_t diamonds_before) {
+	static uint8_t guard[GUARD_SIZE];
+	if (guard[0] != GUARD_BYTE) {
+		memset(guard, GUARD_BYTE, GUARD_SIZE);
+	}
+	if (memcmp(arena.before, guard, GUARD_SIZE) != 0
+			|| memcmp(arena.after, guard, GUARD_SIZE) != 0) {
+		fail("memory outside the game state written");
+	}
+	const GameState* s = &arena.state;
+	if (!in_bounds(s->player_x, s->player_y)) {
+		fail("player out of bounds");
+	}
+	uint8_t under_player = get_object_at(s->player_x, s->player_y);
+	if (under_player != EMPTY_SQUARE && under_player != DIAMOND
+			&& !(under_player == BOMB && s->bomb_x == s->player_x
+			&& s->bomb_y == s->player_y)) {
+		fail("player on a square they can't be on");
+	}
+	if ((s->bomb_x == NO_BOMB) != (s->bomb_y == NO_BOMB)
+			|| (s->bomb_x != NO_BOMB && !in_bounds(s->bomb_x, s->bomb_y))) {
+		fail("bomb out of bounds");
+	}
+	// Simple loops over the squares so the compiler can vectorise them
+	// (this runs after every step)
+	const uint8_t* visible = &s->visible[0][0];
+	const uint8_t* discovered = &s->discovered[0][0];
+	const uint16_t* field = &s->playing_field[0][0];
+	uint8_t undiscovered_visible = 0;
+	for (int i = 0; i < WIDTH * HEIGHT; i++) {
+		undiscovered_visible |= visible[i] & (discovered[i] == 0);
+	}
+	uint16_t diamonds = 0;
+	for (int i = 0; i < WIDTH * HEIGHT; i++) {
+		diamonds += field[i] == DIAMOND;
+	}
+	// Anything other than empty, breakable, unbreakable, diamond,
+	// discovered breakable or bomb
+	uint8_t bad_objects = 0;
+	for (int i = 0; i < WIDTH * HEIGHT; i++) {
+		bad_objects |= (field[i] > BOMB) | (field[i] == PLAYER)
+				| (field[i] == FACING) | (field[i] == UNDISCOVERED);
+	}
+	if (undiscovered_visible) {
+		fail("visible square not discovered");
+	}
+	if (bad_objects) {
+		fail("square holds something that isn't an object");
+	}
+	if (diamonds > diamonds_before) {
+		fail("diamond count went up");
+	}
+	return diamonds;
+}
+
+/*
+ * Sets off the bomb and checks that the blast stayed within its range.
+ */
+static void blow_bomb_checked(void) {
+	const GameState* s = &arena.state;
+	GameState before = *s;
+	blow_bomb();
+	for (uint8_t x = 0; x < WIDTH; x++) {
+		for (uint8_t y = 0; y < HEIGHT; y++) {
+			int distance = abs(x - before.bomb_x) + abs(y - before.bomb_y);
+			if (s->playing_field[x][y] != before.playing_field[x][y]
+					&& distance > 1) {
+				fail("bomb blast changed a square out of its range");
+			}
+			if ((before.visible[x][y] && !s->visible[x][y])
+					|| (before.discovered[x][y] && !s->discovered[x][y])) {
+				fail("bomb blast hid a square");
+			}
+		}
+	}
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+	input = data;
+	input_size = size;
+	memset(arena.before, GUARD_BYTE, GUARD_SIZE);
+	memset(arena.after, GUARD_BYTE, GUARD_SIZE);
+	use_game_state(&arena.state);
+	// The level is the first byte's top bit, so both get fuzzed
+	initialise_game(size > 0 ? data[0] >> 7 : 0);
+
+	uint32_t now = 0;
+	uint32_t last_flash_time = 0;
+	uint32_t bomb_time = 0;
+	uint16_t diamonds = check_invariants(UINT16_MAX);
+	for (position = 0; position < size; position++) {
+		uint8_t op = data[position] & 7;
+		uint8_t arg = data[position] >> 3;
+		if (op <= 3) {
+			static const int8_t dx[] = {1, -1, 0, 0};
+			static const int8_t dy[] = {0, 0, 1, -1};
+			move_player(dx[op], dy[op]);
+			if (!is_game_won()) {
+				check_diamond();
+			}
+		} else if (op == 4) {
+			inspect_wall(arg & 1);
+		} else if (op == 5) {
+			if (place_bomb()) {
+				bomb_time = now + BOMB_DELAY;
+			}
+		} else if (op == 6) {
+			toggle_field_of_vision();
+		} else {
+			for (uint8_t step = 0; step <= arg && !is_game_over(); step++) {
+				now += TIME_STEP;
+				if (now >= last_flash_time + FLASH_INTERVAL) {
+					flash_facing();
+					last_flash_time = now;
+				}
+				if (bomb_active()) {
+					if (now >= bomb_time) {
+						blow_bomb_checked();
+					}
+					if (now >= bomb_time + 50) {
+						bomb_animation_middle();
+					}
+					if (now >= bomb_time + 100) {
+						bomb_animation_end();
+					} else if (now % FLASH_INTERVAL == 0) {
+						flash_bomb();
+					}
+				}
+			}
+		}
+		diamonds = check_invariants(diamonds);
+		if (is_game_over() || is_game_won()) {
+			break;
+		}
+	}
+	return 0;
+}
+
+#ifndef FUZZ_LIBFUZZER
+
+/*
+ * Runs one input from a file.
+ */
+static int run_file(const char* path) {
+	FILE* f = fopen(path, "rb");
+	if (f == NULL) {
+		perror(path);
+		return 1;
+	}
+	uint8_t data[65536];
+	size_t size = fread(data, 1, sizeof(data), f);
+	fclose(f);
+	LLVMFuzzerTestOneInput(data, size);
+	return 0;
+}
+
+static uint64_t next_random(uint64_t* state) {
+	uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+int main(int argc, char** argv) {
+	unsigned long runs = 1000000;
+	uint64_t seed = 1;
+	int opt;
+	while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+		switch (opt) {
+			case 'n':
+				runs = strtoul(optarg, NULL, 10);
+				break;
+			case 's':
+				seed = strtoull(optarg, NULL, 10);
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-n runs] [-s seed] [file...]\n",
+						argv[0]);
+				return 2;
+		}
+	}
+	if (optind < argc) {
+		int result = 0;
+		for (int i = optind; i < argc; i++) {
+			result |= run_file(argv[i]);
+		}
+		return result;
+	}
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	uint8_t data[512];
+	for (run_number = 0; run_number < runs; run_number++) {
+		size_t size = next_random(&seed) % sizeof(data);
+		for (size_t i = 0; i < size; i++) {
+			data[i] = next_random(&seed);
+		}
+		LLVMFuzzerTestOneInput(data, size);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double seconds = (end.tv_sec - start.tv_sec)
+			+ (end.tv_nsec - start.tv_nsec) / 1e9;
+	printf("%lu runs in %.2fs: %.0f runs/s\n", runs, seconds,
+			seconds > 0 ? runs / seconds : 0);
+	return 0;
+}
+
+#endif /* FUZZ_LIBFUZZER */
@@ -0,0 +1,344 @@
+/*
+ * game_replay.c
+ *
+ * Author: Matthew Chen
+ *
+ * Replays input logs (see DiamondMiners/input_log.h) through the game
+ * rules on a PC (DiamondMiners/game.c built for the host, as for
+ * game_sim.c), handling each action the way play_game_tick() does: cheat
+ * mode changes what inspect shows, a bomb goes off 2 seconds after it is
+ * placed and the cursor and bomb flash. Time goes a game tick
+ * (GAME_TICK_MS) at a time, and each action is handled in the tick it was
+ * recorded in, before the timers. No time passes while the game is paused
+ * (the tick it is paused in skips the timers, as on the board).
+ * It reads either the output of the !i command (a "level N entries N
+ * dropped N" line then the entries in hex) or the output of
+ * telemetry_decode (each "event" record of type TELEMETRY_EVENT_INPUT_LOG
+ * starts a log, then "input entry=N" records), from the files given or
+ * standard input. For each log it prints how the game ended, the steps
+ * taken, the diamonds left, how long it took and the number of LED
+ * matrix pixels drawn and SPI bytes that would have been sent (3 bytes a
+ * pixel), so two builds of the rules can be compared on the same game.
+ *
+ * Usage: game_replay [-v] [file...]
+ */
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../DiamondMiners/game.h"
+#include "../DiamondMiners/input_log.h"
+#include "../DiamondMiners/telemetry.h"
+#include "../DiamondMiners/timer0.h"
+
+#define MAX_ENTRIES 65536
+#define NO_BOMB UINT32_MAX
+#define BOMB_DELAY 2000			// ms, as in play_game_tick()
+#define FLASH_INTERVAL 500		// ms
+#define SPI_BYTES_PER_PIXEL 3	// see ledmatrix_update_pixel()
+// How long to keep going after the last entry (for a bomb to go off)
+#define RUN_ON_TIME (BOMB_DELAY + 200)
+
+typedef struct {
+	int level;
+	uint32_t length;
+	uint16_t entries[MAX_ENTRIES];
+} InputLog;
+
+static GameState state;
+static unsigned long pixels;
+static int verbose;
+
+void initialise_display(void) {
+}
+
+void update_square_colour(uint8_t x, uint8_t y, uint16_t object) {
+	(void)object;
+	if (x < WIDTH && y < HEIGHT) {
+		pixels++;
+	}
+}
+
+void play_found_diamond(void) {
+}
+
+static uint16_t count_diamonds(void) {
+	uint16_t diamonds = 0;
+	for (int x = 0; x < WIDTH; x++) {
+		for (int y = 0; y < HEIGHT; y++) {
+			diamonds += state.playing_field[x][y] == DIAMOND;
+		}
+	}
+	return diamonds;
+}
+
+/*
+ * Replays one log and prints the result.
+ */
+static void replay(const InputLog* log) {
+	use_game_state(&state);
+	pixels = 0;
+	initialise_game(log->level);
+	uint8_t cheat_mode = 0;
+	uint8_t paused = 0;
+	uint32_t last_flash_time = 0;
+	uint32_t bomb_time = NO_BOMB;
+	uint16_t bomb_flash_interval = 600;
+	uint16_t found = 0;
+	uint32_t due = 0;			// tick of the last entry taken
+	uint32_t position = 0;
+	uint32_t tick = 0;
+	uint32_t now = 0;			// game time (ms)
+	while (!is_game_over() && !is_game_won()) {
+		if (position >= log->length && (paused
+				|| (tick - due) * GAME_TICK_MS > RUN_ON_TIME)) {
+			break;
+		}
+		tick++;
+		now += GAME_TICK_MS;
+		// Actions recorded in this tick. Any the game was paused for
+		// have this tick too.
+		uint8_t paused_this_tick = 0;
+		while (position < log->length
+				&& due + (log->entries[position] & INPUT_LOG_MAX_DELTA) <= tick) {
+			uint16_t entry = log->entries[position++];
+			due += entry & INPUT_LOG_MAX_DELTA;
+			uint8_t action = entry >> INPUT_LOG_ACTION_SHIFT;
+			if (verbose && action != INPUT_LOG_GAP) {
+				printf("%6u ms (tick %u): action %u\n", (unsigned)now,
+						(unsigned)tick, action);
+			}
+			if (paused) {
+				// Everything but unpausing is thrown away
+				if (action == INPUT_PAUSE) {
+					paused = 0;
+				}
+				continue;
+			}
+			int8_t dx = 0;
+			int8_t dy = 0;
+			switch (action) {
+				case INPUT_MOVE_RIGHT:
+					dx = 1;
+					break;
+				case INPUT_MOVE_DOWN:
+					dy = -1;
+					break;
+				case INPUT_MOVE_UP:
+					dy = 1;
+					break;
+				case INPUT_MOVE_LEFT:
+					dx = -1;
+					break;
+				case INPUT_INSPECT:
+					inspect_wall(cheat_mode);
+					break;
+				case INPUT_CHEAT:
+					cheat_mode = !cheat_mode;
+					break;
+				case INPUT_BOMB:
+					if (place_bomb() == 1) {
+						bomb_time = now + BOMB_DELAY;
+					}
+					break;
+				case INPUT_PAUSE:
+					paused = 1;
+					paused_this_tick = 1;
+					break;
+				case INPUT_VISION:
+					toggle_field_of_vision();
+					break;
+			}
+			if (dx != 0 || dy != 0) {
+				move_player(dx, dy);
+				if (is_game_won()) {
+					break;
+				}
+				if (check_diamond() == 1) {
+					found++;
+				}
+			}
+		}
+		if (paused || paused_this_tick || is_game_won()) {
+			continue;
+		}
+		// The timers, as in play_game_tick()
+		if (now >= last_flash_time + FLASH_INTERVAL) {
+			flash_facing();
+			last_flash_time = now;
+		}
+		if (bomb_active()) {
+			if (now >= bomb_time) {
+				blow_bomb();
+			}
+			if (now >= bomb_time + 50) {
+				bomb_animation_middle();
+			}
+			if (now >= bomb_time + 100) {
+				bomb_animation_end();
+				bomb_flash_interval = 600;
+				bomb_time = NO_BOMB;
+			}
+			if (now >= bomb_time - bomb_flash_interval) {
+				if (bomb_flash_interval > 75) {
+					bomb_flash_interval /= 1.5;
+				}
+				flash_bomb();
+			}
+		}
+	}
+	const char* result = is_game_won() ? "won"
+			: is_game_over() ? "lost" : "not finished";
+	printf("level %d: %s, %u steps, %u diamonds found (%u left), %u ms, "
+			"%lu pixels (%lu SPI bytes)", log->level, result, get_steps(),
+			found, count_diamonds(), (unsigned)now, pixels,
+			pixels * SPI_BYTES_PER_PIXEL);
+	if (position < log->length) {
+		printf(", %u entries not used", (unsigned)(log->length - position));
+	}
+	printf("\n");
+}
+
+/*
+ * Removes terminal escape sequences (ESC [ ... letter) from a line.
+ */
+static void strip_escapes(char* line) {
+	char* out = line;
+	for (char* in = line; *in; in++) {
+		if (*in == '\x1b') {
+			if (in[1] == '[') {
+				in += 2;
+				while (*in && !isalpha((unsigned char)*in)) {
+					in++;
+				}
+			}
+			if (*in == '\0') {
+				break;
+			}
+			continue;
+		}
+		*out++ = *in;
+	}
+	*out = '\0';
+}
+
+static void add_entry(InputLog* log, unsigned long entry) {
+	if (log->level >= 0 && log->length < MAX_ENTRIES) {
+		log->entries[log->length++] = entry;
+	}
+}
+
+/*
+ * Returns 1 if the line is only entries (groups of 4 hex digits).
+ */
+static int is_entry_line(const char* line) {
+	int words = 0;
+	while (*line) {
+		if (isspace((unsigned char)*line)) {
+			line++;
+			continue;
+		}
+		for (int i = 0; i < 4; i++) {
+			if (!isxdigit((unsigned char)line[i])) {
+				return 0;
+			}
+		}
+		if (line[4] != '\0' && !isspace((unsigned char)line[4])) {
+			return 0;
+		}
+		line += 4;
+		words++;
+	}
+	return words > 0;
+}
+
+/*
+ * Starts a new log (replaying the one before, if there was one).
+ */
+static void start_log(InputLog* log, int level) {
+	if (log->level >= 0) {
+		replay(log);
+	}
+	log->level = level;
+	log->length = 0;
+}
+
+/*
+ * Reads logs from a file, replaying each one once the next starts (or the
+ * file ends).
+ */
+static void read_logs(FILE* f, InputLog* log) {
+	char line[1024];
+	log->level = -1;
+	log->length = 0;
+	while (fgets(line, sizeof(line), f)) {
+		strip_escapes(line);
+		char* start = line;
+		while (isspace((unsigned char)*start)) {
+			start++;
+		}
+		int level;
+		unsigned dropped, type, arg;
+		unsigned long entry;
+		if (sscanf(start, "level %d entries %*u dropped %u", &level,
+				&dropped) == 2) {
+			if (dropped > 0) {
+				fprintf(stderr, "level %d log is missing %u entries (the "
+						"log was full)\n", level, dropped);
+			}
+			start_log(log, level);
+		} else if (sscanf(start, "event time=%*u type=%u arg=%u", &type,
+				&arg) == 2) {
+			if (type == TELEMETRY_EVENT_INPUT_LOG) {
+				start_log(log, arg);
+			}
+		} else if (sscanf(start, "input entry=%lu", &entry) == 1) {
+			add_entry(log, entry);
+		} else if (is_entry_line(start)) {
+			char* p = start;
+			char* end;
+			while ((entry = strtoul(p, &end, 16)), end != p) {
+				add_entry(log, entry);
+				p = end;
+			}
+		}
+	}
+	if (log->level >= 0) {
+		replay(log);
+	}
+}
+
+int main(int argc, char** argv) {
+	int opt;
+	while ((opt = getopt(argc, argv, "v")) != -1) {
+		switch (opt) {
+			case 'v':
+				verbose = 1;
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-v] [file...]\n", argv[0]);
+				return 2;
+		}
+	}
+	static InputLog log;
+	if (optind == argc) {
+		read_logs(stdin, &log);
+		return 0;
+	}
+	int result = 0;
+	for (int i = optind; i < argc; i++) {
+		FILE* f = fopen(argv[i], "r");
+		if (f == NULL) {
+			perror(argv[i]);
+			result = 1;
+			continue;
+		}
+		read_logs(f, &log);
+		fclose(f);
+	}
+	return result;
+}
@@ -0,0 +1,461 @@
+/*
+ * game_sim.c
+ *
+ * Author: Matthew Chen
+ *
+ * Plays lots of games of Diamond Miners on a PC, using the game's own
+ * rules (DiamondMiners/game.c built for the host), to see how hard each
+ * level is and to give the rules a workout. Each worker thread plays
+ * games on its own GameState. The display and sound functions game.c
+ * calls do nothing here.
+ * A game goes in ticks. Each tick the agent picks one action (a move, a
+ * bomb or nothing) and a bomb goes off -b ticks after it is placed (the
+ * board's 2 seconds is about 8 moves). A game ends when it is won, the
+ * player is blown up or it has gone on for -m ticks.
+ * Agents:
+ *	random	moves at random, sometimes placing a bomb
+ *	greedy	walks to the nearest diamond (then to the right hand side),
+ *			bombing the breakable walls in the way and getting out of range
+ * Every game is seeded from -s and its number, so the results don't
+ * depend on the number of threads.
+ * For each level and agent it prints the win, death and time out rates,
+ * the ticks taken by the games that were won (10th, 50th and 90th
+ * percentile and maximum) and the average diamonds and bombs per game,
+ * then the number of games played per second.
+ *
+ * Usage: game_sim [-a agent] [-b ticks] [-g games] [-j threads] [-l level]
+ *		[-m ticks] [-s seed]
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../DiamondMiners/game.h"
+
+#define NUM_LEVELS 2
+#define NO_BOMB UINT8_MAX
+
+// Actions an agent can take in a tick
+#define ACTION_NONE		0
+#define ACTION_RIGHT	1
+#define ACTION_LEFT		2
+#define ACTION_UP		3
+#define ACTION_DOWN		4
+#define ACTION_BOMB		5
+
+static const int8_t action_dx[] = {0, 1, -1, 0, 0};
+static const int8_t action_dy[] = {0, 0, 0, 1, -1};
+
+// What happened in a game
+#define RESULT_WON		0
+#define RESULT_DIED		1
+#define RESULT_TIMEOUT	2
+
+typedef struct {
+	GameState state;
+	uint64_t rng;
+	uint32_t tick;
+	uint32_t bomb_tick;		// when the bomb goes off
+} Game;
+
+typedef uint8_t (*Agent)(Game* g);
+
+typedef struct {
+	uint64_t games;
+	uint64_t results[3];
+	uint64_t diamonds;
+	uint64_t bombs;
+	uint64_t* win_ticks;	// number of games won in each number of ticks
+} Stats;
+
+typedef struct {
+	uint8_t level;
+	Agent agent;
+	Stats* stats;
+	atomic_uint_fast64_t* next_game;
+} Job;
+
+static uint64_t games_per_job = 100000;
+static uint32_t bomb_ticks = 8;
+static uint32_t max_ticks = 1000;
+static uint64_t seed = 1;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * The display and sound aren't needed to play the game.
+ */
+void initialise_display(void) {
+}
+
+void update_square_colour(uint8_t x, uint8_t y, uint16_t object) {
+	(void)x;
+	(void)y;
+	(void)object;
+}
+
+void play_found_diamond(void) {
+}
+
+/*
+ * splitmix64: a good enough, fast random number generator.
+ */
+static uint64_t next_random(uint64_t* state) {
+	uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+static uint8_t random_agent(Game* g) {
+	uint8_t roll = next_random(&g->rng) % 20;
+	if (roll == 0) {
+		return ACTION_BOMB;
+	}
+	if (roll == 1) {
+		return ACTION_NONE;
+	}
+	return ACTION_RIGHT + roll % 4;
+}
+
+static int passable(uint8_t x, uint8_t y) {
+	uint8_t object = get_object_at(x, y);
+	return object == EMPTY_SQUARE || object == DIAMOND;
+}
+
+static int breakable(uint8_t x, uint8_t y) {
+	uint8_t object = get_object_at(x, y);
+	return object == BREAKABLE || object == DISCOVERED_BREAKABLE;
+}
+
+static int any_diamonds(void) {
+	for (uint8_t x = 0; x < WIDTH; x++) {
+		for (uint8_t y = 0; y < HEIGHT; y++) {
+			if (get_object_at(x, y) == DIAMOND) {
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+#define GOAL_DIAMOND	0	// the nearest diamond
+#define GOAL_EXIT		1	// the right hand side
+#define GOAL_SAFE		2	// out of range of the bomb
+
+static int is_goal(const GameState* s, int goal, uint8_t x, uint8_t y) {
+	switch (goal) {
+		case GOAL_DIAMOND:
+			return get_object_at(x, y) == DIAMOND;
+		case GOAL_EXIT:
+			return x == WIDTH - 1;
+		default:
+			return abs(x - s->bomb_x) + abs(y - s->bomb_y) > 1;
+	}
+}
+
+/*
+ * Breadth first search from the player to the nearest goal square,
+ * through passable squares (and breakable walls if through_walls is set).
+ * The directions are tried starting from a random one, so the agent
+ * doesn't always take the same one of several equally short paths.
+ * Returns the path length (0 if the player is on a goal, -1 if there's no
+ * way there) and fills in path[0..length] with the squares (x*HEIGHT+y)
+ * from the player to the goal.
+ */
+static int find_path(Game* g, int goal, int through_walls, uint8_t* path) {
+	const GameState* s = &g->state;
+	uint8_t first = next_random(&g->rng) % 4;
+	int8_t came_from[WIDTH * HEIGHT];
+	uint8_t queue[WIDTH * HEIGHT];
+	memset(came_from, -1, sizeof(came_from));
+	uint8_t start = s->player_x * HEIGHT + s->player_y;
+	int head = 0, tail = 0;
+	queue[tail++] = start;
+	came_from[start] = ACTION_NONE;
+	while (head < tail) {
+		uint8_t square = queue[head++];
+		uint8_t x = square / HEIGHT;
+		uint8_t y = square % HEIGHT;
+		if (is_goal(s, goal, x, y)) {
+			// Follow the moves back to the start
+			int length = 0;
+			for (uint8_t back = square; back != start; length++) {
+				uint8_t action = came_from[back];
+				back = (back / HEIGHT - action_dx[action]) * HEIGHT
+						+ back % HEIGHT - action_dy[action];
+			}
+			for (int i = length; i >= 0; i--) {
+				path[i] = square;
+				uint8_t action = came_from[square];
+				square = (square / HEIGHT - action_dx[action]) * HEIGHT
+						+ square % HEIGHT - action_dy[action];
+			}
+			return length;
+		}
+		for (uint8_t i = 0; i < 4; i++) {
+			uint8_t action = ACTION_RIGHT + (first + i) % 4;
+			uint8_t nx = x + action_dx[action];
+			uint8_t ny = y + action_dy[action];
+			if (!in_bounds(nx, ny) || came_from[nx * HEIGHT + ny] >= 0) {
+				continue;
+			}
+			if (passable(nx, ny) || (through_walls && breakable(nx, ny))) {
+				came_from[nx * HEIGHT + ny] = action;
+				queue[tail++] = nx * HEIGHT + ny;
+			}
+		}
+	}
+	return -1;
+}
+
+/*
+ * Returns the move from square to the next square.
+ */
+static uint8_t step_towards(uint8_t from, uint8_t to) {
+	int dx = to / HEIGHT - from / HEIGHT;
+	int dy = to % HEIGHT - from % HEIGHT;
+	for (uint8_t action = ACTION_RIGHT; action <= ACTION_DOWN; action++) {
+		if (action_dx[action] == dx && action_dy[action] == dy) {
+			return action;
+		}
+	}
+	return ACTION_NONE;
+}
+
+static uint8_t greedy_agent(Game* g) {
+	uint8_t path[WIDTH * HEIGHT];
+	if (bomb_active()) {
+		// Get out of range and wait for it to go off
+		if (find_path(g, GOAL_SAFE, 0, path) > 0) {
+			return step_towards(path[0], path[1]);
+		}
+		return ACTION_NONE;
+	}
+	int goal = any_diamonds() ? GOAL_DIAMOND : GOAL_EXIT;
+	int length = find_path(g, goal, 0, path);
+	if (length > 0) {
+		return step_towards(path[0], path[1]);
+	}
+	length = find_path(g, goal, 1, path);
+	if (length > 0) {
+		// Walk up to the first wall in the way and bomb it
+		for (int i = 1; i <= length; i++) {
+			if (breakable(path[i] / HEIGHT, path[i] % HEIGHT)) {
+				if (i == 1) {
+					return ACTION_BOMB;
+				}
+				return step_towards(path[0], path[1]);
+			}
+		}
+	}
+	return random_agent(g);
+}
+
+static const struct {
+	const char* name;
+	Agent agent;
+} agents[] = {
+	{"random", random_agent},
+	{"greedy", greedy_agent},
+};
+#define NUM_AGENTS (sizeof(agents) / sizeof(agents[0]))
+
+/*
+ * Plays one game, adding the result to stats.
+ */
+static void play(Game* g, uint8_t level, Agent agent, Stats* stats) {
+	use_game_state(&g->state);
+	initialise_game(level);
+	g->tick = 0;
+	g->bomb_tick = 0;
+	uint8_t result = RESULT_TIMEOUT;
+	while (g->tick < max_ticks) {
+		g->tick++;
+		uint8_t action = agent(g);
+		if (action == ACTION_BOMB) {
+			if (place_bomb()) {
+				g->bomb_tick = g->tick + bomb_ticks;
+				stats->bombs++;
+			}
+		} else if (action != ACTION_NONE) {
+			move_player(action_dx[action], action_dy[action]);
+			stats->diamonds += check_diamond();
+			if (is_game_won()) {
+				result = RESULT_WON;
+				break;
+			}
+		}
+		if (bomb_active() && g->tick >= g->bomb_tick) {
+			blow_bomb();
+			bomb_animation_end();
+			if (is_game_over()) {
+				result = RESULT_DIED;
+				break;
+			}
+		}
+	}
+	stats->games++;
+	stats->results[result]++;
+	if (result == RESULT_WON) {
+		stats->win_ticks[g->tick]++;
+	}
+}
+
+static void* worker(void* arg) {
+	Job* job = arg;
+	Stats stats;
+	memset(&stats, 0, sizeof(stats));
+	stats.win_ticks = calloc(max_ticks + 1, sizeof(uint64_t));
+	Game* g = malloc(sizeof(Game));
+	if (stats.win_ticks == NULL || g == NULL) {
+		perror("game_sim");
+		exit(1);
+	}
+	uint64_t n;
+	while ((n = atomic_fetch_add(job->next_game, 1)) < games_per_job) {
+		g->rng = seed ^ (n * 0xD1B54A32D192ED03ULL) ^ ((uint64_t)job->level << 56);
+		play(g, job->level, job->agent, &stats);
+	}
+	pthread_mutex_lock(&stats_lock);
+	job->stats->games += stats.games;
+	for (int i = 0; i < 3; i++) {
+		job->stats->results[i] += stats.results[i];
+	}
+	job->stats->diamonds += stats.diamonds;
+	job->stats->bombs += stats.bombs;
+	for (uint32_t t = 0; t <= max_ticks; t++) {
+		job->stats->win_ticks[t] += stats.win_ticks[t];
+	}
+	pthread_mutex_unlock(&stats_lock);
+	free(stats.win_ticks);
+	free(g);
+	return NULL;
+}
+
+/*
+ * Returns the number of ticks by which fraction of the won games were won.
+ */
+static uint32_t percentile(const Stats* stats, double fraction) {
+	uint64_t wanted = (uint64_t)(fraction * stats->results[RESULT_WON]);
+	uint64_t seen = 0;
+	for (uint32_t t = 0; t <= max_ticks; t++) {
+		seen += stats->win_ticks[t];
+		if (seen > wanted) {
+			return t;
+		}
+	}
+	return max_ticks;
+}
+
+static void print_stats(uint8_t level, const char* agent, const Stats* stats,
+		double seconds) {
+	double games = stats->games ? (double)stats->games : 1;
+	printf("level %u %-7s %9llu games %6.2f%% won %6.2f%% died %6.2f%% "
+			"timed out", level, agent, (unsigned long long)stats->games,
+			100 * stats->results[RESULT_WON] / games,
+			100 * stats->results[RESULT_DIED] / games,
+			100 * stats->results[RESULT_TIMEOUT] / games);
+	if (stats->results[RESULT_WON]) {
+		uint32_t most = 0;
+		for (uint32_t t = 0; t <= max_ticks; t++) {
+			if (stats->win_ticks[t]) {
+				most = t;
+			}
+		}
+		printf(", ticks to win p10 %u p50 %u p90 %u max %u",
+				percentile(stats, 0.1), percentile(stats, 0.5),
+				percentile(stats, 0.9), most);
+	}
+	printf(", %.2f diamonds %.2f bombs per game, %.0f games/s\n",
+			stats->diamonds / games, stats->bombs / games,
+			seconds > 0 ? stats->games / seconds : 0);
+}
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char** argv) {
+	long threads = sysconf(_SC_NPROCESSORS_ONLN);
+	int only_level = -1;
+	const char* only_agent = NULL;
+	int opt;
+	while ((opt = getopt(argc, argv, "a:b:g:j:l:m:s:")) != -1) {
+		switch (opt) {
+			case 'a':
+				only_agent = optarg;
+				break;
+			case 'b':
+				bomb_ticks = strtoul(optarg, NULL, 10);
+				break;
+			case 'g':
+				games_per_job = strtoull(optarg, NULL, 10);
+				break;
+			case 'j':
+				threads = strtol(optarg, NULL, 10);
+				break;
+			case 'l':
+				only_level = atoi(optarg);
+				break;
+			case 'm':
+				max_ticks = strtoul(optarg, NULL, 10);
+				break;
+			case 's':
+				seed = strtoull(optarg, NULL, 10);
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-a random|greedy] [-b ticks] "
+						"[-g games] [-j threads] [-l level] [-m ticks] "
+						"[-s seed]\n", argv[0]);
+				return 2;
+		}
+	}
+	if (threads < 1) {
+		threads = 1;
+	}
+	pthread_t* ids = malloc(threads * sizeof(pthread_t));
+	uint64_t total_games = 0;
+	double start = now();
+	for (uint8_t level = 0; level < NUM_LEVELS; level++) {
+		if (only_level >= 0 && level != only_level) {
+			continue;
+		}
+		for (size_t a = 0; a < NUM_AGENTS; a++) {
+			if (only_agent && strcmp(only_agent, agents[a].name) != 0) {
+				continue;
+			}
+			Stats stats;
+			memset(&stats, 0, sizeof(stats));
+			stats.win_ticks = calloc(max_ticks + 1, sizeof(uint64_t));
+			atomic_uint_fast64_t next_game = 0;
+			Job job = {level, agents[a].agent, &stats, &next_game};
+			double job_start = now();
+			for (long t = 0; t < threads; t++) {
+				if (pthread_create(&ids[t], NULL, worker, &job) != 0) {
+					perror("game_sim");
+					return 1;
+				}
+			}
+			for (long t = 0; t < threads; t++) {
+				pthread_join(ids[t], NULL);
+			}
+			print_stats(level, agents[a].name, &stats, now() - job_start);
+			total_games += stats.games;
+			free(stats.win_ticks);
+		}
+	}
+	double seconds = now() - start;
+	printf("%llu games in %.2fs on %ld threads: %.0f games/s\n",
+			(unsigned long long)total_games, seconds, threads,
+			seconds > 0 ? total_games / seconds : 0);
+	free(ids);
+	return 0;
+}
@@ -0,0 +1,20 @@
+/*
+ * avr/pgmspace.h
+ *
+ * Author: Matthew Chen
+ *
+ * Stand-in for avr-libc's <avr/pgmspace.h> so game code can be built on a
+ * PC (see game_sim.c). A PC has no separate program memory, so PROGMEM
+ * does nothing and program memory is read like any other.
+ */
+
+#ifndef HOST_PGMSPACE_H_
+#define HOST_PGMSPACE_H_
+
+#include <stdint.h>
+
+#define PROGMEM
+#define pgm_read_byte(address) (*(const uint8_t*)(address))
+#define pgm_read_word(address) (*(const uint16_t*)(address))
+
+#endif /* HOST_PGMSPACE_H_ */
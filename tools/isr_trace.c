@@ -0,0 +1,464 @@
+/*
+ * isr_trace.c
+ *
+ * Author: Matthew Chen
+ *
+ * Reports interrupt handler timing from a VCD trace of the marker pins
+ * written by the Trace build of the game (see DiamondMiners/isr_trace.h).
+ * The trace can come from simavr or from a logic analyser - the signals
+ * are found by name (PD2, PD3, PD5, PD6, PA2, PA3, PA4 and PD7 unless given
+ * with -s). A handler whose signal isn't in the trace is left out.
+ * For each handler it prints the number of calls and the shortest,
+ * average and longest (worst case) time it ran for, and for the main
+ * program the same for the times interrupts were turned off. It also
+ * reports:
+ * - nesting: a handler starting while another is still running (the game
+ *   never turns interrupts back on in a handler, so this should be 0)
+ * - held off: a handler starting within the -g gap of the end of an
+ *   interrupts off time or another handler, which may have delayed it.
+ *   The longest such delay (from the start of what held it off) is given.
+ * - latency of periodic interrupts (TIMER0_COMPA every 1000us and
+ *   TIMER2_COMPA every 8000us unless changed with -p): how much later
+ *   than its earliest start in the period
+ *   each call started.
+ * Times are in microseconds and in clock cycles (at -f Hz). With -c the
+ * figures are printed as CSV lines so they can be compared between builds.
+ *
+ * Usage: isr_trace [-c] [-f hz] [-g us] [-p NAME=us] [-s NAME=signal] [file]
+ */
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#define MAX_TOKEN 256
+#define MAX_CODE 16
+
+typedef struct {
+	const char* name;		// what we call it
+	char signal[MAX_TOKEN];	// its name in the trace
+	int is_handler;			// 0 for the interrupts off marker
+	double period;			// ns, 0 if not periodic
+	char code[MAX_CODE];	// VCD identifier code, empty if not found
+	int level;
+	double rise;			// ns, time it last went high
+	double fall;			// ns, time it last went low
+	// Time high
+	unsigned long count;
+	double total, min, max, max_at;
+	// Nesting and holding off
+	unsigned long nested;
+	unsigned long held_off;
+	double held_max, held_max_at;
+	const char* held_by;
+	// Start times, for periodic latency
+	double* starts;
+	size_t num_starts, size_starts;
+} Marker;
+
+static Marker markers[] = {
+	{.name = "TIMER0_COMPA", .signal = "PD2", .is_handler = 1, .period = 1e6},
+	{.name = "PCINT1", .signal = "PD3", .is_handler = 1},
+	{.name = "USART0_RX", .signal = "PD5", .is_handler = 1},
+	{.name = "USART0_UDRE", .signal = "PD6", .is_handler = 1},
+	{.name = "ADC", .signal = "PA2", .is_handler = 1},
+	{.name = "TIMER2_COMPA", .signal = "PA3", .is_handler = 1, .period = 8e6},
+	{.name = "EE_READY", .signal = "PA4", .is_handler = 1},
+	{.name = "interrupts off", .signal = "PD7"},
+};
+#define NUM_MARKERS (sizeof(markers) / sizeof(markers[0]))
+
+static double cycles_per_ns = 8e6 / 1e9;
+static double gap = 2000;	// ns
+static unsigned long max_depth = 1;
+
+static Marker* find_marker(const char* name) {
+	for (size_t i = 0; i < NUM_MARKERS; i++) {
+		if (strcasecmp(markers[i].name, name) == 0) {
+			return &markers[i];
+		}
+	}
+	// "CLI" is short for the interrupts off marker
+	if (strcasecmp(name, "CLI") == 0) {
+		return &markers[NUM_MARKERS - 1];
+	}
+	return NULL;
+}
+
+/*
+ * Reads the next whitespace separated token into token. Returns 0 at the
+ * end of the file.
+ */
+static int next_token(FILE* f, char* token) {
+	int c;
+	do {
+		c = getc(f);
+	} while (c != EOF && isspace(c));
+	if (c == EOF) {
+		return 0;
+	}
+	int n = 0;
+	while (c != EOF && !isspace(c)) {
+		if (n < MAX_TOKEN - 1) {
+			token[n++] = c;
+		}
+		c = getc(f);
+	}
+	token[n] = '\0';
+	return 1;
+}
+
+/*
+ * Skips tokens up to and including $end.
+ */
+static void skip_to_end(FILE* f) {
+	char token[MAX_TOKEN];
+	while (next_token(f, token) && strcmp(token, "$end") != 0) {
+	}
+}
+
+/*
+ * Reads a $timescale (e.g. "1ns" or "10 us") and returns nanoseconds per
+ * time unit.
+ */
+static double read_timescale(FILE* f) {
+	char token[MAX_TOKEN];
+	char text[2 * MAX_TOKEN] = "";
+	while (next_token(f, token) && strcmp(token, "$end") != 0) {
+		strncat(text, token, sizeof(text) - strlen(text) - 1);
+	}
+	char* unit;
+	double number = strtod(text, &unit);
+	static const struct {
+		const char* unit;
+		double ns;
+	} units[] = {
+		{"s", 1e9}, {"ms", 1e6}, {"us", 1e3}, {"ns", 1}, {"ps", 1e-3}, {"fs", 1e-6},
+	};
+	for (size_t i = 0; i < sizeof(units) / sizeof(units[0]); i++) {
+		if (strcmp(unit, units[i].unit) == 0) {
+			return number * units[i].ns;
+		}
+	}
+	fprintf(stderr, "unknown timescale \"%s\", assuming 1ns\n", text);
+	return 1;
+}
+
+/*
+ * Reads a $var: type size code name [index] $end.
+ */
+static void read_var(FILE* f) {
+	char type[MAX_TOKEN], size[MAX_TOKEN], code[MAX_TOKEN], name[MAX_TOKEN];
+	if (!next_token(f, type) || !next_token(f, size) || !next_token(f, code)
+			|| !next_token(f, name)) {
+		return;
+	}
+	skip_to_end(f);
+	for (size_t i = 0; i < NUM_MARKERS; i++) {
+		if (strcasecmp(markers[i].signal, name) == 0 && !markers[i].code[0]
+				&& strlen(code) < MAX_CODE) {
+			strcpy(markers[i].code, code);
+		}
+	}
+}
+
+static void marker_rises(Marker* m, double now) {
+	m->rise = now;
+	if (!m->is_handler) {
+		return;
+	}
+	// Nesting, and what may have held this handler off
+	unsigned long depth = 1;
+	for (size_t i = 0; i < NUM_MARKERS; i++) {
+		Marker* other = &markers[i];
+		if (other == m || !other->code[0]) {
+			continue;
+		}
+		if (other->level && other->is_handler) {
+			depth++;
+		} else if (!other->level && other->count
+				&& now - other->fall <= gap) {
+			double delay = now - other->rise;
+			if (m->held_by == NULL || delay > m->held_max) {
+				m->held_max = delay;
+				m->held_max_at = now;
+				m->held_by = other->name;
+			}
+			m->held_off++;
+		}
+	}
+	if (depth > 1) {
+		m->nested++;
+	}
+	if (depth > max_depth) {
+		max_depth = depth;
+	}
+	if (m->period > 0) {
+		if (m->num_starts == m->size_starts) {
+			m->size_starts = m->size_starts ? 2 * m->size_starts : 1024;
+			m->starts = realloc(m->starts, m->size_starts * sizeof(double));
+			if (m->starts == NULL) {
+				perror("isr_trace");
+				exit(1);
+			}
+		}
+		m->starts[m->num_starts++] = now;
+	}
+}
+
+static void marker_falls(Marker* m, double now) {
+	double length = now - m->rise;
+	m->fall = now;
+	if (m->count == 0 || length < m->min) {
+		m->min = length;
+	}
+	if (length > m->max) {
+		m->max = length;
+		m->max_at = m->rise;
+	}
+	m->total += length;
+	m->count++;
+}
+
+static void change(const char* code, int level, double now, int started) {
+	for (size_t i = 0; i < NUM_MARKERS; i++) {
+		Marker* m = &markers[i];
+		if (!m->code[0] || strcmp(m->code, code) != 0 || m->level == level) {
+			continue;
+		}
+		m->level = level;
+		// The initial values aren't edges
+		if (!started) {
+			continue;
+		}
+		if (level) {
+			marker_rises(m, now);
+		} else if (m->rise >= 0) {
+			marker_falls(m, now);
+		}
+	}
+}
+
+/*
+ * Reads the trace, returning 0 if no markers were found.
+ */
+static int read_vcd(FILE* f, double* end_time) {
+	char token[MAX_TOKEN];
+	double ns_per_unit = 1;
+	double now = 0;
+	int in_header = 1;
+	int stamps = 0;
+	while (next_token(f, token)) {
+		if (token[0] == '$') {
+			if (strcmp(token, "$timescale") == 0) {
+				ns_per_unit = read_timescale(f);
+			} else if (strcmp(token, "$var") == 0) {
+				read_var(f);
+			} else if (strcmp(token, "$enddefinitions") == 0) {
+				skip_to_end(f);
+				in_header = 0;
+				int found = 0;
+				for (size_t i = 0; i < NUM_MARKERS; i++) {
+					if (markers[i].code[0]) {
+						found++;
+					} else {
+						fprintf(stderr, "no signal %s for %s\n",
+								markers[i].signal, markers[i].name);
+					}
+				}
+				if (!found) {
+					return 0;
+				}
+			} else if (in_header || strcmp(token, "$comment") == 0) {
+				skip_to_end(f);
+			}
+			// $dumpvars etc. just contain value changes
+		} else if (token[0] == '#') {
+			now = strtod(token + 1, NULL) * ns_per_unit;
+			stamps++;
+		} else if (token[0] == 'b' || token[0] == 'B' || token[0] == 'r'
+				|| token[0] == 'R') {
+			char code[MAX_TOKEN];
+			if (!next_token(f, code)) {
+				break;
+			}
+			int level = strchr(token + 1, '1') != NULL;
+			if (token[0] == 'r' || token[0] == 'R') {
+				level = strtod(token + 1, NULL) != 0;
+			}
+			change(code, level, now, stamps > 1);
+		} else if (strchr("01xXzZ", token[0])) {
+			// Changes at the first time stamp are the initial values
+			change(token + 1, token[0] == '1', now, stamps > 1);
+		}
+	}
+	*end_time = now;
+	return 1;
+}
+
+/*
+ * Works out the periodic latency: each start's lateness compared with the
+ * earliest start in the period (the phase all starts would have if nothing
+ * held them off).
+ */
+static void periodic_latency(Marker* m, double* max, double* average,
+		double* max_at) {
+	*max = *average = *max_at = 0;
+	if (m->num_starts == 0) {
+		return;
+	}
+	double first = m->starts[0];
+	double earliest = 0;
+	for (size_t i = 0; i < m->num_starts; i++) {
+		double phase = m->starts[i] - first;
+		phase -= m->period * (long)(phase / m->period + 0.5);
+		if (i == 0 || phase < earliest) {
+			earliest = phase;
+		}
+	}
+	double total = 0;
+	for (size_t i = 0; i < m->num_starts; i++) {
+		double phase = m->starts[i] - first;
+		phase -= m->period * (long)(phase / m->period + 0.5);
+		double late = phase - earliest;
+		total += late;
+		if (late > *max) {
+			*max = late;
+			*max_at = m->starts[i];
+		}
+	}
+	*average = total / m->num_starts;
+}
+
+static void print_time(const char* label, double ns) {
+	printf(" %s%s%.2fus (%.0f cycles)", label, *label ? " " : "", ns / 1000,
+			ns * cycles_per_ns);
+}
+
+static void print_report(int csv) {
+	if (csv) {
+		printf("marker,count,min_us,avg_us,max_us,max_cycles,nested,held_off,"
+				"held_max_us,latency_max_us,latency_avg_us\n");
+	}
+	for (size_t i = 0; i < NUM_MARKERS; i++) {
+		Marker* m = &markers[i];
+		if (!m->code[0]) {
+			continue;
+		}
+		double average = m->count ? m->total / m->count : 0;
+		double late_max, late_average, late_at;
+		periodic_latency(m, &late_max, &late_average, &late_at);
+		if (csv) {
+			printf("%s,%lu,%.3f,%.3f,%.3f,%.0f,%lu,%lu,%.3f,%.3f,%.3f\n",
+					m->name, m->count, m->min / 1000, average / 1000,
+					m->max / 1000, m->max * cycles_per_ns, m->nested,
+					m->held_off, m->held_max / 1000, late_max / 1000,
+					late_average / 1000);
+			continue;
+		}
+		printf("%s (%s): %lu %s\n", m->name, m->signal, m->count,
+				m->is_handler ? "calls" : "times");
+		if (m->count == 0) {
+			continue;
+		}
+		printf("  ");
+		print_time("min", m->min);
+		print_time("avg", average);
+		print_time("max", m->max);
+		printf(" at %.3fms\n", m->max_at / 1e6);
+		if (!m->is_handler) {
+			continue;
+		}
+		printf("   nested %lu, held off %lu", m->nested, m->held_off);
+		if (m->held_by) {
+			printf(" (longest by %s", m->held_by);
+			print_time("", m->held_max);
+			printf(" at %.3fms)", m->held_max_at / 1e6);
+		}
+		printf("\n");
+		if (m->period > 0) {
+			printf("   latency");
+			print_time("avg", late_average);
+			print_time("max", late_max);
+			printf(" at %.3fms\n", late_at / 1e6);
+		}
+	}
+	if (!csv) {
+		printf("deepest nesting: %lu\n", max_depth);
+	}
+}
+
+/*
+ * Splits NAME=value, returning the marker and value or NULL.
+ */
+static Marker* parse_setting(char* arg, char** value) {
+	char* equals = strchr(arg, '=');
+	if (equals == NULL) {
+		return NULL;
+	}
+	*equals = '\0';
+	*value = equals + 1;
+	return find_marker(arg);
+}
+
+int main(int argc, char** argv) {
+	int csv = 0;
+	int opt;
+	while ((opt = getopt(argc, argv, "cf:g:p:s:")) != -1) {
+		Marker* m = NULL;
+		char* value;
+		switch (opt) {
+			case 'c':
+				csv = 1;
+				continue;
+			case 'f':
+				cycles_per_ns = strtod(optarg, NULL) / 1e9;
+				continue;
+			case 'g':
+				gap = strtod(optarg, NULL) * 1000;
+				continue;
+			case 'p':
+				if ((m = parse_setting(optarg, &value)) != NULL) {
+					m->period = strtod(value, NULL) * 1000;
+					continue;
+				}
+				break;
+			case 's':
+				if ((m = parse_setting(optarg, &value)) != NULL) {
+					snprintf(m->signal, MAX_TOKEN, "%s", value);
+					continue;
+				}
+				break;
+		}
+		fprintf(stderr, "usage: %s [-c] [-f hz] [-g us] [-p NAME=us] "
+				"[-s NAME=signal] [file]\n", argv[0]);
+		fprintf(stderr, "NAME is TIMER0_COMPA, PCINT1, USART0_RX, "
+				"USART0_UDRE or CLI\n");
+		return 2;
+	}
+	FILE* f = stdin;
+	if (optind < argc) {
+		f = fopen(argv[optind], "r");
+		if (f == NULL) {
+			perror(argv[optind]);
+			return 1;
+		}
+	}
+	for (size_t i = 0; i < NUM_MARKERS; i++) {
+		markers[i].rise = -1;
+	}
+	double end_time;
+	if (!read_vcd(f, &end_time)) {
+		fprintf(stderr, "no marker signals in the trace\n");
+		return 1;
+	}
+	if (!csv) {
+		printf("trace length %.3fms\n", end_time / 1e6);
+	}
+	print_report(csv);
+	return 0;
+}
@@ -0,0 +1,308 @@
+/*
+ * level_upload.c
+ *
+ * Author: Matthew Chen
+ *
+ * Uploads a level to a board over its serial port while it shows the
+ * start screen (see DiamondMiners/levels.h for the format and the
+ * frames). The level file is the layout written out the way the layouts
+ * in game.c are: HEIGHT rows of WIDTH squares, top row first, each square
+ * one of
+ *		. or 0		empty
+ *		+ or 3		breakable wall
+ *		# or 4		unbreakable wall
+ *		* or 5		diamond
+ * Anything else (spaces, commas, braces) is skipped, so a layout can be
+ * copied straight out of game.c. The player starts in the bottom left
+ * square, so that has to be empty, and there has to be a diamond (the
+ * board turns down a level that breaks either rule).
+ * Each frame is sent once the board has answered the one before. A frame
+ * that is answered with '-' or not answered within a second is sent
+ * again. Other output from the board (the start screen) is ignored.
+ * With -n the frames are printed instead of sent, and with -c the slot is
+ * cleared so the built in level is played again.
+ *
+ * Usage: level_upload [-c] [-n] [-b baud] [-p port] [-s slot] [file]
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "../DiamondMiners/levels.h"
+
+#define NUM_SQUARES (WIDTH * HEIGHT)
+#define FRAME_DATA 4			// bytes of level in each :D frame
+#define ANSWER_TIMEOUT 1000		// ms
+#define MAX_TRIES 5
+
+static int port = -1;
+static int dry_run;
+
+/*
+ * The CRC used by the board (_crc_ccitt_update() in avr-libc).
+ */
+static uint16_t crc_ccitt_update(uint16_t crc, uint8_t data) {
+	data ^= crc & 0xFF;
+	data ^= data << 4;
+	return ((((uint16_t)data << 8) | (crc >> 8)) ^ (uint8_t)(data >> 4)
+			^ ((uint16_t)data << 3));
+}
+
+/*
+ * Reads the layout from file into codes (LEVEL_CODE_* values, top row
+ * first). Returns 0 if it isn't a whole level.
+ */
+static int read_level(FILE* file, const char* name, uint8_t* codes) {
+	int count = 0;
+	int c;
+	while ((c = fgetc(file)) != EOF) {
+		int code;
+		switch (c) {
+			case '.': case '0':
+				code = LEVEL_CODE_EMPTY;
+				break;
+			case '+': case '3':
+				code = LEVEL_CODE_BREAKABLE;
+				break;
+			case '#': case '4':
+				code = LEVEL_CODE_UNBREAKABLE;
+				break;
+			case '*': case '5':
+				code = LEVEL_CODE_DIAMOND;
+				break;
+			default:
+				continue;
+		}
+		if (count == NUM_SQUARES) {
+			fprintf(stderr, "%s: more than %d squares\n", name, NUM_SQUARES);
+			return 0;
+		}
+		codes[count++] = code;
+	}
+	if (count != NUM_SQUARES) {
+		fprintf(stderr, "%s: %d squares, should be %d\n", name, count,
+				NUM_SQUARES);
+		return 0;
+	}
+	if (codes[(HEIGHT - 1) * WIDTH] != LEVEL_CODE_EMPTY) {
+		fprintf(stderr, "%s: the bottom left square (where the player "
+				"starts) isn't empty\n", name);
+		return 0;
+	}
+	if (!memchr(codes, LEVEL_CODE_DIAMOND, NUM_SQUARES)) {
+		fprintf(stderr, "%s: there are no diamonds\n", name);
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ * Packs the level 4 squares a byte, the first in the top 2 bits.
+ */
+static void pack(const uint8_t* codes, uint8_t* level) {
+	for (int i = 0; i < LEVEL_SIZE; i++) {
+		level[i] = (codes[4 * i] << 6) | (codes[4 * i + 1] << 4)
+				| (codes[4 * i + 2] << 2) | codes[4 * i + 3];
+	}
+}
+
+static int open_port(const char* name, int baud) {
+	static const struct {
+		int baud;
+		speed_t speed;
+	} speeds[] = {
+		{9600, B9600}, {19200, B19200}, {38400, B38400}, {57600, B57600},
+		{115200, B115200}, {230400, B230400}, {500000, B500000}
+	};
+	speed_t speed = 0;
+	for (size_t i = 0; i < sizeof(speeds) / sizeof(speeds[0]); i++) {
+		if (speeds[i].baud == baud) {
+			speed = speeds[i].speed;
+		}
+	}
+	if (speed == 0) {
+		fprintf(stderr, "%d baud isn't supported\n", baud);
+		return -1;
+	}
+	int fd = open(name, O_RDWR | O_NOCTTY);
+	if (fd < 0) {
+		perror(name);
+		return -1;
+	}
+	struct termios tio;
+	if (tcgetattr(fd, &tio) < 0) {
+		perror(name);
+		close(fd);
+		return -1;
+	}
+	cfmakeraw(&tio);
+	cfsetispeed(&tio, speed);
+	cfsetospeed(&tio, speed);
+	tio.c_cflag |= CLOCAL | CREAD;
+	if (tcsetattr(fd, TCSANOW, &tio) < 0) {
+		perror(name);
+		close(fd);
+		return -1;
+	}
+	tcflush(fd, TCIOFLUSH);
+	return fd;
+}
+
+/*
+ * Waits for the board to answer. Returns '+', '-' or 0 if it didn't
+ * answer in time.
+ */
+static int wait_for_answer(void) {
+	struct pollfd pfd = {port, POLLIN, 0};
+	while (1) {
+		int ready = poll(&pfd, 1, ANSWER_TIMEOUT);
+		if (ready < 0 && errno == EINTR) {
+			continue;
+		}
+		if (ready <= 0) {
+			return 0;
+		}
+		char c;
+		if (read(port, &c, 1) != 1) {
+			return 0;
+		}
+		if (c == '+' || c == '-') {
+			return c;
+		}
+	}
+}
+
+/*
+ * Sends a frame (without the ':' or '\n') until the board takes it.
+ * Returns 0 if it never does.
+ */
+static int send_frame(const char* frame) {
+	char line[32];
+	int length = snprintf(line, sizeof(line), ":%s\n", frame);
+	if (dry_run) {
+		fputs(line, stdout);
+		return 1;
+	}
+	for (int tries = 0; tries < MAX_TRIES; tries++) {
+		if (write(port, line, length) != length) {
+			perror("write");
+			return 0;
+		}
+		int answer = wait_for_answer();
+		if (answer == '+') {
+			return 1;
+		}
+		// A '-' to an :E frame means the level was turned down, and
+		// sending it again won't help
+		if (answer == '-' && frame[0] == 'E') {
+			break;
+		}
+	}
+	fprintf(stderr, "the board didn't take :%s\n", frame);
+	return 0;
+}
+
+static int upload(int slot, const uint8_t* level, int length) {
+	char frame[32];
+	snprintf(frame, sizeof(frame), "U%X", slot);
+	if (!send_frame(frame)) {
+		return 0;
+	}
+	uint16_t crc = 0xFFFF;
+	for (int offset = 0; offset < length; offset += FRAME_DATA) {
+		int count = length - offset < FRAME_DATA ? length - offset : FRAME_DATA;
+		uint8_t sum = offset;
+		int n = snprintf(frame, sizeof(frame), "D%02X", offset);
+		for (int i = 0; i < count; i++) {
+			n += snprintf(frame + n, sizeof(frame) - n, "%02X",
+					level[offset + i]);
+			sum += level[offset + i];
+			crc = crc_ccitt_update(crc, level[offset + i]);
+		}
+		snprintf(frame + n, sizeof(frame) - n, "%02X", (uint8_t)-sum);
+		if (!send_frame(frame)) {
+			return 0;
+		}
+	}
+	snprintf(frame, sizeof(frame), "E%04X", crc);
+	return send_frame(frame);
+}
+
+int main(int argc, char** argv) {
+	const char* port_name = "/dev/ttyUSB0";
+	int baud = 19200;
+	int slot = 0;
+	int clear = 0;
+	int opt;
+	while ((opt = getopt(argc, argv, "b:cnp:s:")) != -1) {
+		switch (opt) {
+			case 'b':
+				baud = atoi(optarg);
+				break;
+			case 'c':
+				clear = 1;
+				break;
+			case 'n':
+				dry_run = 1;
+				break;
+			case 'p':
+				port_name = optarg;
+				break;
+			case 's':
+				slot = atoi(optarg);
+				break;
+			default:
+				fprintf(stderr, "Usage: %s [-c] [-n] [-b baud] [-p port] "
+						"[-s slot] [file]\n", argv[0]);
+				return 2;
+		}
+	}
+	if (slot < 0 || slot >= LEVEL_SLOTS) {
+		fprintf(stderr, "the slot must be 0 to %d\n", LEVEL_SLOTS - 1);
+		return 2;
+	}
+
+	uint8_t level[LEVEL_SIZE];
+	int length = 0;
+	if (!clear) {
+		uint8_t codes[NUM_SQUARES];
+		FILE* file = stdin;
+		const char* name = "stdin";
+		if (optind < argc) {
+			name = argv[optind];
+			file = fopen(name, "r");
+			if (!file) {
+				perror(name);
+				return 1;
+			}
+		}
+		int ok = read_level(file, name, codes);
+		if (file != stdin) {
+			fclose(file);
+		}
+		if (!ok) {
+			return 1;
+		}
+		pack(codes, level);
+		length = LEVEL_SIZE;
+	}
+
+	if (!dry_run) {
+		port = open_port(port_name, baud);
+		if (port < 0) {
+			return 1;
+		}
+	}
+	int ok = upload(slot, level, length);
+	if (port >= 0) {
+		close(port);
+	}
+	return ok ? 0 : 1;
+}
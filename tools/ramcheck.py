@@ -0,0 +1,251 @@
+#!/usr/bin/env python3
+"""
+ramcheck.py
+
+Author: Matthew Chen
+
+Lists the static RAM used by each module of the game and checks that its
+worst case stack fits in the RAM left over after the static variables. Run
+it on a build's map file, disassembly listing and .su files:
+
+    ramcheck.py --map Debug/DiamondMiners.map --lss Debug/DiamondMiners.lss
+                --su-dir Debug
+
+make -C tools ramcheck builds the firmware with avr-gcc and runs it.
+
+- Static RAM comes from the .data, .bss and .noinit sections in the map
+  file, added up per object file (library members are added up per
+  library).
+- Stack frames come from the .su files written by -fstack-usage. avr-gcc's
+  figures include the saved registers and the return address.
+- Calls come from the disassembly in the .lss listing. Calls through
+  function pointers (icall) can't be followed, so each one is charged
+  --indirect-frame bytes. Functions without a .su file (the C library,
+  assembly) are charged --unknown-frame bytes.
+- The worst case is the deepest path from main plus the deepest path from
+  any interrupt handler (interrupts don't nest in this program).
+- Recursion is an error unless its depth is given with --recursion.
+
+Exits with status 1 (failing the build) if the worst case stack is more
+than the budget (by default the RAM left after the static variables less
+--margin).
+"""
+
+import argparse
+import glob
+import os
+import re
+import sys
+
+OUTPUT_SECTIONS = (".data", ".bss", ".noinit")
+INPUT_LINE = re.compile(
+    r"^\s+(?:[.\w*]\S*\s+)?0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)\s+(\S.*?)\s*$")
+OUTPUT_LINE = re.compile(r"^(\.\w+)\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)")
+LABEL_LINE = re.compile(r"^[0-9a-fA-F]+ <([^>]+)>:\s*$")
+CALL_LINE = re.compile(
+    r"^\s*[0-9a-fA-F]+:\s.*\t(call|rcall|jmp|rjmp)\t.*<([^>+]+)>\s*$")
+ICALL_LINE = re.compile(r"^\s*[0-9a-fA-F]+:\s.*\t(icall|eicall)\b")
+VECTOR_NAME = re.compile(r"^__vector_\d+$")
+
+
+def module_name(path):
+    """Returns the module an object file belongs to: the file name without
+    .o, or the library name for a library member."""
+    path = path.replace("\\", "/")
+    if path.endswith(")") and ".a(" in path:
+        path = path[:path.rindex("(")]
+    name = os.path.basename(path)
+    for suffix in (".o", ".a"):
+        if name.endswith(suffix):
+            name = name[:-len(suffix)]
+    return name
+
+
+def read_map(path):
+    """Returns (total static bytes, {module: bytes})."""
+    total = 0
+    modules = {}
+    section = None
+    with open(path, errors="replace") as f:
+        for line in f:
+            line = line.rstrip("\r\n")
+            output = OUTPUT_LINE.match(line)
+            if output:
+                section = output.group(1) if output.group(1) in OUTPUT_SECTIONS else None
+                if section:
+                    total += int(output.group(3), 16)
+                continue
+            if line and not line[0].isspace():
+                section = None
+                continue
+            if section is None:
+                continue
+            match = INPUT_LINE.match(line)
+            if not match:
+                continue
+            size = int(match.group(2), 16)
+            if size:
+                name = module_name(match.group(3))
+                modules[name] = modules.get(name, 0) + size
+    return total, modules
+
+
+def read_stack_usage(su_dir):
+    """Returns {function: frame bytes} from the .su files."""
+    frames = {}
+    for path in glob.glob(os.path.join(su_dir, "*.su")):
+        with open(path) as f:
+            for line in f:
+                parts = line.rstrip("\r\n").split("\t")
+                if len(parts) < 3:
+                    continue
+                function = parts[0].split(":")[-1]
+                if "dynamic" in parts[2] and "bounded" not in parts[2]:
+                    sys.exit("ramcheck: %s has an unbounded stack frame" % function)
+                frames[function] = max(frames.get(function, 0), int(parts[1]))
+    return frames
+
+
+def read_calls(path):
+    """Returns {function: [set of called functions, set of functions jumped
+    to, number of indirect calls]}."""
+    calls = {}
+    current = None
+    with open(path, errors="replace") as f:
+        for line in f:
+            label = LABEL_LINE.match(line)
+            if label:
+                current = label.group(1)
+                calls.setdefault(current, [set(), set(), 0])
+                continue
+            if current is None:
+                continue
+            call = CALL_LINE.match(line)
+            if call and call.group(1) in ("call", "rcall"):
+                calls[current][0].add(call.group(2))
+            elif call and call.group(2) != current:
+                # A jump to another function (a tail call, or a shared
+                # exit in the library). A jump to itself is just a loop.
+                calls[current][1].add(call.group(2))
+            elif ICALL_LINE.match(line):
+                calls[current][2] += 1
+    return calls
+
+
+class StackChecker:
+    def __init__(self, frames, calls, args):
+        self.frames = frames
+        self.calls = calls
+        self.args = args
+        self.depths = {}
+        self.unknown = set()
+        self.active = []
+
+    def frame(self, function):
+        if function in self.frames:
+            return self.frames[function]
+        self.unknown.add(function)
+        return self.args.unknown_frame
+
+    def depth(self, function):
+        """Returns (worst case bytes, deepest call path) from function."""
+        if function in self.depths:
+            return self.depths[function]
+        if function in self.active:
+            cycle = self.active[self.active.index(function):]
+            sys.exit("ramcheck: recursion through %s - give its depth with "
+                     "--recursion" % " -> ".join(cycle + [function]))
+        self.active.append(function)
+        callees, jumps, indirect = self.calls.get(function, (set(), set(), 0))
+        repeat = 1
+        if function in callees:
+            if function not in self.args.recursion:
+                sys.exit("ramcheck: %s calls itself - give its depth with "
+                         "--recursion" % function)
+            repeat = self.args.recursion[function]
+        deepest, path = 0, []
+        if indirect:
+            deepest, path = self.args.indirect_frame, ["(indirect call)"]
+        # Jumps that lead back into a function we're in are loops, not
+        # recursion - nothing more is pushed
+        jumps = set(j for j in jumps if j not in self.active)
+        for callee in sorted(callees | jumps):
+            if callee == function:
+                continue
+            callee_depth, callee_path = self.depth(callee)
+            if callee_depth > deepest:
+                deepest, path = callee_depth, callee_path
+        self.active.pop()
+        name = function if repeat == 1 else "%s x%d" % (function, repeat)
+        result = (self.frame(function) * repeat + deepest, [name] + path)
+        self.depths[function] = result
+        return result
+
+
+def print_modules(modules):
+    """Prints the static RAM of each module, largest first."""
+    for name in sorted(modules, key=lambda name: (-modules[name], name)):
+        print("  %-16s %5d" % (name, modules[name]))
+
+
+def parse_recursion(values):
+    bounds = {}
+    for value in values:
+        name, _, depth = value.partition("=")
+        bounds[name] = int(depth)
+    return bounds
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+            formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--map", required=True, help="linker map file")
+    parser.add_argument("--lss", help="disassembly listing (for the stack check)")
+    parser.add_argument("--su-dir", help="directory with the .su files")
+    parser.add_argument("--ram-size", type=int, default=2048)
+    parser.add_argument("--margin", type=int, default=64,
+            help="bytes of RAM to keep spare (default 64)")
+    parser.add_argument("--budget", type=int,
+            help="stack budget in bytes (default: RAM left less the margin)")
+    parser.add_argument("--unknown-frame", type=int, default=16)
+    parser.add_argument("--indirect-frame", type=int, default=32)
+    parser.add_argument("--recursion", action="append", default=[],
+            metavar="FUNCTION=DEPTH")
+    args = parser.parse_args()
+    args.recursion = parse_recursion(args.recursion)
+
+    static_total, modules = read_map(args.map)
+    print("ramcheck: static RAM %d of %d bytes" % (static_total, args.ram_size))
+    print_modules(modules)
+    if not args.lss:
+        return 0
+
+    frames = read_stack_usage(args.su_dir or os.path.dirname(args.lss))
+    calls = read_calls(args.lss)
+    checker = StackChecker(frames, calls, args)
+    main_depth, main_path = checker.depth("main")
+    isr_depth, isr_path = 0, []
+    for function in sorted(calls):
+        if VECTOR_NAME.match(function):
+            depth, path = checker.depth(function)
+            if depth > isr_depth:
+                isr_depth, isr_path = depth, path
+    worst = main_depth + isr_depth
+    budget = args.budget
+    if budget is None:
+        budget = args.ram_size - static_total - args.margin
+    print("ramcheck: worst case stack %d bytes (budget %d)" % (worst, budget))
+    print("  main %d: %s" % (main_depth, " -> ".join(main_path)))
+    if isr_path:
+        print("  interrupt %d: %s" % (isr_depth, " -> ".join(isr_path)))
+    if checker.unknown:
+        print("  assumed %d bytes for: %s" % (args.unknown_frame,
+                ", ".join(sorted(checker.unknown))))
+    if worst > budget:
+        print("ramcheck: error: stack may run into the static variables")
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
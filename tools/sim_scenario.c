@@ -0,0 +1,373 @@
+/*
+ * sim_scenario.c
+ *
+ * Author: Matthew Chen
+ *
+ * Runs the game firmware in simavr through a scripted scenario, so the
+ * parts of it that depend on timing can be checked without a board. It
+ * starts a game (with 's' on the terminal) and then makes -n moves from
+ * each input source, taking turns, one at a time. The moves go up and down
+ * in turn, so the player steps between the start square (0,0) and the
+ * square above it, which are empty on both built in levels. A blocked move
+ * doesn't redraw the player, so it wouldn't be timed.
+ * - buttons: B2 (up) or B1 (down) is pressed for 60ms, which raises PCINT1
+ * - terminal: 'w' or 's' is sent, which raises USART0_RX
+ * - joystick: ADC1 (y) is pulled to 0V (up) or 5V (down) for 60ms and then
+ *   back to the centre (2.5V)
+ * Each move is followed by a pause, so every input is a sample of its own.
+ * The scenario ends with the !l command (see latency.h).
+ * With -l the latency report is read back from the terminal output and
+ * checked against limits given as [Source.]stat=us, for example
+ * -l p99=25000 -l Joystick.max=50000 (stat is min, p50, p99 or max;
+ * without a source the limit is for every source). Every source has to
+ * have at least half of its moves measured. The exit status is 1 if any
+ * check fails, so latency regressions fail the test.
+ * With -t the ISR marker pins of the Trace build (see isr_trace.h) are
+ * written to a VCD file for tools/isr_trace.
+ * With -v the terminal output is copied to standard output.
+ * The firmware is built by tools/Makefile (see the latency_test and
+ * isr_trace_test targets). simavr doesn't have the ATmega324A, so the
+ * ATmega324P (which has the same peripherals) is simulated unless -m
+ * says otherwise.
+ *
+ * Usage: sim_scenario [-v] [-l limit]... [-m mcu] [-n moves] [-t vcd] elf
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include "sim_avr.h"
+#include "sim_elf.h"
+#include "sim_irq.h"
+#include "sim_vcd_file.h"
+#include "avr_adc.h"
+#include "avr_ioport.h"
+#include "avr_uart.h"
+
+#define F_CPU 8000000
+#define MILLIVOLTS 5000
+#define JOYSTICK_CENTRE (MILLIVOLTS / 2)
+#define HOLD_TIME 60			// ms a button or the joystick is held
+#define SETTLE_TIME 200			// ms between moves
+#define OUTPUT_SIZE (256 * 1024)
+#define MAX_LIMITS 16
+
+#define NUM_SOURCES 3
+static const char* const source_names[NUM_SOURCES] =
+		{"Button", "Serial", "Joystick"};
+#define NUM_STATS 4
+static const char* const stat_names[NUM_STATS] = {"min", "p50", "p99", "max"};
+
+// The ISR marker pins (see DiamondMiners/isr_trace.h)
+static const struct {
+	char port;
+	int pin;
+} trace_pins[] = {{'D', 2}, {'D', 3}, {'D', 5}, {'D', 6}, {'D', 7},
+		{'A', 2}, {'A', 3}, {'A', 4}};
+#define NUM_TRACE_PINS (sizeof(trace_pins) / sizeof(trace_pins[0]))
+
+typedef struct {
+	int source;		// -1 for every source
+	int stat;
+	unsigned long us;
+} Limit;
+
+static avr_t* avr;
+static char output[OUTPUT_SIZE];
+static size_t output_length;
+static int verbose;
+
+static void uart_output(struct avr_irq_t* irq, uint32_t value, void* param) {
+	(void)irq;
+	(void)param;
+	if (output_length < OUTPUT_SIZE - 1) {
+		output[output_length++] = value;
+	}
+	if (verbose) {
+		putchar(value);
+	}
+}
+
+/*
+ * Runs the firmware for ms milliseconds of simulated time.
+ */
+static void run_for(unsigned ms) {
+	avr_cycle_count_t end = avr->cycle + (avr_cycle_count_t)ms * (F_CPU / 1000);
+	while (avr->cycle < end) {
+		int state = avr_run(avr);
+		if (state == cpu_Done || state == cpu_Crashed) {
+			fprintf(stderr, "the firmware stopped (state %d)\n", state);
+			exit(1);
+		}
+	}
+}
+
+static void send_key(char key) {
+	avr_raise_irq(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'),
+			UART_IRQ_INPUT), (uint8_t)key);
+	// A character takes about 0.5ms at 19200 baud
+	run_for(2);
+}
+
+static void set_button(int pin, int pressed) {
+	avr_raise_irq(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('B'), pin),
+			pressed);
+}
+
+static void set_joystick(int channel, uint32_t millivolts) {
+	avr_raise_irq(avr_io_getirq(avr, AVR_IOCTL_ADC_GETIRQ,
+			ADC_IRQ_ADC0 + channel), millivolts);
+}
+
+/*
+ * Makes a move from a source (0 button, 1 terminal, 2 joystick), up or
+ * down.
+ */
+static void move(int source, int up) {
+	switch (source) {
+		case 0:
+			set_button(up ? 2 : 1, 1);
+			run_for(HOLD_TIME);
+			set_button(up ? 2 : 1, 0);
+			break;
+		case 1:
+			send_key(up ? 'w' : 's');
+			break;
+		case 2:
+			set_joystick(1, up ? 0 : MILLIVOLTS);
+			run_for(HOLD_TIME);
+			set_joystick(1, JOYSTICK_CENTRE);
+			break;
+	}
+	run_for(SETTLE_TIME);
+}
+
+/*
+ * Reads a "stat=<n>us" or "stat=<n>ms" field from a report line (which
+ * ends at end). Returns 0 if it isn't there.
+ */
+static int read_stat(const char* line, const char* end, const char* stat,
+		unsigned long* us) {
+	char key[8];
+	snprintf(key, sizeof(key), " %s=", stat);
+	const char* field = strstr(line, key);
+	if (field == NULL || field >= end) {
+		return 0;
+	}
+	char* unit;
+	*us = strtoul(field + strlen(key), &unit, 10);
+	if (strncmp(unit, "ms", 2) == 0) {
+		*us *= 1000;
+	} else if (strncmp(unit, "us", 2) != 0) {
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ * Checks the latency report in the output (from start on) against the
+ * limits. Returns the number of checks that failed.
+ */
+static int check_latency(size_t start, const Limit* limits, int num_limits,
+		unsigned min_samples) {
+	int failed = 0;
+	output[output_length] = '\0';
+	for (int source = 0; source < NUM_SOURCES; source++) {
+		char heading[32];
+		snprintf(heading, sizeof(heading), "%s: n=", source_names[source]);
+		const char* line = strstr(output + start, heading);
+		if (line == NULL) {
+			printf("%s: no latency report\n", source_names[source]);
+			failed++;
+			continue;
+		}
+		const char* end = strchr(line, '\r');
+		if (end == NULL) {
+			end = output + output_length;
+		}
+		unsigned long count = strtoul(line + strlen(heading), NULL, 10);
+		unsigned long stats[NUM_STATS];
+		int ok = 1;
+		for (int i = 0; i < NUM_STATS; i++) {
+			ok &= read_stat(line, end, stat_names[i], &stats[i]);
+		}
+		if (!ok) {
+			printf("%s: couldn't read the report\n", source_names[source]);
+			failed++;
+			continue;
+		}
+		printf("%-8s n=%lu min=%luus p50=%luus p99=%luus max=%luus\n",
+				source_names[source], count, stats[0], stats[1], stats[2],
+				stats[3]);
+		if (count < min_samples) {
+			printf("  FAIL: %lu samples, expected at least %u\n", count,
+					min_samples);
+			failed++;
+		}
+		for (int i = 0; i < num_limits; i++) {
+			const Limit* limit = &limits[i];
+			if ((limit->source == -1 || limit->source == source)
+					&& stats[limit->stat] > limit->us) {
+				printf("  FAIL: %s %luus is over the limit of %luus\n",
+						stat_names[limit->stat], stats[limit->stat], limit->us);
+				failed++;
+			}
+		}
+	}
+	return failed;
+}
+
+/*
+ * Reads a limit ([Source.]stat=us). Returns 0 if it isn't one.
+ */
+static int parse_limit(const char* text, Limit* limit) {
+	limit->source = -1;
+	const char* dot = strchr(text, '.');
+	if (dot != NULL) {
+		for (int i = 0; i < NUM_SOURCES; i++) {
+			if (strncasecmp(text, source_names[i], dot - text) == 0
+					&& strlen(source_names[i]) == (size_t)(dot - text)) {
+				limit->source = i;
+			}
+		}
+		if (limit->source == -1) {
+			return 0;
+		}
+		text = dot + 1;
+	}
+	const char* equals = strchr(text, '=');
+	if (equals == NULL) {
+		return 0;
+	}
+	limit->stat = -1;
+	for (int i = 0; i < NUM_STATS; i++) {
+		if (strncmp(text, stat_names[i], equals - text) == 0
+				&& strlen(stat_names[i]) == (size_t)(equals - text)) {
+			limit->stat = i;
+		}
+	}
+	limit->us = strtoul(equals + 1, NULL, 10);
+	return limit->stat != -1;
+}
+
+int main(int argc, char** argv) {
+	const char* mcu = "atmega324p";
+	const char* vcd_path = NULL;
+	unsigned moves = 20;
+	Limit limits[MAX_LIMITS];
+	int num_limits = 0;
+	int check = 0;
+	int opt;
+	while ((opt = getopt(argc, argv, "l:m:n:t:v")) != -1) {
+		switch (opt) {
+			case 'l':
+				if (num_limits == MAX_LIMITS
+						|| !parse_limit(optarg, &limits[num_limits])) {
+					fprintf(stderr, "bad limit %s\n", optarg);
+					return 2;
+				}
+				num_limits++;
+				check = 1;
+				break;
+			case 'm':
+				mcu = optarg;
+				break;
+			case 'n':
+				moves = atoi(optarg);
+				break;
+			case 't':
+				vcd_path = optarg;
+				break;
+			case 'v':
+				verbose = 1;
+				break;
+			default:
+				optind = argc;
+				break;
+		}
+	}
+	if (optind != argc - 1) {
+		fprintf(stderr, "usage: %s [-v] [-l limit]... [-m mcu] [-n moves] "
+				"[-t vcd] elf\n", argv[0]);
+		return 2;
+	}
+
+	elf_firmware_t firmware;
+	memset(&firmware, 0, sizeof(firmware));
+	if (elf_read_firmware(argv[optind], &firmware) != 0) {
+		fprintf(stderr, "couldn't read %s\n", argv[optind]);
+		return 1;
+	}
+	strncpy(firmware.mmcu, mcu, sizeof(firmware.mmcu) - 1);
+	firmware.frequency = F_CPU;
+	firmware.vcc = firmware.avcc = firmware.aref = MILLIVOLTS;
+	avr = avr_make_mcu_by_name(firmware.mmcu);
+	if (avr == NULL) {
+		fprintf(stderr, "simavr doesn't have the %s\n", firmware.mmcu);
+		return 1;
+	}
+	avr_init(avr);
+	avr_load_firmware(avr, &firmware);
+
+	// Take the terminal output here rather than simavr printing it
+	uint32_t flags = 0;
+	avr_ioctl(avr, AVR_IOCTL_UART_GET_FLAGS('0'), &flags);
+	flags &= ~AVR_UART_FLAG_STDIO;
+	avr_ioctl(avr, AVR_IOCTL_UART_SET_FLAGS('0'), &flags);
+	avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'),
+			UART_IRQ_OUTPUT), uart_output, NULL);
+
+	avr_vcd_t vcd;
+	if (vcd_path != NULL) {
+		avr_vcd_init(avr, vcd_path, &vcd, 1000);
+		for (size_t i = 0; i < NUM_TRACE_PINS; i++) {
+			char name[8];
+			snprintf(name, sizeof(name), "P%c%d", trace_pins[i].port,
+					trace_pins[i].pin);
+			avr_vcd_add_signal(&vcd, avr_io_getirq(avr,
+					AVR_IOCTL_IOPORT_GETIRQ(trace_pins[i].port),
+					trace_pins[i].pin), 1, name);
+		}
+		avr_vcd_start(&vcd);
+	}
+
+	// Buttons up and the joystick centred while it calibrates, then start
+	// a game from the start screen
+	for (int pin = 0; pin < 4; pin++) {
+		set_button(pin, 0);
+	}
+	set_joystick(0, JOYSTICK_CENTRE);
+	set_joystick(1, JOYSTICK_CENTRE);
+	run_for(500);
+	send_key('s');
+	run_for(500);
+
+	// Every move changes direction, whichever source it comes from, so the
+	// player never walks into a wall or the edge
+	unsigned made = 0;
+	for (unsigned i = 0; i < moves; i++) {
+		for (int source = 0; source < NUM_SOURCES; source++) {
+			move(source, made++ % 2 == 0);
+		}
+	}
+
+	size_t report_start = output_length;
+	send_key('!');
+	send_key('l');
+	run_for(500);
+
+	if (vcd_path != NULL) {
+		avr_vcd_stop(&vcd);
+	}
+	if (!check) {
+		return 0;
+	}
+	int failed = check_latency(report_start, limits, num_limits,
+			(moves + 1) / 2);
+	printf(failed ? "latency test FAILED\n" : "latency test passed\n");
+	return failed ? 1 : 0;
+}
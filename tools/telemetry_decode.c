@@ -0,0 +1,316 @@
+/*
+ * telemetry_decode.c
+ *
+ * Author: Matthew Chen
+ *
+ * Decodes the binary telemetry sent by the game (see
+ * DiamondMiners/telemetry.h) on a PC. Reads a serial port (which is set to
+ * raw mode at the given baud rate), a capture file or standard input,
+ * pulls the COBS frames out from between the terminal text, checks them
+ * and prints each record using the schema records sent by the game.
+ * Anything that doesn't decode to a frame with the right CRC is treated
+ * as terminal text. A count of the frames (and of frames missing from the
+ * sequence numbers) is printed at the end (or on Ctrl-C).
+ *
+ * Usage: telemetry_decode [-b baud] [-t] [port or file]
+ *		-b	baud rate if reading a serial port (default 19200)
+ *		-t	also print the terminal text that isn't telemetry
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#define RECORD_SCHEMA 0
+#define MAX_FRAME 512
+#define MAX_STRING 128
+
+typedef struct {
+	int known;
+	char name[MAX_STRING];
+	char format[MAX_STRING];
+	char fields[MAX_STRING];
+	unsigned long count;
+} Schema;
+
+static Schema schema[256];
+static unsigned long good_frames, missed_frames;
+static int last_sequence = -1;
+static int show_text;
+static volatile sig_atomic_t stop;
+
+static void handle_signal(int sig) {
+	(void)sig;
+	stop = 1;
+}
+
+/*
+ * The CRC used by avr-libc's _crc_ccitt_update().
+ */
+static uint16_t crc_ccitt_update(uint16_t crc, uint8_t data) {
+	data ^= crc & 0xFF;
+	data ^= data << 4;
+	return ((((uint16_t)data << 8) | (crc >> 8)) ^ (uint8_t)(data >> 4)
+			^ ((uint16_t)data << 3));
+}
+
+/*
+ * Decodes a COBS block of len bytes (without the 0 delimiters) into out.
+ * Returns the decoded length, or -1 if it isn't valid COBS.
+ */
+static int cobs_decode(const uint8_t* in, int len, uint8_t* out) {
+	int i = 0;
+	int n = 0;
+	while (i < len) {
+		int code = in[i++];
+		if (code == 0 || i + code - 1 > len) {
+			return -1;
+		}
+		for (int j = 1; j < code; j++) {
+			out[n++] = in[i++];
+		}
+		if (code < 0xFF && i < len) {
+			out[n++] = 0;
+		}
+	}
+	return n;
+}
+
+/*
+ * Copies the next null terminated string from data into dest, returning
+ * the position after it or NULL if there isn't one.
+ */
+static const uint8_t* take_string(const uint8_t* data, const uint8_t* end,
+		char* dest) {
+	const uint8_t* zero = memchr(data, 0, end - data);
+	if (zero == NULL || zero - data >= MAX_STRING) {
+		return NULL;
+	}
+	memcpy(dest, data, zero - data + 1);
+	return zero + 1;
+}
+
+static void handle_schema(const uint8_t* data, int len) {
+	if (len < 1) {
+		return;
+	}
+	Schema* s = &schema[data[0]];
+	const uint8_t* end = data + len;
+	const uint8_t* p = data + 1;
+	if ((p = take_string(p, end, s->name)) == NULL
+			|| (p = take_string(p, end, s->format)) == NULL
+			|| (p = take_string(p, end, s->fields)) == NULL) {
+		return;
+	}
+	if (!s->known) {
+		printf("schema %u: %s %s (%s)\n", data[0], s->name, s->format, s->fields);
+	}
+	s->known = 1;
+}
+
+/*
+ * Prints the next field name from *fields (or a number if there are no
+ * names left).
+ */
+static void print_field_name(const char** fields, int index) {
+	const char* comma = strchr(*fields, ',');
+	int len = comma ? (int)(comma - *fields) : (int)strlen(*fields);
+	if (len > 0) {
+		printf(" %.*s=", len, *fields);
+	} else {
+		printf(" %d=", index);
+	}
+	*fields += comma ? len + 1 : len;
+}
+
+static void print_record(uint8_t id, const uint8_t* data, int len) {
+	Schema* s = &schema[id];
+	s->count++;
+	if (!s->known) {
+		printf("record %u:", id);
+		for (int i = 0; i < len; i++) {
+			printf(" %02x", data[i]);
+		}
+		printf("\n");
+		return;
+	}
+	printf("%s", s->name);
+	const char* format = s->format;
+	const char* fields = s->fields;
+	int pos = 0;
+	int index = 0;
+	while (*format && pos < len) {
+		char type = *format++;
+		int size = type == 'L' ? 4 : type == 'H' ? 2 : 1;
+		int repeat = (*format == '*');
+		print_field_name(&fields, index++);
+		if (repeat) {
+			format++;
+			printf("[");
+		}
+		do {
+			if (pos + size > len) {
+				break;
+			}
+			uint32_t value = 0;
+			for (int i = size - 1; i >= 0; i--) {
+				value = (value << 8) | data[pos + i];
+			}
+			pos += size;
+			printf(repeat && pos + size <= len ? "%lu " : "%lu",
+					(unsigned long)value);
+		} while (repeat && pos < len);
+		if (repeat) {
+			printf("]");
+		}
+	}
+	printf("\n");
+}
+
+/*
+ * Handles the bytes between two 0 bytes: a telemetry frame if it decodes
+ * and its CRC is right, otherwise terminal text.
+ */
+static void handle_block(const uint8_t* block, int len) {
+	if (len == 0) {
+		return;
+	}
+	uint8_t data[MAX_FRAME];
+	int n = cobs_decode(block, len, data);
+	if (n >= 4) {
+		uint16_t crc = 0xFFFF;
+		for (int i = 0; i < n - 2; i++) {
+			crc = crc_ccitt_update(crc, data[i]);
+		}
+		if (crc == (data[n-2] | (data[n-1] << 8))) {
+			good_frames++;
+			uint8_t sequence = data[1];
+			if (last_sequence >= 0) {
+				missed_frames += (uint8_t)(sequence - last_sequence - 1);
+			}
+			last_sequence = sequence;
+			if (data[0] == RECORD_SCHEMA) {
+				handle_schema(data + 2, n - 4);
+			} else {
+				print_record(data[0], data + 2, n - 4);
+			}
+			fflush(stdout);
+			return;
+		}
+	}
+	if (show_text) {
+		fwrite(block, 1, len, stdout);
+		fflush(stdout);
+	}
+}
+
+/*
+ * Puts a serial port into raw mode at the given baud rate.
+ */
+static int set_raw(int fd, long baud) {
+	static const struct {
+		long rate;
+		speed_t speed;
+	} rates[] = {
+		{9600, B9600}, {19200, B19200}, {38400, B38400}, {57600, B57600},
+		{115200, B115200}, {230400, B230400},
+#ifdef B500000
+		{500000, B500000},
+#endif
+	};
+	struct termios tio;
+	if (tcgetattr(fd, &tio) < 0) {
+		return -1;
+	}
+	cfmakeraw(&tio);
+	for (size_t i = 0; i < sizeof(rates) / sizeof(rates[0]); i++) {
+		if (rates[i].rate == baud) {
+			cfsetispeed(&tio, rates[i].speed);
+			cfsetospeed(&tio, rates[i].speed);
+			return tcsetattr(fd, TCSANOW, &tio);
+		}
+	}
+	fprintf(stderr, "unsupported baud rate %ld\n", baud);
+	errno = EINVAL;
+	return -1;
+}
+
+int main(int argc, char** argv) {
+	long baud = 19200;
+	int opt;
+	while ((opt = getopt(argc, argv, "b:t")) != -1) {
+		switch (opt) {
+			case 'b':
+				baud = strtol(optarg, NULL, 10);
+				break;
+			case 't':
+				show_text = 1;
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-b baud] [-t] [port or file]\n", argv[0]);
+				return 2;
+		}
+	}
+	int fd = 0;
+	if (optind < argc) {
+		fd = open(argv[optind], O_RDONLY | O_NOCTTY);
+		if (fd < 0) {
+			perror(argv[optind]);
+			return 1;
+		}
+	}
+	if (isatty(fd) && set_raw(fd, baud) < 0) {
+		perror("setting up serial port");
+		return 1;
+	}
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = handle_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	uint8_t block[MAX_FRAME];
+	int len = 0;
+	uint8_t buf[256];
+	while (!stop) {
+		ssize_t got = read(fd, buf, sizeof(buf));
+		if (got < 0 && errno == EINTR) {
+			continue;
+		}
+		if (got <= 0) {
+			break;
+		}
+		for (ssize_t i = 0; i < got; i++) {
+			if (buf[i] == 0) {
+				handle_block(block, len);
+				len = 0;
+			} else if (len < MAX_FRAME) {
+				block[len++] = buf[i];
+			} else {
+				// Too long to be a frame - must be text
+				handle_block(block, len);
+				block[0] = buf[i];
+				len = 1;
+			}
+		}
+	}
+	if (show_text) {
+		fwrite(block, 1, len, stdout);
+	}
+
+	fprintf(stderr, "\n%lu frames, %lu missed\n", good_frames, missed_frames);
+	for (int id = 1; id < 256; id++) {
+		if (schema[id].count) {
+			fprintf(stderr, "  %-12s %lu\n",
+					schema[id].known ? schema[id].name : "(unknown)",
+					schema[id].count);
+		}
+	}
+	return 0;
+}